@@ -0,0 +1,105 @@
+#include "affinity.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
+
+// Reads the first line of a sysfs file. Returns empty string if it cannot be read.
+static std::string readSysfsLine(const std::string& path) {
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+/*
+  Builds the list of nodes from sysfs. Only CPUs which the process
+  is allowed to run on are used (e.g. when started with taskset or in a container).
+*/
+CalcLumTopology::CalcLumTopology() {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (0 != sched_getaffinity(0, sizeof(allowed), &allowed)) {
+    for (auto cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      CPU_SET(cpu, &allowed);
+    }
+  }
+
+  std::vector<int> node_ids = parseCpuList(readSysfsLine("/sys/devices/system/node/online"));
+  for (auto node : node_ids) {
+    std::vector<int> cpus = parseCpuList(
+        readSysfsLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+    cpus.erase(std::remove_if(cpus.begin(), cpus.end(),
+                              [&allowed](int cpu){ return (cpu >= CPU_SETSIZE) || !CPU_ISSET(cpu, &allowed); }),
+               cpus.end());
+    if (!cpus.empty()) {
+      nodes_.push_back(cpus);
+    }
+  }
+
+  if (nodes_.empty()) {
+    // no NUMA information. All allowed CPUs are in one node.
+    std::vector<int> cpus;
+    for (auto cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &allowed)) {
+        cpus.push_back(cpu);
+      }
+    }
+    nodes_.push_back(cpus);
+  }
+}
+
+CalcLumTopology::CalcLumTopology(const std::vector<std::vector<int> >& nodes) : nodes_(nodes) {
+}
+
+int CalcLumTopology::getNodeOfCpu(int cpu) const {
+  for (size_t node = 0; node < nodes_.size(); node++) {
+    if (nodes_[node].end() != std::find(nodes_[node].begin(), nodes_[node].end(), cpu)) {
+      return node;
+    }
+  }
+  return -1;
+}
+
+int CalcLumTopology::getCurrentNode() const {
+  int cpu = sched_getcpu();
+  if (cpu < 0) {
+    return -1;
+  }
+  return getNodeOfCpu(cpu);
+}
+
+int CalcLumTopology::getWorkerCpu(int worker) const {
+  const std::vector<int>& cpus = nodes_[getWorkerNode(worker)];
+  return cpus[(worker / nodes_.size()) % cpus.size()];
+}
+
+std::vector<int> CalcLumTopology::parseCpuList(const std::string& list) {
+  std::vector<int> cpus;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty()) {
+      continue;
+    }
+    size_t dash = range.find('-');
+    int first = std::atoi(range.substr(0, dash).c_str());
+    int last = (std::string::npos == dash) ? first : std::atoi(range.substr(dash + 1).c_str());
+    for (auto cpu = first; cpu <= last; cpu++) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+bool CalcLumTopology::pinCurrentThread(const std::vector<int>& cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto cpu : cpus) {
+    if (cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  return 0 == pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
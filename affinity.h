@@ -0,0 +1,39 @@
+#pragma once
+#include <vector>
+#include <string>
+
+/*
+  CalcLumTopology describes NUMA nodes and CPUs which the process is allowed to run on.
+  It is used to pin reader and worker threads, so threads are spread evenly across nodes
+  and frames decoded on a node are processed by workers on the same node.
+  Nodes are read from sysfs (/sys/devices/system/node). When it is not available,
+  all CPUs are treated as a single node.
+*/
+class CalcLumTopology {
+public:
+  // Reads topology of the system.
+  CalcLumTopology();
+  // Topology with the given nodes. Each node is a list of CPUs.
+  CalcLumTopology(const std::vector<std::vector<int> >& nodes);
+
+  int getNodesNum() const { return nodes_.size(); }
+  const std::vector<int>& getNodeCpus(int node) const { return nodes_[node]; }
+  // Returns -1 when the CPU does not belong to any node.
+  int getNodeOfCpu(int cpu) const;
+  // Node the calling thread is running on right now.
+  int getCurrentNode() const;
+
+  // Workers are assigned to nodes round-robin and then to single CPUs within the node.
+  int getWorkerNode(int worker) const { return worker % nodes_.size(); }
+  int getWorkerCpu(int worker) const;
+  // Readers are assigned to nodes round-robin and may run on any CPU of the node.
+  int getReaderNode(int reader) const { return reader % nodes_.size(); }
+
+  // Parses sysfs CPU list, for example "0-3,8,10-11".
+  static std::vector<int> parseCpuList(const std::string& list);
+  // Pins the calling thread to the set of CPUs.
+  static bool pinCurrentThread(const std::vector<int>& cpus);
+
+private:
+  std::vector<std::vector<int> > nodes_;
+};
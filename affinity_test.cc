@@ -0,0 +1,52 @@
+/*
+  Set of unit tests for CPU topology and thread placement.
+*/
+#include <gtest/gtest.h>
+#include <thread>
+#include "affinity.h"
+
+TEST(topology, parseCpuList) {
+  std::vector<int> expected = {0, 1, 2, 3, 8, 10, 11};
+  ASSERT_EQ(expected, CalcLumTopology::parseCpuList("0-3,8,10-11"));
+  ASSERT_EQ(std::vector<int>({5}), CalcLumTopology::parseCpuList("5"));
+  ASSERT_TRUE(CalcLumTopology::parseCpuList("").empty());
+}
+
+TEST(topology, workersSpreadAcrossNodes) {
+  CalcLumTopology topology({{0, 1, 2, 3}, {4, 5, 6, 7}});
+
+  ASSERT_EQ(0, topology.getWorkerCpu(0));
+  ASSERT_EQ(4, topology.getWorkerCpu(1));
+  ASSERT_EQ(1, topology.getWorkerCpu(2));
+  ASSERT_EQ(5, topology.getWorkerCpu(3));
+  // more workers than CPUs wrap around
+  ASSERT_EQ(0, topology.getWorkerCpu(8));
+  ASSERT_EQ(1, topology.getWorkerNode(3));
+  ASSERT_EQ(0, topology.getReaderNode(2));
+}
+
+TEST(topology, nodeOfCpu) {
+  CalcLumTopology topology({{0, 2}, {1, 3}});
+
+  ASSERT_EQ(0, topology.getNodeOfCpu(2));
+  ASSERT_EQ(1, topology.getNodeOfCpu(3));
+  ASSERT_EQ(-1, topology.getNodeOfCpu(4));
+}
+
+TEST(topology, systemTopology) {
+  CalcLumTopology topology;
+
+  ASSERT_LE(1, topology.getNodesNum());
+  ASSERT_FALSE(topology.getNodeCpus(0).empty());
+  // thread pinned to a CPU of a node runs on that node
+  std::thread t([&topology]{
+    ASSERT_TRUE(CalcLumTopology::pinCurrentThread({topology.getWorkerCpu(0)}));
+    ASSERT_EQ(topology.getWorkerNode(0), topology.getCurrentNode());
+  });
+  t.join();
+}
+
+int main(int argc, char **argv) {
+ ::testing::InitGoogleTest(&argc, argv);
+ return RUN_ALL_TESTS();
+}
@@ -2,9 +2,9 @@
   This file implements main thread. 
   Steps: 
    - processes command line parameters 
-   - creates a list of found files
    - creates scheduler with specified number of threads
-   - opens each file and sequentially reads video frame by video frame.
+   - creates reader threads which open files and read video frame by video frame.
+   - finds files in the directory (and sub-directories) and gives them to reader threads
    - frames are packaged into jobs and sent to the scheduler for processing
    - worker threads pick the jobs and process them updating file-specific shared stats
    - when all files has been processed, the main thread waits until worked threads finish
@@ -13,29 +13,238 @@
 #include <unistd.h>
 #include "frameJob.h"
 #include "scheduler.h"
+#include "config.h"
+#include "reader.h"
+#include "resultCache.h"
+#include "dirWatcher.h"
+#include "discovery.h"
+#include "profiler.h"
+#include "series.h"
+#include "partialStats.h"
 #include <string>
 #include <list>
 #include <tuple>
+#include <thread>
+#include <algorithm>
+#include <set>
+#include <vector>
+#include <csignal>
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <dirent.h>
+#include <mutex>
+#include <fcntl.h>
 #include <iostream>
+#include <iomanip>
 
 /*
-  Function takes list of files to process.
-  It opens each file and extracts frame by frame and sends them to the scheduler for procesing. 
+  Parameters which change results of a file. Cached results are used only when they were
+  calculated with the same parameters.
 */
-int processFiles(int threads_num, std::list<std::string> files) {
-  // Create a list with assotiated file contexts.
+static std::string cacheSignature(const CalcLumConfig& config) {
+  std::string signature = "sample_step=" + std::to_string(config.sample_step) +
+                          " frame_step=" + std::to_string(config.frame_step) +
+                          " native_yuv=" + std::to_string(config.native_yuv) + " exact=" + std::to_string(config.exact);
+  // whole frames keep the old signature, so results cached before regions existed are still used
+  if (nullptr != config.roi) {
+    signature += " roi=" + config.roi->getSignature();
+  }
+  return signature;
+}
+
+/*
+  Reads the mask of the region of interest. Any image OpenCV can read is accepted, non zero pixels are used.
+  Returns nullptr when it cannot be read or no pixel is set.
+*/
+static std::shared_ptr<const CalcLumRoiSpec> loadRoiMask(const std::string& path) {
+  cv::Mat image = cv::imread(path, cv::IMREAD_GRAYSCALE);
+  if (image.empty()) {
+    return nullptr;
+  }
+  std::vector<uint8_t> mask;
+  mask.reserve(static_cast<size_t>(image.rows) * image.cols);
+  for (auto i = 0; i < image.rows; i++) {
+    const uint8_t* row = image.ptr(i);
+    mask.insert(mask.end(), row, row + image.cols);
+  }
+  if (std::all_of(mask.begin(), mask.end(), [](uint8_t value) { return 0 == value; })) {
+    return nullptr;
+  }
+  return std::make_shared<const CalcLumRoiSpec>(CalcLumRoiSpec::fromMask(image.rows, image.cols, std::move(mask)));
+}
+
+// Creates context of a file. In exact mode it keeps the fine histogram too.
+static std::shared_ptr<CalcLumFileCtx> newFileCtx(const CalcLumConfig& config, const std::string& file_name) {
+  std::shared_ptr<CalcLumFileCtx> file_ctx = std::make_shared<CalcLumFileCtx>(file_name);
+  if (config.exact) {
+    file_ctx->setExact();
+  }
+  // The file is found now and read later, its identity must be the one of the version read.
+  CalcLumFileIdentity identity;
+  if (CalcLumFileIdentity::fromFile(file_name, identity)) {
+    file_ctx->setIdentity(identity);
+  }
+  return file_ctx;
+}
+
+// Number of threads listing directories.
+static const int kWalkersNum = 4;
+
+// Set by SIGINT or SIGTERM in watch mode.
+static volatile sig_atomic_t stop_requested = 0;
+
+static void stopHandler(int) {
+  stop_requested = 1;
+}
+
+static void printAggregatedStats(const CalcLumConfig& config, StatsAggregator& aggr) {
+  if (config.exact) {
+    std::cout << std::fixed << std::setprecision(4);
+    std::cout << "  min luminance:    " << aggr.calcExactMin() << std::endl;
+    std::cout << "  max luminance:    " << aggr.calcExactMax() << std::endl;
+    std::cout << "  mean luminance:   " << aggr.calcExactMean() << std::endl;
+    std::cout << "  median luminance: " << aggr.calcExactMedian() << std::endl;
+    std::cout << std::defaultfloat;
+  } else {
+    std::cout << "  min luminance:    " << aggr.calcMin() << std::endl;
+    std::cout << "  max luminance:    " << aggr.calcMax() << std::endl;
+    std::cout << "  mean luminance:   " << aggr.calcMean() << std::endl;
+    std::cout << "  median luminance: " << aggr.calcMedian() << std::endl;
+  }
+  if ((1 < config.frame_step) || (aggr.calcFramesSampled() != aggr.calcFramesTotal())) {
+    std::cout << "  frames sampled:   " << aggr.calcFramesSampled() << " of " << aggr.calcFramesTotal() << std::endl;
+  }
+}
+
+/*
+  Watch mode. New files closed after writing or moved into the directory are given to the reader
+  threads. Only files passing the -I and -E filters of discovery are taken. The watcher is created
+  before the directory is listed, so a file found by discovery may have been read while it was still
+  being written. When such a file reports that it has been written, it is processed again and the new
+  result replaces the old one. Otherwise each file is processed once, later changes are ignored.
+  When a file has been processed, its statistics are added to a live aggregator and
+  aggregated statistics of all files processed so far are displayed. Old files are not read again.
+*/
+static void watchDirectory(const CalcLumConfig& config, const std::string& dir, CalcLumDirWatcher& watcher,
+                           const CalcLumDiscovery& discovery, CalcLumReader& reader,
+                           std::list<std::tuple<cv::String, std::shared_ptr<CalcLumFileCtx> > >& filesToProcess) {
+  if (!watcher.isValid()) {
+    std::cout << "Cannot watch directory " << dir << std::endl;
+    return;
+  }
+  struct sigaction action = {};
+  action.sa_handler = stopHandler;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+  std::cout << "Watching " << dir << " for new files, press Ctrl+C to stop ...." << std::endl;
+
+  std::set<std::string> known_files;
+  // files found by discovery which have not reported being written yet
+  std::set<std::string> discovered;
+  std::list<std::shared_ptr<CalcLumFileCtx> > pending;
+  for (auto file : filesToProcess) {
+    known_files.insert(std::get<0>(file));
+    discovered.insert(std::get<0>(file));
+    pending.push_back(std::get<1>(file));
+  }
+
+  std::unique_ptr<StatsAggregator> live_aggr = std::make_unique<StatsAggregator>();
+  while (!stop_requested) {
+    std::list<std::string> new_files;
+    if (!watcher.waitForFiles(new_files, 250)) {
+      std::cout << "Cannot watch directory " << dir << std::endl;
+      break;
+    }
+    bool replaced = false;
+    for (auto file : new_files) {
+      // -I and -E apply to new files too
+      if (!discovery.accepts(file.substr(file.find_last_of('/') + 1))) {
+        continue;
+      }
+      if (0 < discovered.erase(file)) {
+        // The old context is left to finish, only its result is dropped.
+        std::cout << file << "->> Written after it was found, processing again" << std::endl;
+        auto found = std::find_if(filesToProcess.begin(), filesToProcess.end(),
+                                  [&file](const std::tuple<cv::String, std::shared_ptr<CalcLumFileCtx> >& it) {
+                                    return std::get<0>(it) == file;
+                                  });
+        pending.remove(std::get<1>(*found));
+        std::get<1>(*found) = newFileCtx(config, file);
+        pending.push_back(std::get<1>(*found));
+        reader.addFile(std::get<1>(*found));
+        replaced = true;
+        continue;
+      }
+      if (!known_files.insert(file).second) {
+        std::cout << file << "->> Already processed, change ignored" << std::endl;
+        continue;
+      }
+      std::cout << "Found file " << file << std::endl;
+      std::shared_ptr<CalcLumFileCtx> file_ctx = newFileCtx(config, file);
+      filesToProcess.push_back(std::make_tuple(file, file_ctx));
+      pending.push_back(file_ctx);
+      reader.addFile(file_ctx);
+    }
+
+    if (replaced) {
+      // the old result may have been aggregated already, so start again from files processed so far
+      live_aggr = std::make_unique<StatsAggregator>();
+      for (auto file : filesToProcess) {
+        std::shared_ptr<CalcLumFileCtx> file_ctx = std::get<1>(file);
+        if ((pending.end() == std::find(pending.begin(), pending.end(), file_ctx)) && !file_ctx->isError()) {
+          live_aggr->addFileCtx(file_ctx);
+        }
+      }
+    }
+
+    bool updated = false;
+    for (auto it = pending.begin(); it != pending.end(); ) {
+      if (!(*it)->isFinished()) {
+        ++it;
+        continue;
+      }
+      if (!(*it)->isError()) {
+        live_aggr->addFileCtx(*it);
+        updated = true;
+      }
+      it = pending.erase(it);
+    }
+    if (updated) {
+      std::cout << "Aggregated statistics so far:" << std::endl;
+      printAggregatedStats(config, *live_aggr);
+    }
+  }
+}
+
+/*
+  Function finds files in dir and processes them.
+  Reader threads open files and extract frame by frame and send them to the scheduler for procesing. 
+  Files are given to reader threads as soon as they are found, so processing starts while the directory
+  tree is still being listed.
+  In watch mode files which appear in dir are processed too, until calclum is stopped by SIGINT or SIGTERM.
+*/
+int processFiles(const CalcLumConfig& config, const std::string& dir) {
+  // A list of found files with assotiated file contexts.
   std::list<std::tuple<cv::String, std::shared_ptr<CalcLumFileCtx> > > filesToProcess;
-  for (auto file : files) {
-    std::tuple<cv::String, std::shared_ptr<CalcLumFileCtx> > t = 
-        std::make_tuple(file, std::make_shared<CalcLumFileCtx>(file));
-    filesToProcess.push_back(t);
+
+  // Profiler is created first, SIGUSR1 must be blocked before any other thread is started.
+  std::shared_ptr<CalcLumProfiler> profiler;
+  if (config.profile || !config.profile_json.empty()) {
+    profiler = std::make_shared<CalcLumProfiler>();
+    profiler->startSignalThread();
   }
 
   // Now create scheduler
-  CalcLumScheduler s(threads_num);
+  CalcLumScheduler s(config.threads_num, config.work_stealing ? CalcLumSchedulingMode::WorkStealing :
+                                                              CalcLumSchedulingMode::GlobalQueue);
+  std::shared_ptr<CalcLumTopology> topology;
+  if (config.pin_threads) {
+    topology = std::make_shared<CalcLumTopology>();
+    std::cout << "Pinning threads to " << topology->getNodesNum() << " NUMA node(s)" << std::endl;
+    s.setTopology(topology);
+  }
+  if (nullptr != profiler) {
+    s.setProfiler(profiler);
+  }
   s.start();
 
   // create condition variable to provide feedback from working threads that
@@ -47,48 +256,109 @@ int processFiles(int threads_num, std::list<std::string> files) {
   std::shared_ptr<std::mutex> cv_m = std::make_shared<std::mutex>();    
   std::shared_ptr<int> files_to_process = std::make_shared<int>(0);
 
-  // Now iterate through all files, read frame by frame and send them to the scheduler for processing.
-  for(auto file : filesToProcess) {
-    cv::VideoCapture vc;
-    cv::String fileName = std::get<0>(file);
-    std::shared_ptr<CalcLumFileCtx> fileCtx = std::get<1>(file);
-
-    if (!vc.open(fileName)) {
-      std::cout << fileName << "->> Invalid file" << std::endl; 
-      fileCtx->setError();
-      vc.release();
-      continue;
-    }
- 
-    fileCtx->setSyncVars(cv, cv_m, files_to_process);
-    (*files_to_process)++;
-
-    std::unique_ptr<CalcLumFrameJob> jobToProcess;
-    while(true) {
-      // create a new frame processing job
-      std::unique_ptr<CalcLumFrameJob> newJob = std::make_unique<CalcLumFrameJob>();
-      // read new frame to the job class
-      if(vc.read(newJob->getFrame())) {
-        fileCtx->incFramesRead();
-        // we got the next frame. Setup job's fields.
-        newJob->setFileCtx(fileCtx);
-        if(nullptr != jobToProcess) {
-	  s.addJob(std::move(jobToProcess));
+  // Create reader threads and give them all files. Each reader thread reads one file
+  // at a time, frame by frame, and sends frames to the scheduler for processing.
+  CalcLumReader reader(s, config, config.readers_num);
+  reader.setSyncVars(cv, cv_m, files_to_process);
+  if (nullptr != topology) {
+    reader.setTopology(topology);
+  }
+  if (nullptr != profiler) {
+    reader.setProfiler(profiler);
+  }
+  // Luminance of each frame is written on a background thread as soon as it is known.
+  std::shared_ptr<CalcLumSeriesWriter> series_writer;
+  if (!config.series_path.empty()) {
+    series_writer = std::make_shared<CalcLumSeriesWriter>(config.series_path);
+    if (!series_writer->isOpen()) {
+      std::cout << "Cannot write time series " << config.series_path << std::endl;
+      reader.finish();
+      s.stopThreads();
+      return 1;
+    }
+    series_writer->start();
+    reader.setSeriesWriter(series_writer);
+  }
+  reader.start();
+
+  // Files which have not changed since the last run are not read at all.
+  std::unique_ptr<CalcLumResultCache> cache;
+  if (!config.cache_path.empty()) {
+    cache = std::make_unique<CalcLumResultCache>(config.cache_path, cacheSignature(config));
+    cache->load();
+  }
+  // In watch mode the directory is watched before it is listed, so no file written meanwhile is missed.
+  std::unique_ptr<CalcLumDirWatcher> watcher;
+  if (config.watch && !dir.empty()) {
+    watcher = std::make_unique<CalcLumDirWatcher>(dir);
+  }
+  // The filters of discovery are used in watch mode too.
+  CalcLumDiscovery discovery(dir, config.recursive, kWalkersNum);
+  for (const auto& pattern : config.includes) {
+    discovery.addInclude(pattern);
+  }
+  for (const auto& pattern : config.excludes) {
+    discovery.addExclude(pattern);
+  }
+  if (!dir.empty()) {
+    // Files are found by several walker threads, the list and the cache are guarded by files_m.
+    std::mutex files_m;
+    bool listed = discovery.run([&](const std::string& file) {
+      std::lock_guard<std::mutex> lk(files_m);
+      std::cout << "Found file " << file << std::endl;
+      std::shared_ptr<CalcLumFileCtx> file_ctx = newFileCtx(config, file);
+      filesToProcess.push_back(std::make_tuple(file, file_ctx));
+
+      CalcLumStats stats;
+      int frames_total = 0;
+      CalcLumFileIdentity identity;
+      if ((nullptr != cache) && file_ctx->getIdentity(identity) && cache->lookup(file, identity, stats, frames_total) &&
+          (0 < stats.frames)) {
+        file_ctx->loadStats(stats, frames_total);
+        std::cout << file_ctx->getFileName() << "->> Average file luminance: ";
+        if (file_ctx->isExact()) {
+          std::cout << std::fixed << std::setprecision(4) << file_ctx->getExactAverageLuminance() << std::defaultfloat;
+        } else {
+          std::cout << file_ctx->getFileAverageLuminance();
         }
-        jobToProcess = std::move(newJob);
+        std::cout << " (cached)" << std::endl;
+        return;
       }
-      else {
-        // mark that entire file has been read
-        fileCtx->setEOF();
-        // send the last read frame. EOF is set now, so we get notified when the last frame has been processed.
-        assert(nullptr != jobToProcess);
-        s.addJob(std::move(jobToProcess)); 
-        break; // exit loop and go to the next file
+      reader.addFile(file_ctx);
+    });
+
+    if (!listed || (filesToProcess.empty() && !config.watch && config.raw_input.empty())) {
+      std::cout << (listed ? "No files found ...." : "Cannot access directory " + dir) << std::endl;
+      reader.finish();
+      s.stopThreads();
+      return 1;
+    }
+  }
+
+  if (!config.raw_input.empty()) {
+    // Raw frames are read on this thread, reader threads are not used.
+    int fd = (config.raw_input == "-") ? STDIN_FILENO : open(config.raw_input.c_str(), O_RDONLY);
+    std::string name = (config.raw_input == "-") ? std::string("stdin") : config.raw_input;
+    std::shared_ptr<CalcLumFileCtx> file_ctx = newFileCtx(config, name);
+    filesToProcess.push_back(std::make_tuple(name, file_ctx));
+    if (-1 == fd) {
+      std::cout << name << "->> Cannot open" << std::endl;
+      file_ctx->setError();
+    } else {
+      reader.readRawStream(fd, file_ctx, config.raw_format);
+      if (STDIN_FILENO != fd) {
+        close(fd);
       }
     }
-    vc.release();
   }
 
+  if (nullptr != watcher) {
+    watchDirectory(config, dir, *watcher, discovery, reader, filesToProcess);
+  }
+
+  // wait until all files have been read
+  reader.finish();
+
   // All frames from all files have been sent to the scheduler.
   // Now wait on the conditional variable until all files have been processed.
   std::unique_lock<std::mutex> lk(*cv_m);
@@ -96,6 +366,45 @@ int processFiles(int threads_num, std::list<std::string> files) {
 
   s.stopThreads();
 
+  if (nullptr != series_writer) {
+    series_writer->finish();
+  }
+
+  if (nullptr != cache) {
+    for(auto file : filesToProcess) {
+      std::shared_ptr<CalcLumFileCtx> file_ctx = std::get<1>(file);
+      CalcLumFileIdentity identity;
+      if(!file_ctx->isError() && file_ctx->getIdentity(identity)) {
+        cache->store(std::get<0>(file), identity, file_ctx->getStats(), file_ctx->getFramesTotal());
+      }
+    }
+    if (!cache->save()) {
+      std::cout << "Cannot write result cache " << config.cache_path << std::endl;
+    }
+  }
+
+  if (!config.partial_path.empty()) {
+    CalcLumPartialStats partial;
+    partial.setSignature(cacheSignature(config));
+    for(auto file : filesToProcess) {
+      std::shared_ptr<CalcLumFileCtx> file_ctx = std::get<1>(file);
+      if(!file_ctx->isError()) {
+        partial.add(std::get<0>(file), file_ctx->getStats(), file_ctx->getFramesTotal());
+      }
+    }
+    if (!partial.save(config.partial_path)) {
+      std::cout << "Cannot write partial stats " << config.partial_path << std::endl;
+    }
+  }
+
+  if (nullptr != profiler) {
+    std::cout << std::endl;
+    profiler->printSummary(std::cout);
+    if (!config.profile_json.empty() && !profiler->writeJSON(config.profile_json)) {
+      std::cout << "Cannot write profile " << config.profile_json << std::endl;
+    }
+  }
+
   // Now display all aggregated stats 
   // Create stats aggregator and add file contexts for all successfully processed files.
   StatsAggregator aggr;
@@ -115,36 +424,149 @@ int processFiles(int threads_num, std::list<std::string> files) {
   }
 
   std::cout << "Aggregated statistics across all processed files:" << std::endl;
-  std::cout << "  min luminance:    " << aggr.calcMin() << std::endl;
-  std::cout << "  max luminance:    " << aggr.calcMax() << std::endl;
-  std::cout << "  mean luminance:   " << aggr.calcMean() << std::endl;
-  std::cout << "  median luminance: " << aggr.calcMedian() << std::endl;
+  printAggregatedStats(config, aggr);
   
   return 0;
 }
 
+/*
+  Merge mode. Statistics of files processed by other runs (see -O) are combined without reading any video.
+  Each file is loaded into a context, as if it was taken from the result cache, so the results are
+  the same as if all files had been processed by one run.
+*/
+int mergePartialStats(CalcLumConfig config, const std::vector<std::string>& paths) {
+  CalcLumPartialStats partial;
+  for (const auto& path : paths) {
+    size_t files_num = partial.getEntries().size();
+    if (!partial.load(path)) {
+      std::cout << "Cannot read partial stats " << path << std::endl;
+      return 1;
+    }
+    std::cout << "Merged " << path << ": " << partial.getEntries().size() - files_num << " files" << std::endl;
+  }
+  if (0 < partial.getDuplicatesNum()) {
+    std::cout << partial.getDuplicatesNum() << " files given more than once, counted once" << std::endl;
+  }
+  // Results of different parameters (e.g. sampling or a region) cannot be compared, merging them is a mistake
+  // unless it is asked for. -O then saves the merged files as mixed.
+  if (partial.hasMixedSignatures()) {
+    if (!config.force_merge) {
+      std::cout << "Partial stats were calculated with different parameters, use --force to merge them anyway" <<
+          std::endl;
+      return 1;
+    }
+    std::cout << "Warning: partial stats were calculated with different parameters" << std::endl;
+  }
+  if (!config.partial_path.empty() && !partial.save(config.partial_path)) {
+    std::cout << "Cannot write partial stats " << config.partial_path << std::endl;
+  }
+
+  // exact results only when all files have them
+  config.exact = partial.isExact();
+  if (!config.exact && (0 < partial.getExactNum())) {
+    std::cout << "Warning: " << partial.getEntries().size() - partial.getExactNum() << " of " <<
+        partial.getEntries().size() << " files were not processed in exact mode, results are not exact" << std::endl;
+  }
+  StatsAggregator aggr;
+  for (const auto& entry : partial.getEntries()) {
+    std::shared_ptr<CalcLumFileCtx> file_ctx = newFileCtx(config, entry.file_name);
+    file_ctx->loadStats(entry.stats, entry.frames_total);
+    aggr.addFileCtx(file_ctx);
+  }
+
+  std::cout << std::endl;
+  std::cout << "=================================================" << std::endl;
+  if(aggr.empty()) {
+    std::cout << "No files were successfully processed" << std::endl;
+    return 1;
+  }
+  std::cout << "Aggregated statistics across all merged files:" << std::endl;
+  printAggregatedStats(config, aggr);
+  return 0;
+}
+
 void show_usage(std::string name) {
-  std::cout << "Usage: " << name << " -d DIR -t THREADS_NUM" << std::endl;
-  std::cout << "       " << "THREADS_NUM is number between 1 and 15" << std::endl;
+  std::cout << "Usage: " << name << " -d DIR|-i INPUT -g WIDTHxHEIGHT [-F FORMAT] -t THREADS_NUM|auto [-r READERS_NUM] [-s SEGMENTS_NUM] [-m FRAMES_NUM] [-b BATCH_SIZE|auto] [-w] [-p] [-y] [-x SAMPLE_STEP] [-k FRAME_STEP] [-e] [-o X,Y,WIDTH,HEIGHT|-M MASK_FILE|-L] [-c CACHE_FILE|auto] [-f] [-R] [-I PATTERN] [-E PATTERN] [-u] [-T TIMEOUT] [-P] [-J PROFILE_FILE] [-S SERIES_FILE] [-O PARTIAL_FILE]" << std::endl;
+  std::cout << "       " << name << " --merge PARTIAL_FILE... [-O PARTIAL_FILE] [--force]" << std::endl;
+  std::cout << "       " << "THREADS_NUM is number of worker threads, auto uses one per CPU" << std::endl;
+  std::cout << "       " << "READERS_NUM is number of files decoded in parallel, default 1" << std::endl;
+  std::cout << "       " << "SEGMENTS_NUM is number of segments long files are split into, default 1" << std::endl;
+  std::cout << "       " << "FRAMES_NUM is maximum number of frames kept in memory" << std::endl;
+  std::cout << "       " << "BATCH_SIZE is number of frames processed by one job, default 1" << std::endl;
+  std::cout << "       " << "-w use work stealing scheduler" << std::endl;
+  std::cout << "       " << "-p pin threads to CPUs and keep frames on the NUMA node they were decoded on" << std::endl;
+  std::cout << "       " << "-y decode frames to native YUV and use only Y plane, usually limited range (16-235), not full range BGR luma" << std::endl;
+  std::cout << "       " << "SAMPLE_STEP uses only every Nth pixel of every Nth row (approximate), default 1" << std::endl;
+  std::cout << "       " << "FRAME_STEP processes only every Nth frame, others are skipped without decoding to BGR, default 1" << std::endl;
+  std::cout << "       " << "-e exact mode, luminance is not rounded to whole numbers" << std::endl;
+  std::cout << "       " << "X,Y,WIDTH,HEIGHT is the only rectangle of frames used, e.g. 0,140,1920,800" << std::endl;
+  std::cout << "       " << "MASK_FILE is an image whose non zero pixels are the only pixels of frames used" << std::endl;
+  std::cout << "       " << "-L leave out black bars (letterbox) detected once per file" << std::endl;
+  std::cout << "       " << "CACHE_FILE keeps results of unchanged files between runs, auto uses ~/.cache/calclum" << std::endl;
+  std::cout << "       " << "INPUT is a file or pipe with raw frames, - reads frames from stdin" << std::endl;
+  std::cout << "       " << "FORMAT is pixel format of raw frames: y, yuv420, yuv422, yuv444 or bgr, default yuv420" << std::endl;
+  std::cout << "       " << "-R process files in sub-directories of DIR too" << std::endl;
+  std::cout << "       " << "-I process only files matching PATTERN (e.g. '*.mp4'), may be repeated" << std::endl;
+  std::cout << "       " << "-E skip files and directories matching PATTERN, may be repeated" << std::endl;
+  std::cout << "       " << "-u open files of unknown format too, not only those which look like a video" << std::endl;
+  std::cout << "       " << "TIMEOUT is number of seconds a file may hang in the decoder before it is abandoned, 0 disables it, default 60" << std::endl;
+  std::cout << "       " << "-P measure stages of processing and print them at exit or on SIGUSR1" << std::endl;
+  std::cout << "       " << "PROFILE_FILE receives the measurements as JSON at exit (implies -P)" << std::endl;
+  std::cout << "       " << "SERIES_FILE receives luminance of every frame, as CSV when it ends with .csv" << std::endl;
+  std::cout << "       " << "PARTIAL_FILE receives statistics of all files at exit, --merge combines such files of many runs" << std::endl;
+  std::cout << "       " << "--force merge partial files calculated with different parameters, -O marks the result as mixed" << std::endl;
+  std::cout << "       " << "-f keep running and process new files appearing in DIR until stopped, not with -R" << std::endl;
+}
+
+/*
+  Returns true when the option at argv[i] must be followed by a value and it is missing.
+*/
+static bool isValueMissing(int argc, char* argv[], int i) {
+  static const std::set<std::string> with_value = {"-t", "-d", "-r", "-s", "-m", "-b", "-k", "-i", "-g", "-F",
+                                                   "-I", "-E", "-T", "-J", "-o", "-M", "-S", "-O", "-c", "-x"};
+  return (i + 1 >= argc) && (with_value.end() != with_value.find(argv[i]));
 }
 
 int main(int argc, char* argv[]) {
   // Command line params processing. In C++ it is always a pain.
+  if ((argc > 2) && (std::string(argv[1]) == "--merge")) {
+    // all other arguments are partial stats files, except -O with its file and --force
+    CalcLumConfig config;
+    std::vector<std::string> paths;
+    for (auto i = 2; i < argc; i++) {
+      if ((std::string(argv[i]) == "-O") && (i + 1 < argc)) {
+        config.partial_path = argv[++i];
+      } else if (std::string(argv[i]) == "--force") {
+        config.force_merge = true;
+      } else {
+        paths.push_back(argv[i]);
+      }
+    }
+    return mergePartialStats(config, paths);
+  }
   if (argc < 5) {
     show_usage(argv[0]);
     return 1;
   } 
 
   std::string arg, param;
-  auto threads_num = 0;
+  CalcLumConfig config;
+  auto& threads_num = config.threads_num;
   std::string dir;
+  // -o, -M and -L select the region in different ways, only one of them may be given
+  int roi_num = 0;
   for(auto i = 0; i < argc; i++) {
     arg = argv[i];
+    if(isValueMissing(argc, argv, i)) {
+      show_usage(argv[0]);
+      return 1;
+    }
     if(arg == "-t") {
-      // next must be number of threads
+      // next must be number of threads or auto
       param = argv[++i];
-      threads_num = std::atoi(param.c_str());
-      if ((threads_num < 1) || (threads_num > 15)) {
+      threads_num = (param == "auto") ? std::max(1u, std::thread::hardware_concurrency()) :
+                                        std::atoi(param.c_str());
+      if (threads_num < 1) {
         show_usage(argv[0]);
         return 1;
       }
@@ -153,40 +575,188 @@ int main(int argc, char* argv[]) {
       // next must be directory name
       dir = argv[++i];
     }
+    if(arg == "-r") {
+      // next must be number of reader threads
+      param = argv[++i];
+      config.readers_num = std::atoi(param.c_str());
+      if (config.readers_num < 1) {
+        show_usage(argv[0]);
+        return 1;
+      }
+    }
+    if(arg == "-s") {
+      // next must be number of segments
+      param = argv[++i];
+      config.segments = std::atoi(param.c_str());
+      if (config.segments < 1) {
+        show_usage(argv[0]);
+        return 1;
+      }
+    }
+    if(arg == "-m") {
+      // next must be number of frame buffers
+      param = argv[++i];
+      config.frame_buffers = std::atoi(param.c_str());
+      if (config.frame_buffers < 1) {
+        show_usage(argv[0]);
+        return 1;
+      }
+    }
+    if(arg == "-b") {
+      // next must be batch size or auto
+      param = argv[++i];
+      config.batch_size = (param == "auto") ? 0 : std::atoi(param.c_str());
+      if ((config.batch_size < 1) && (param != "auto")) {
+        show_usage(argv[0]);
+        return 1;
+      }
+    }
+    if(arg == "-w") {
+      config.work_stealing = true;
+    }
+    if(arg == "-p") {
+      config.pin_threads = true;
+    }
+    if(arg == "-y") {
+      config.native_yuv = true;
+    }
+    if(arg == "-k") {
+      // next must be frame step
+      param = argv[++i];
+      config.frame_step = std::atoi(param.c_str());
+      if (config.frame_step < 1) {
+        show_usage(argv[0]);
+        return 1;
+      }
+    }
+    if(arg == "-i") {
+      // next must be raw input file, pipe or - for stdin
+      config.raw_input = argv[++i];
+    }
+    if(arg == "-g") {
+      // next must be size of raw frames
+      param = argv[++i];
+      if (!config.raw_format.parseSize(param)) {
+        show_usage(argv[0]);
+        return 1;
+      }
+    }
+    if(arg == "-F") {
+      // next must be pixel format of raw frames
+      param = argv[++i];
+      if (!config.raw_format.parseFormat(param)) {
+        show_usage(argv[0]);
+        return 1;
+      }
+    }
+    if(arg == "-R") {
+      config.recursive = true;
+    }
+    if(arg == "-I") {
+      // next must be include pattern
+      config.includes.push_back(argv[++i]);
+    }
+    if(arg == "-E") {
+      // next must be exclude pattern
+      config.excludes.push_back(argv[++i]);
+    }
+    if(arg == "-u") {
+      config.sniff = false;
+    }
+    if(arg == "-T") {
+      // next must be decode timeout, 0 turns the watchdog off
+      param = argv[++i];
+      config.decode_timeout = std::atoi(param.c_str());
+      if (config.decode_timeout < 0) {
+        show_usage(argv[0]);
+        return 1;
+      }
+    }
+    if(arg == "-P") {
+      config.profile = true;
+    }
+    if(arg == "-J") {
+      // next must be profile file name
+      config.profile_json = argv[++i];
+    }
+    if(arg == "-e") {
+      config.exact = true;
+    }
+    if(arg == "-o") {
+      // next must be rectangle of interest
+      param = argv[++i];
+      CalcLumRect rect;
+      if (!rect.parse(param)) {
+        show_usage(argv[0]);
+        return 1;
+      }
+      roi_num++;
+      config.roi = std::make_shared<const CalcLumRoiSpec>(CalcLumRoiSpec::fromRect(rect));
+    }
+    if(arg == "-M") {
+      // next must be mask image
+      param = argv[++i];
+      roi_num++;
+      config.roi = loadRoiMask(param);
+      if (nullptr == config.roi) {
+        std::cout << "Cannot read mask " << param << " or it has no pixel set" << std::endl;
+        return 1;
+      }
+    }
+    if(arg == "-L") {
+      roi_num++;
+      config.roi = std::make_shared<const CalcLumRoiSpec>(CalcLumRoiSpec::letterbox());
+    }
+    if(arg == "-S") {
+      // next must be time series file name
+      config.series_path = argv[++i];
+    }
+    if(arg == "-O") {
+      // next must be partial stats file name
+      config.partial_path = argv[++i];
+    }
+    if(arg == "-f") {
+      config.watch = true;
+    }
+    if(arg == "-c") {
+      // next must be cache file or auto
+      param = argv[++i];
+      config.cache_path = (param == "auto") ? CalcLumResultCache::getDefaultPath() : param;
+    }
+    if(arg == "-x") {
+      // next must be sampling step
+      param = argv[++i];
+      config.sample_step = std::atoi(param.c_str());
+      if (config.sample_step < 1) {
+        show_usage(argv[0]);
+        return 1;
+      }
+    }
   }
-  if((0 == threads_num) || dir.empty()) {
+  if((0 == threads_num) || (dir.empty() && config.raw_input.empty())) {
     show_usage(argv[0]);
     return 1;
   }
-  std::cout << "Running with " << threads_num << " threads" << std::endl;
-
-  std::list<std::string> files;
-
-  // Open specified directory and find all regular files.
-  // Do not enter any sub-directories.
-  DIR* dirp = opendir(dir.c_str());
-  if(nullptr == dirp) {
-    std::cout << "Cannot access directory " << dir << std::endl;
-    return 1; 
+  if(config.watch && config.recursive) {
+    // only DIR itself is watched, new files in its sub-directories would be missed
+    show_usage(argv[0]);
+    return 1;
   }
-  
-  struct dirent * dp;
-  while ((dp = readdir(dirp)) != NULL) {
-    struct stat file_stat;
-    std::string fullPath = dir + std::string("/") + std::string(dp->d_name);
-    stat(fullPath.c_str(), &file_stat);
-    if(S_ISREG(file_stat.st_mode)) {
-      std::cout << "Found file " << std::string(dp->d_name) << std::endl;
-      files.push_back(fullPath);
-    }
+  if(1 < roi_num) {
+    show_usage(argv[0]);
+    return 1;
   }
-  closedir(dirp);
-  
-  if(files.empty()) {
-    std::cout << "No files found ...." << std::endl;
-    return 1; 
+  if(!config.raw_input.empty() && !config.raw_format.isValid()) {
+    // size of raw frames cannot be guessed
+    show_usage(argv[0]);
+    return 1;
+  }
+  std::cout << "Running with " << threads_num << " threads and " << config.readers_num << " readers" << std::endl;
+  if (1 < config.sample_step) {
+    std::cout << "Approximate mode, using every " << config.sample_step << " pixel of every " <<
+        config.sample_step << " row" << std::endl;
   }
 
   std::cout << "Processing files ...." << std::endl;
-  return processFiles(threads_num, files);
+  return processFiles(config, dir);
 }
@@ -0,0 +1,177 @@
+/*
+  End-to-end benchmark. Synthetic videos are generated in a temporary directory
+  and processed the same way as calclum does it: reader threads decode frames
+  and worker threads of the scheduler calculate luminance.
+  Videos are written as YUV4MPEG2 (mapped into memory, no decoding) and as MJPEG AVI
+  (decoded by OpenCV), so the cost of decoding can be told from the rest.
+  Run with: make bench
+*/
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdlib>
+#include <unistd.h>
+#include "frameJob.h"
+#include "scheduler.h"
+#include "reader.h"
+#include "config.h"
+
+static const int kFilesNum = 4;
+static const int kFramesNum = 25;
+static const int kWidth = 1280;
+static const int kHeight = 720;
+
+enum SyntheticFormat { kY4M = 0, kMJPEG = 1 };
+
+static std::string bench_dir;
+static std::vector<std::string> files[2];
+
+// Frame with a gradient moving with frame number, so consecutive frames differ.
+static void drawFrame(cv::Mat& frame, int file, int frame_num) {
+  frame.create(kHeight, kWidth, CV_8UC3);
+  for (int i = 0; i < kHeight; i++) {
+    uint8_t* row = frame.ptr(i);
+    for (int j = 0; j < kWidth; j++) {
+      row[j * 3] = (i + frame_num * 4) & 0xFF;
+      row[j * 3 + 1] = (j + file * 32) & 0xFF;
+      row[j * 3 + 2] = ((i + j) / 8) & 0xFF;
+    }
+  }
+}
+
+static bool writeY4M(const std::string& file_name, int file) {
+  std::ofstream out(file_name, std::ios::binary);
+  out << "YUV4MPEG2 W" << kWidth << " H" << kHeight << " F25:1 C420jpeg\n";
+  std::vector<char> frame(kWidth * kHeight * 3 / 2);
+  for (int frame_num = 0; frame_num < kFramesNum; frame_num++) {
+    for (int i = 0; i < kHeight; i++) {
+      for (int j = 0; j < kWidth; j++) {
+        frame[i * kWidth + j] = (i + j + frame_num * 4 + file * 32) & 0xFF;
+      }
+    }
+    std::fill(frame.begin() + kWidth * kHeight, frame.end(), 128);
+    out << "FRAME\n";
+    out.write(frame.data(), frame.size());
+  }
+  return static_cast<bool>(out);
+}
+
+static bool writeMJPEG(const std::string& file_name, int file) {
+  cv::VideoWriter writer;
+  if (!writer.open(file_name, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), 25, cv::Size(kWidth, kHeight))) {
+    return false;
+  }
+  cv::Mat frame;
+  for (int frame_num = 0; frame_num < kFramesNum; frame_num++) {
+    drawFrame(frame, file, frame_num);
+    writer.write(frame);
+  }
+  writer.release();
+  return true;
+}
+
+static void generateVideos() {
+  char dir_template[] = "/tmp/calclum_bench_XXXXXX";
+  bench_dir = mkdtemp(dir_template);
+  for (int file = 0; file < kFilesNum; file++) {
+    std::string y4m = bench_dir + "/video" + std::to_string(file) + ".y4m";
+    if (writeY4M(y4m, file)) {
+      files[kY4M].push_back(y4m);
+    }
+    std::string avi = bench_dir + "/video" + std::to_string(file) + ".avi";
+    if (writeMJPEG(avi, file)) {
+      files[kMJPEG].push_back(avi);
+    }
+  }
+}
+
+/*
+  Processes files like processFiles in calclum.cc does, without the cache and watch mode.
+  Returns number of frames processed.
+*/
+static int processFiles(const std::vector<std::string>& file_names, const CalcLumConfig& config) {
+  CalcLumScheduler s(config.threads_num, CalcLumSchedulingMode::GlobalQueue);
+  s.start();
+  std::shared_ptr<std::condition_variable> cv = std::make_shared<std::condition_variable>();
+  std::shared_ptr<std::mutex> cv_m = std::make_shared<std::mutex>();
+  std::shared_ptr<int> files_to_process = std::make_shared<int>(0);
+
+  CalcLumReader reader(s, config, config.readers_num);
+  reader.setSyncVars(cv, cv_m, files_to_process);
+  reader.start();
+  std::vector<std::shared_ptr<CalcLumFileCtx> > ctxs;
+  for (const auto& file_name : file_names) {
+    ctxs.push_back(std::make_shared<CalcLumFileCtx>(file_name));
+    reader.addFile(ctxs.back());
+  }
+  reader.finish();
+  {
+    std::unique_lock<std::mutex> lk(*cv_m);
+    cv->wait(lk, [files_to_process]{return *files_to_process == 0;});
+  }
+  s.stopThreads();
+
+  int frames = 0;
+  for (const auto& ctx : ctxs) {
+    frames += ctx->getFramesProcessed();
+  }
+  return frames;
+}
+
+/*
+  Arguments: format of videos, number of worker threads, number of reader threads.
+  Throughput is reported in frames per second.
+*/
+static void BM_EndToEnd(benchmark::State& state) {
+  const std::vector<std::string>& file_names = files[state.range(0)];
+  if (file_names.empty()) {
+    state.SkipWithError("Synthetic videos could not be written");
+    return;
+  }
+  CalcLumConfig config;
+  config.threads_num = state.range(1);
+  config.readers_num = state.range(2);
+  config.batch_size = 0;
+  config.native_yuv = true;
+
+  // results of each file are printed by calclum, they would mix with the report
+  std::ostringstream discard;
+  std::streambuf* cout_buf = std::cout.rdbuf(discard.rdbuf());
+  int frames = 0;
+  for (auto _ : state) {
+    frames = processFiles(file_names, config);
+    discard.str("");
+  }
+  std::cout.rdbuf(cout_buf);
+  if (frames != static_cast<int>(file_names.size()) * kFramesNum) {
+    state.SkipWithError("Not all frames processed");
+  }
+  state.SetItemsProcessed(state.iterations() * frames);
+}
+
+static void endToEndArgs(benchmark::internal::Benchmark* b) {
+  for (auto format : {kY4M, kMJPEG}) {
+    for (auto threads : {1, 2, 4, 8}) {
+      for (auto readers : {1, 4}) {
+        b->Args({format, threads, readers});
+      }
+    }
+  }
+  b->ArgNames({"mjpeg", "threads", "readers"})->UseRealTime()->Unit(benchmark::kMillisecond);
+}
+BENCHMARK(BM_EndToEnd)->Apply(endToEndArgs);
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  generateVideos();
+  benchmark::RunSpecifiedBenchmarks();
+  std::string cmd = "rm -rf " + bench_dir;
+  return system(cmd.c_str());
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include "rawFrame.h"
+#include "roi.h"
+
+/*
+  Run-time configuration of calclum. It is filled from command line parameters
+  in main() and passed to the code reading files.
+*/
+struct CalcLumConfig {
+  // number of worker threads in the scheduler
+  int threads_num{0};
+  // each worker thread has its own queue and steals jobs from others when idle
+  bool work_stealing{false};
+  // pin worker and reader threads to CPUs, spread evenly over NUMA nodes
+  bool pin_threads{false};
+  // number of reader threads decoding files in parallel
+  int readers_num{1};
+  // long files are split into this many segments, each read by different reader thread
+  int segments{1};
+  // number of frames in one job. 0 means it is selected based on frame resolution
+  int batch_size{1};
+  // maximum number of frame buffers. 0 means enough for all jobs which may exist at the same time
+  int frame_buffers{0};
+  // ask decoder to deliver frames in native YUV format and calculate
+  // luminance from Y plane only (no color conversions)
+  bool native_yuv{false};
+  // approximate mode: only every sample_step-th pixel of every sample_step-th row is used
+  int sample_step{1};
+  // only every frame_step-th frame is decoded and processed, the others are skipped
+  int frame_step{1};
+  // exact mode: luminance is kept in fixed point, results are not rounded to whole numbers
+  bool exact{false};
+  // region of interest of frames (rectangle, mask or letterbox detection), not set when whole frames are used
+  std::shared_ptr<const CalcLumRoiSpec> roi;
+  // file with results of previous runs. Empty means that the cache is not used
+  std::string cache_path;
+  // process files in sub-directories too
+  bool recursive{false};
+  // shell patterns of file names to be processed and of files and directories to be skipped
+  std::vector<std::string> includes;
+  std::vector<std::string> excludes;
+  // open only files which look like a video (see CalcLumSniffer)
+  bool sniff{true};
+  // seconds a decoder call may take before the file is abandoned, 0 disables the watchdog
+  int decode_timeout{60};
+  // measure stages of processing (see CalcLumProfiler), print them at exit and optionally write as JSON
+  bool profile{false};
+  std::string profile_json;
+  // file the luminance of every frame is written to (CSV when it ends with .csv), see CalcLumSeriesWriter
+  std::string series_path;
+  // file per-file statistics are written to at exit, so runs on several machines can be merged
+  std::string partial_path;
+  // --merge only: merge partial stats calculated with different parameters
+  bool force_merge{false};
+  // keep watching the directory and process new files until stopped
+  bool watch{false};
+  // stream of raw frames (- means stdin). Frames have raw_format geometry and pixel format
+  std::string raw_input;
+  CalcLumRawFormat raw_format;
+};
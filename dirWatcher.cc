@@ -0,0 +1,55 @@
+#include "dirWatcher.h"
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+
+CalcLumDirWatcher::CalcLumDirWatcher(const std::string& dir) : dir_(dir) {
+  // paths of files reported must be the same as those found by CalcLumDiscovery
+  while ((1 < dir_.size()) && ('/' == dir_.back())) {
+    dir_.pop_back();
+  }
+  fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (-1 == fd_) {
+    return;
+  }
+  watch_ = inotify_add_watch(fd_, dir_.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR);
+}
+
+CalcLumDirWatcher::~CalcLumDirWatcher() {
+  if (-1 != fd_) {
+    close(fd_);
+  }
+}
+
+bool CalcLumDirWatcher::waitForFiles(std::list<std::string>& files, int timeout_ms) {
+  struct pollfd pfd = {fd_, POLLIN, 0};
+  int ready = poll(&pfd, 1, timeout_ms);
+  if (-1 == ready) {
+    return EINTR == errno;
+  }
+  if (0 == ready) {
+    return true;
+  }
+
+  // Buffer is big enough for several events with the longest name. Read until all events are taken.
+  alignas(struct inotify_event) char buf[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)];
+  while (true) {
+    ssize_t len = read(fd_, buf, sizeof(buf));
+    if (-1 == len) {
+      return (EAGAIN == errno) || (EINTR == errno);
+    }
+    for (char* ptr = buf; ptr < buf + len; ) {
+      const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(ptr);
+      ptr += sizeof(struct inotify_event) + event->len;
+      if (event->mask & IN_IGNORED) {
+        // directory has been removed
+        return false;
+      }
+      if ((0 < event->len) && !(event->mask & IN_ISDIR)) {
+        files.push_back(dir_ + "/" + event->name);
+      }
+    }
+  }
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <string>
+#include <list>
+
+/*
+  CalcLumDirWatcher watches a directory with inotify and reports files which are ready
+  to be processed: files closed after writing (IN_CLOSE_WRITE) and files moved into
+  the directory (IN_MOVED_TO), e.g. by a recorder which writes to a temporary name first.
+  Sub-directories are not watched.
+*/
+class CalcLumDirWatcher {
+public:
+  CalcLumDirWatcher() = delete;
+  CalcLumDirWatcher(const std::string& dir);
+  CalcLumDirWatcher(const CalcLumDirWatcher&) = delete;
+  CalcLumDirWatcher& operator=(const CalcLumDirWatcher&) = delete;
+  ~CalcLumDirWatcher();
+
+  // Returns false when the directory cannot be watched.
+  bool isValid() const { return -1 != watch_; }
+  // Waits up to timeout_ms for files to become ready and appends their full paths to files.
+  // Returns false on error. Interruption by a signal is not an error, files are just empty then.
+  bool waitForFiles(std::list<std::string>& files, int timeout_ms);
+
+private:
+  std::string dir_;
+  int fd_{-1};
+  int watch_{-1};
+};
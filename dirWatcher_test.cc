@@ -0,0 +1,81 @@
+/*
+  Set of unit tests for directory watcher.
+*/
+#include <gtest/gtest.h>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "dirWatcher.h"
+
+class DirWatcherTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    char dir_template[] = "/tmp/calclum_watch_XXXXXX";
+    dir_ = mkdtemp(dir_template);
+  }
+
+  void TearDown() override {
+    std::string cmd = "rm -rf " + dir_;
+    ASSERT_EQ(0, system(cmd.c_str()));
+  }
+
+  std::string dir_;
+};
+
+TEST_F(DirWatcherTest, missingDirectory) {
+  CalcLumDirWatcher watcher(dir_ + "/missing");
+  ASSERT_FALSE(watcher.isValid());
+}
+
+TEST_F(DirWatcherTest, nothingHappens) {
+  CalcLumDirWatcher watcher(dir_);
+  ASSERT_TRUE(watcher.isValid());
+  std::list<std::string> files;
+  ASSERT_TRUE(watcher.waitForFiles(files, 10));
+  ASSERT_TRUE(files.empty());
+}
+
+// File is reported only when it has been closed, not while it is being written.
+TEST_F(DirWatcherTest, fileReportedWhenClosed) {
+  CalcLumDirWatcher watcher(dir_);
+  std::list<std::string> files;
+  {
+    std::ofstream out(dir_ + "/video.mp4");
+    out << "frames" << std::flush;
+    ASSERT_TRUE(watcher.waitForFiles(files, 10));
+    ASSERT_TRUE(files.empty());
+  }
+  ASSERT_TRUE(watcher.waitForFiles(files, 1000));
+  ASSERT_EQ(1u, files.size());
+  ASSERT_EQ(dir_ + "/video.mp4", files.front());
+}
+
+TEST_F(DirWatcherTest, movedFileReported) {
+  std::string tmp_dir = dir_ + "/tmp";
+  ASSERT_EQ(0, mkdir(tmp_dir.c_str(), 0755));
+  { std::ofstream out(tmp_dir + "/part"); out << "frames"; }
+
+  CalcLumDirWatcher watcher(dir_);
+  ASSERT_EQ(0, rename((tmp_dir + "/part").c_str(), (dir_ + "/video.ts").c_str()));
+  std::list<std::string> files;
+  ASSERT_TRUE(watcher.waitForFiles(files, 1000));
+  ASSERT_EQ(1u, files.size());
+  ASSERT_EQ(dir_ + "/video.ts", files.front());
+}
+
+// Paths are the same as those of CalcLumDiscovery, whatever slashes the directory ends with.
+TEST_F(DirWatcherTest, trailingSlashRoot) {
+  CalcLumDirWatcher watcher(dir_ + "//");
+  { std::ofstream out(dir_ + "/video.mp4"); out << "frames"; }
+  std::list<std::string> files;
+  ASSERT_TRUE(watcher.waitForFiles(files, 1000));
+  ASSERT_EQ(1u, files.size());
+  ASSERT_EQ(dir_ + "/video.mp4", files.front());
+}
+
+int main(int argc, char **argv) {
+ ::testing::InitGoogleTest(&argc, argv);
+ return RUN_ALL_TESTS();
+}
@@ -0,0 +1,132 @@
+#include "discovery.h"
+#include <thread>
+#include <algorithm>
+#include <memory>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+
+CalcLumDiscovery::CalcLumDiscovery(const std::string& root, bool recursive, int walkers_num) :
+  root_(root), recursive_(recursive), walkers_num_(std::max(walkers_num, 1)) {
+  // avoid double slashes in paths of found files
+  while ((1 < root_.size()) && ('/' == root_.back())) {
+    root_.pop_back();
+  }
+}
+
+bool CalcLumDiscovery::isIncluded(const char* name) const {
+  if (includes_.empty()) {
+    return true;
+  }
+  for (const auto& pattern : includes_) {
+    if (0 == fnmatch(pattern.c_str(), name, 0)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool CalcLumDiscovery::isExcluded(const char* name) const {
+  for (const auto& pattern : excludes_) {
+    if (0 == fnmatch(pattern.c_str(), name, 0)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+  Lists one directory. Files are reported, sub-directories are queued for other walkers.
+*/
+bool CalcLumDiscovery::listDir(const std::string& dir) {
+  DIR* dirp = opendir(dir.c_str());
+  if (nullptr == dirp) {
+    return false;
+  }
+  int dir_fd = dirfd(dirp);
+  std::list<std::string> sub_dirs;
+
+  struct dirent* dp;
+  while (nullptr != (dp = readdir(dirp))) {
+    const char* name = dp->d_name;
+    if ((0 == std::strcmp(name, ".")) || (0 == std::strcmp(name, ".."))) {
+      continue;
+    }
+    bool is_file = (DT_REG == dp->d_type);
+    bool is_dir = (DT_DIR == dp->d_type);
+    if ((DT_UNKNOWN == dp->d_type) || (DT_LNK == dp->d_type)) {
+      // type is not known without stat. Links are followed to find out what they point to.
+      struct stat file_stat;
+      if (0 != fstatat(dir_fd, name, &file_stat, 0)) {
+        continue;
+      }
+      is_file = S_ISREG(file_stat.st_mode);
+      // do not enter linked directories, they may create a loop
+      is_dir = S_ISDIR(file_stat.st_mode) && (DT_LNK != dp->d_type);
+    }
+
+    if (isExcluded(name)) {
+      continue;
+    }
+    if (is_file && isIncluded(name)) {
+      on_file_(dir + "/" + name);
+    } else if (is_dir && recursive_) {
+      sub_dirs.push_back(dir + "/" + name);
+    }
+  }
+  closedir(dirp);
+
+  if (!sub_dirs.empty()) {
+    {
+      std::lock_guard<std::mutex> lk(dirs_m_);
+      dirs_.splice(dirs_.end(), sub_dirs);
+    }
+    dirs_cv_.notify_all();
+  }
+  return true;
+}
+
+void CalcLumDiscovery::walkerFunc(CalcLumDiscovery* d) {
+  while (true) {
+    std::string dir;
+    {
+      std::unique_lock<std::mutex> lk(d->dirs_m_);
+      d->dirs_cv_.wait(lk, [d]{return !d->dirs_.empty() || (0 == d->busy_walkers_);});
+      if (d->dirs_.empty()) {
+        // nothing queued and nobody can queue more
+        return;
+      }
+      dir = d->dirs_.front();
+      d->dirs_.pop_front();
+      d->busy_walkers_++;
+    }
+    d->listDir(dir);
+    {
+      std::lock_guard<std::mutex> lk(d->dirs_m_);
+      d->busy_walkers_--;
+    }
+    d->dirs_cv_.notify_all();
+  }
+}
+
+bool CalcLumDiscovery::run(FileCallback on_file) {
+  on_file_ = on_file;
+  // Root is listed by this thread. Walkers are started only when there are sub-directories.
+  if (!listDir(root_)) {
+    return false;
+  }
+  if (dirs_.empty()) {
+    return true;
+  }
+
+  std::vector<std::unique_ptr<std::thread> > walkers;
+  for (auto counter = 0; counter < walkers_num_; counter++) {
+    walkers.push_back(std::make_unique<std::thread>(walkerFunc, this));
+  }
+  for (const auto& walker : walkers) {
+    walker->join();
+  }
+  return true;
+}
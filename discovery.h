@@ -0,0 +1,61 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <list>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+
+/*
+  CalcLumDiscovery finds files to be processed in a directory tree.
+  Directories are listed by a pool of walker threads, each one takes the next directory
+  from a shared queue, so several directories are read at the same time. Every file
+  found is passed to a callback right away, so files can be processed while the rest
+  of the tree is still being listed.
+
+  File type is taken from d_type returned by readdir. fstatat is called only when the file
+  system does not provide it or for symbolic links. Symbolic links to files are followed,
+  links to directories are not, so the traversal cannot loop.
+
+  Filters are shell patterns (fnmatch) matched against the name of a file, not its path.
+  A file is passed when it matches at least one include pattern (or there are none)
+  and no exclude pattern. Directories matching an exclude pattern are not entered.
+*/
+class CalcLumDiscovery {
+public:
+  // Called from walker threads, possibly by several at the same time.
+  typedef std::function<void(const std::string&)> FileCallback;
+
+  CalcLumDiscovery() = delete;
+  CalcLumDiscovery(const std::string& root, bool recursive, int walkers_num);
+
+  void addInclude(const std::string& pattern) { includes_.push_back(pattern); }
+  void addExclude(const std::string& pattern) { excludes_.push_back(pattern); }
+  // True when a file of this name passes the filters. Used for files found in other ways
+  // than by run, e.g. by watching the directory.
+  bool accepts(const std::string& name) const { return isIncluded(name.c_str()) && !isExcluded(name.c_str()); }
+
+  // Walks the tree and returns when all directories have been listed.
+  // Returns false when the root directory cannot be read.
+  bool run(FileCallback on_file);
+
+private:
+  std::string root_;
+  bool recursive_;
+  int walkers_num_;
+  std::vector<std::string> includes_;
+  std::vector<std::string> excludes_;
+  FileCallback on_file_;
+
+  // directories waiting to be listed, guarded by dirs_m_
+  std::mutex dirs_m_;
+  std::condition_variable dirs_cv_;
+  std::list<std::string> dirs_;
+  // number of directories being listed. Walkers finish when no directory is queued or being listed.
+  int busy_walkers_{0};
+
+  bool isIncluded(const char* name) const;
+  bool isExcluded(const char* name) const;
+  bool listDir(const std::string& dir);
+  static void walkerFunc(CalcLumDiscovery* d);
+};
@@ -0,0 +1,109 @@
+/*
+  Set of unit tests for file discovery.
+*/
+#include <gtest/gtest.h>
+#include <fstream>
+#include <set>
+#include <mutex>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "discovery.h"
+
+// Creates a tree:
+//   a.mp4 b.txt 2024/01/c.mp4 2024/01/d.ts 2024/02/e.mp4 tmp/f.mp4
+class DiscoveryTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    char dir_template[] = "/tmp/calclum_discovery_XXXXXX";
+    dir_ = mkdtemp(dir_template);
+    for (auto sub : {"/2024", "/2024/01", "/2024/02", "/tmp"}) {
+      mkdir((dir_ + sub).c_str(), 0755);
+    }
+    for (auto file : {"/a.mp4", "/b.txt", "/2024/01/c.mp4", "/2024/01/d.ts", "/2024/02/e.mp4", "/tmp/f.mp4"}) {
+      std::ofstream out(dir_ + file);
+    }
+  }
+
+  void TearDown() override {
+    std::string cmd = "rm -rf " + dir_;
+    ASSERT_EQ(0, system(cmd.c_str()));
+  }
+
+  // Runs discovery and returns found files relative to the root.
+  std::set<std::string> find(CalcLumDiscovery& discovery) {
+    std::set<std::string> files;
+    std::mutex m;
+    bool result = discovery.run([&](const std::string& file) {
+      std::lock_guard<std::mutex> lk(m);
+      // every file must be reported once
+      EXPECT_TRUE(files.insert(file.substr(dir_.size())).second) << file;
+    });
+    EXPECT_TRUE(result);
+    return files;
+  }
+
+  std::string dir_;
+};
+
+TEST_F(DiscoveryTest, topLevelOnly) {
+  CalcLumDiscovery discovery(dir_, false, 4);
+  ASSERT_EQ(std::set<std::string>({"/a.mp4", "/b.txt"}), find(discovery));
+}
+
+TEST_F(DiscoveryTest, recursive) {
+  CalcLumDiscovery discovery(dir_ + "/", true, 4);
+  ASSERT_EQ(std::set<std::string>({"/a.mp4", "/b.txt", "/2024/01/c.mp4", "/2024/01/d.ts", "/2024/02/e.mp4",
+                                   "/tmp/f.mp4"}), find(discovery));
+}
+
+TEST_F(DiscoveryTest, includeAndExclude) {
+  CalcLumDiscovery discovery(dir_, true, 2);
+  discovery.addInclude("*.mp4");
+  discovery.addInclude("*.ts");
+  discovery.addExclude("tmp");
+  discovery.addExclude("e.*");
+  ASSERT_EQ(std::set<std::string>({"/a.mp4", "/2024/01/c.mp4", "/2024/01/d.ts"}), find(discovery));
+}
+
+// Names of files found by other means are checked with the same filters.
+TEST_F(DiscoveryTest, accepts) {
+  CalcLumDiscovery discovery(dir_, true, 1);
+  ASSERT_TRUE(discovery.accepts("b.txt"));
+  discovery.addInclude("*.mp4");
+  discovery.addExclude("e.*");
+  ASSERT_TRUE(discovery.accepts("a.mp4"));
+  ASSERT_FALSE(discovery.accepts("b.txt"));
+  ASSERT_FALSE(discovery.accepts("e.mp4"));
+}
+
+// Links to files are followed, links to directories are not entered.
+TEST_F(DiscoveryTest, symbolicLinks) {
+  ASSERT_EQ(0, symlink((dir_ + "/a.mp4").c_str(), (dir_ + "/2024/link.mp4").c_str()));
+  ASSERT_EQ(0, symlink(dir_.c_str(), (dir_ + "/2024/loop").c_str()));
+  CalcLumDiscovery discovery(dir_, true, 4);
+  discovery.addInclude("*.mp4");
+  ASSERT_EQ(std::set<std::string>({"/a.mp4", "/2024/link.mp4", "/2024/01/c.mp4", "/2024/02/e.mp4", "/tmp/f.mp4"}),
+            find(discovery));
+}
+
+TEST_F(DiscoveryTest, missingRoot) {
+  CalcLumDiscovery discovery(dir_ + "/missing", true, 4);
+  ASSERT_FALSE(discovery.run([](const std::string&) {}));
+}
+
+// Many nested directories listed by many walkers.
+TEST_F(DiscoveryTest, wideTree) {
+  for (auto i = 0; i < 50; i++) {
+    std::string sub = dir_ + "/tmp/" + std::to_string(i);
+    mkdir(sub.c_str(), 0755);
+    std::ofstream out(sub + "/video.mp4");
+  }
+  CalcLumDiscovery discovery(dir_ + "/tmp", true, 8);
+  ASSERT_EQ(51u, find(discovery).size());
+}
+
+int main(int argc, char **argv) {
+ ::testing::InitGoogleTest(&argc, argv);
+ return RUN_ALL_TESTS();
+}
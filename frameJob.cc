@@ -1,4 +1,18 @@
 #include "frameJob.h"
+#include "lumaKernel.h"
+#include <iomanip>
+#include <thread>
+
+CalcLumFrameJob::~CalcLumFrameJob() {
+  if (nullptr != frame_pool_) {
+    frame_pool_->release(std::move(frame_));
+  }
+}
+
+void CalcLumFrameJob::setFramePool(std::shared_ptr<CalcLumFramePool> frame_pool) {
+  frame_pool_ = frame_pool;
+  frame_ = frame_pool_->acquire();
+}
 
 /*
   Method processes a single frame. This is executed on worker thread.
@@ -6,72 +20,154 @@
   Frame luminance is average of all pixels.
 */
 void CalcLumFrameJob::processJob() {
-  // frame to be processed is in frame_
-  // convert to YUV to get value Y.
-  cv::Mat yuv_frame;
-  cv::cvtColor(frame_, yuv_frame, CV_BGR2YUV);
-
-  int channels = yuv_frame.channels();
-  //printf("Found %d channels\n", channels);
-  int rows = yuv_frame.rows;
-  int cols = yuv_frame.cols;
-  //printf("Found %d cols and %d rows\n", cols, rows);
- 
-  // point to YUV data
-  uint8_t* ptrPixel = yuv_frame.data;
-  int pixel_luminance;
-  long long frame_luminance = 0;
-  for (int i = 0; i < rows; i++) {
-    for (int j = 0; j < cols; j++) {
-      // Y is at offset 0, U at offset 1 and V at offset 2
-      pixel_luminance = ptrPixel[i*cols*channels + j * channels + 0];
-      frame_luminance += pixel_luminance;
-    }
-  }
- frame_luminance /= (cols*rows);
- file_ctx_->reportFrameLuminance(frame_luminance);
- //printf("Average frame luminance is %d\n", (int)round(frame_luminance));
- 
-#if 0
-  OK. Here is my attempt to split into color planes and calculate luminance per
-  color plane. I must be doing some mistake because it crashes.
-  // split it into color planes
-  int channels = frame_.channels();
-  std::vector<cv::Mat> rgbChannels(channels);
-  cv::split(frame_, rgbChannels);
-
-  // Now process each channel
-  for (auto color : rgbChannels) {
-    // convert the channel to YUV
-    cv::Mat yuv_frame;
-    cv::cvtColor(frame_, yuv_frame, CV_BGR2YUV); <<- crashes here
-
-    int yuv_channels = yuv_frame.channels();
-    printf("Found %d channels\n", channels);
-    int rows = yuv_frame.rows;
-    int cols = yuv_frame.cols;
-    printf("Found %d cols and %d rows\n", cols, rows);
- 
-    // point to YUV data
-    uint8_t* ptrPixel = yuv_frame.data;
-    int pixel_luminance;
-    cv::Scalar_<uint8_t> yuvPixel;
-    for (int i = 0; i < rows; i++) {
-      for (int j = 0; j < cols; j++) {
-        pixel_luminance = ptrPixel[i*cols*channels + j * channels + 0];
-        if(0 != pixel_luminance) {
-        printf("Found %d value.\n", pixel_luminance);
-         }
-      }
+  uint32_t frame_luminance_fixed = calcFrameLuminanceFixed();
+  int frame_luminance = frame_luminance_fixed >> kLumaFixedShift;
+  recordSeries(frame_luminance);
+  {
+    CalcLumProfiler::Timer timer(file_ctx_->getProfiler(), CalcLumStage::Merge);
+    if (exact_) {
+      file_ctx_->reportFrameLuminanceFixed(frame_luminance_fixed);
+    } else {
+      file_ctx_->reportFrameLuminance(frame_luminance);
     }
+    file_ctx_->incFramesProcessed();
   }
-#endif
 
-  file_ctx_->incFramesProcessed();
+  file_ctx_->signalEnd();
+}
+
+/*
+  Calculates luminance of all frames in the batch. Frame jobs are destroyed
+  right after that, so frame buffers go back to the pool before stats are merged.
+*/
+void CalcLumBatchJob::processJob() {
+  CalcLumStats stats;
+  for (auto& job : jobs_) {
+    uint32_t frame_luminance_fixed = job->calcFrameLuminanceFixed();
+    job->recordSeries(frame_luminance_fixed >> kLumaFixedShift);
+    if (job->isExact()) {
+      stats.addFrameFixed(frame_luminance_fixed);
+    } else {
+      stats.addFrame(frame_luminance_fixed >> kLumaFixedShift);
+    }
+  }
+  jobs_.clear();
 
+  {
+    CalcLumProfiler::Timer timer(file_ctx_->getProfiler(), CalcLumStage::Merge);
+    file_ctx_->reportStats(stats);
+    file_ctx_->addFramesProcessed(stats.frames);
+  }
   file_ctx_->signalEnd();
 }
 
+/*
+  The region is resolved by the first frame of the file which gets here and kept in the file context.
+  In letterbox mode the reader has set it before any frame of the file was sent (see CalcLumFileCtx::detectLetterbox),
+  so all frames of the file use the same region.
+*/
+const CalcLumRoi* CalcLumFrameJob::getRoi(int rows, int cols) {
+  const CalcLumRoiSpec* roi_spec = (nullptr != file_ctx_) ? file_ctx_->getRoiSpec() : nullptr;
+  if ((nullptr == roi_spec) || (CalcLumRoiMode::Frame == roi_spec->getMode())) {
+    return nullptr;
+  }
+  const CalcLumRoi* roi = file_ctx_->getRoi();
+  if (nullptr != roi) {
+    return roi;
+  }
+  assert(CalcLumRoiMode::Letterbox != roi_spec->getMode());
+  return file_ctx_->setRoi(roi_spec->resolve(rows, cols));
+}
+
+CalcLumRect CalcLumFrameJob::detectLetterbox() const {
+  return detectLetterboxBGR(frame_.data, frame_.rows, frame_.cols, frame_.step);
+}
+
+/*
+  Luminance (Y) of each pixel is calculated by luma kernel directly from BGR data,
+  so the frame does not have to be converted to YUV.
+  Only rows and columns of the region of interest are read. Masked region uses the masked kernel.
+  In approximate mode only sampled pixels are used and the average is taken over them.
+  The sum is divided once, in fixed point. Whole luminance is the same as the sum divided by
+  the number of pixels, the fractional bits are used only in exact mode.
+*/
+uint32_t CalcLumFrameJob::calcFrameLuminanceFixed() {
+  // frame to be processed is in frame_
+  assert(3 == frame_.channels());
+  const uint8_t* data = frame_.data;
+  int rows = frame_.rows;
+  int cols = frame_.cols;
+
+  const CalcLumRoi* roi = getRoi(rows, cols);
+  if (nullptr != roi) {
+    const CalcLumRect& rect = roi->getRect();
+    data = frame_.ptr(rect.y) + rect.x * 3;
+    rows = rect.height;
+    cols = rect.width;
+    if (roi->isMasked()) {
+      long long samples = 0;
+      unsigned long long frame_luminance = sumLumaBGRMasked(data, rows, cols, frame_.step,
+                                                            roi->getMask(), cols, sample_step_, samples);
+      return (0 < samples) ? (frame_luminance << kLumaFixedShift) / samples : 0;
+    }
+  }
+
+  unsigned long long frame_luminance = sumLumaBGRSampled(data, rows, cols, frame_.step, sample_step_);
+  return (frame_luminance << kLumaFixedShift) / lumaSamplesNum(rows, cols, sample_step_);
+}
+
+/*
+  Planar YUV frames are delivered by OpenCV as single channel image with
+  Y plane in the first luma_rows_ rows, followed by U and V planes.
+  Packed YUV 4:2:2 (2 channels) has Y in every other byte.
+*/
+uint32_t CalcLumYPlaneFrameJob::calcFrameLuminanceFixed() {
+  int channels = frame_.channels();
+  if (3 == channels) {
+    return CalcLumFrameJob::calcFrameLuminanceFixed();
+  }
+
+  const uint8_t* data = frame_.data;
+  int rows = getLumaRows();
+  int cols = frame_.cols;
+  const uint8_t* mask = nullptr;
+
+  const CalcLumRoi* roi = getRoi(rows, cols);
+  if (nullptr != roi) {
+    const CalcLumRect& rect = roi->getRect();
+    data = frame_.ptr(rect.y) + rect.x * channels;
+    rows = rect.height;
+    cols = rect.width;
+    mask = roi->isMasked() ? roi->getMask() : nullptr;
+  }
+
+  unsigned long long frame_luminance = 0;
+  long long samples = lumaSamplesNum(rows, cols, sample_step_);
+  if ((1 == channels) && (nullptr != mask)) {
+    frame_luminance = sumLumaPlaneMasked(data, rows, cols, frame_.step, mask, cols, sample_step_, samples);
+  } else if (1 == channels) {
+    frame_luminance = sumLumaPlaneSampled(data, rows, cols, frame_.step, sample_step_);
+  } else {
+    samples = 0;
+    for (int i = 0; i < rows; i += sample_step_) {
+      const uint8_t* row = data + i * frame_.step;
+      for (int j = 0; j < cols; j += sample_step_) {
+        uint8_t used = (nullptr != mask) ? mask[i * cols + j] : 0xff;
+        frame_luminance += row[j * channels] & used;
+        samples += used & 1;
+      }
+    }
+  }
+  return (0 < samples) ? (frame_luminance << kLumaFixedShift) / samples : 0;
+}
+
+CalcLumRect CalcLumYPlaneFrameJob::detectLetterbox() const {
+  int channels = frame_.channels();
+  if (3 == channels) {
+    return CalcLumFrameJob::detectLetterbox();
+  }
+  return detectLetterboxPlane(frame_.data, getLumaRows(), frame_.cols, frame_.step, channels);
+}
 
 /* 
   This method tries to detect if all frames from a file has been processed.
@@ -87,10 +183,61 @@ void CalcLumFileCtx::signalEnd() {
   if(frames_read_ != frames_processed_) {
     return; 
   }
+
+  notifyEnd();
+}
+
+/*
+  Called by the reader watchdog when the decoder got stuck in the file. Frames read so far
+  may never be processed, so the end is signaled without waiting for them.
+  Jobs of the file still in the scheduler find the end signaled already and do nothing.
+*/
+void CalcLumFileCtx::abandon() {
+  error_ = true;
+  eof_ = true;
+  if(nullptr == cv_m_) {
+    // stuck while opening, the file has not been counted as being processed yet
+    if(!end_signaled_.exchange(true)) {
+      std::cout << file_name_ << "->> Error during processing, file skipped" << std::endl;
+    }
+    finished_ = true;
+    if(nullptr != series_) {
+      series_->setFinished();
+    }
+    return;
+  }
+  notifyEnd();
+}
+
+void CalcLumFileCtx::notifyEnd() {
+  // Several worker threads may see all frames processed at the same time.
+  // Only one of them signals.
+  if(end_signaled_.exchange(true)) {
+    return;
+  }
   
   // All frames from the file has been processed.
   // Display average file luminance for the file.
-  std::cout << file_name_ << "->> Average file luminance: " << getFileAverageLuminance() << std::endl;
+  if(error_) {
+    std::cout << file_name_ << "->> Error during processing, file skipped" << std::endl;
+  } else {
+    std::cout << file_name_ << "->> Average file luminance: ";
+    if(isExact()) {
+      std::cout << std::fixed << std::setprecision(4) << getExactAverageLuminance() << std::defaultfloat;
+    } else {
+      std::cout << getFileAverageLuminance();
+    }
+    if(0 < frames_skipped_) {
+      std::cout << " (sampled " << frames_read_ << " of " << getFramesTotal() << " frames)";
+    }
+    std::cout << std::endl;
+  }
+
+  finished_ = true;
+  // all frames of the file are in the series, the rest will never come
+  if(nullptr != series_) {
+    series_->setFinished();
+  }
 
   // signal that one more file has been processed.
   {
@@ -100,29 +247,166 @@ void CalcLumFileCtx::signalEnd() {
   cv_->notify_all();
 }
 
+CalcLumFileCtx::CalcLumFileCtx(const std::string& file_name) : file_name_(file_name) {
+  for (auto& occurances : median_set_) {
+    occurances.store(0, std::memory_order_relaxed);
+  }
+}
+
+/*
+  Updates min and max luminance with compare-and-swap. When another thread
+  changed the value in the meantime, compare_exchange_weak loads the new value
+  and the comparison is done again.
+*/
+template <typename T>
+static void atomicMinMax(std::atomic<T>& min, std::atomic<T>& max, T min_value, T max_value) {
+  T current = min.load(std::memory_order_relaxed);
+  while (((-1 == current) || (min_value < current)) &&
+         !min.compare_exchange_weak(current, min_value, std::memory_order_relaxed)) {
+  }
+  // -1 is lower than any luminance, so max does not need special case
+  current = max.load(std::memory_order_relaxed);
+  while ((max_value > current) &&
+         !max.compare_exchange_weak(current, max_value, std::memory_order_relaxed)) {
+  }
+}
+
+void CalcLumFileCtx::updateMinMax(int min_luminance, int max_luminance) {
+  atomicMinMax(min_luminance_, max_luminance_, min_luminance, max_luminance);
+}
+
 /* 
   Method is called when luminance for a single frame has been calculated.
   It updates various fields, so later on min. max, median and mean can be calculated.
+  Frames are counted in frames_processed_ afterwards. That atomic increment makes
+  the updates below visible to the thread which sees all frames processed.
 */
 void CalcLumFileCtx::reportFrameLuminance(int frame_luminance) {
-  std::unique_lock<std::mutex> lk(ctx_m_);
-  file_luminance_ += frame_luminance;
+  assert(frame_luminance <= 255);
+  file_luminance_.fetch_add(frame_luminance, std::memory_order_relaxed);
+  updateMinMax(frame_luminance, frame_luminance);
+
+  // update median_set. Just increase the occurance of the number
+  median_set_[frame_luminance].fetch_add(1, std::memory_order_relaxed);
+}
+
+const CalcLumRoi* CalcLumFileCtx::setRoi(std::shared_ptr<const CalcLumRoi> roi) {
+  std::lock_guard<std::mutex> lk(roi_m_);
+  if (!roi_ready_.load(std::memory_order_relaxed)) {
+    roi_ = roi;
+    roi_ready_.store(true, std::memory_order_release);
+  }
+  return roi_.get();
+}
 
-  // update min luminance
-  if(-1 == min_luminance_) {
-    min_luminance_ = frame_luminance;
+/*
+  Frames too dark to tell the bars are only counted, they are processed later with the region found
+  in a brighter frame, like all other frames of the file.
+*/
+bool CalcLumFileCtx::detectLetterbox(const CalcLumFrameJob& job) {
+  if (nullptr != getRoi()) {
+    return true;
   }
-  min_luminance_ = std::min(min_luminance_, frame_luminance);
+  roi_frame_ = job.getLumaRect();
+  CalcLumRect rect = job.detectLetterbox();
+  if (rect.isEmpty()) {
+    if (++roi_attempts_ < kLetterboxAttempts) {
+      return false;
+    }
+    rect = roi_frame_;
+  }
+  setRoi(std::make_shared<CalcLumRoi>(rect));
+  return true;
+}
 
-  // update max luminance
-  if (-1 == max_luminance_) {
-    max_luminance_ = frame_luminance;
+void CalcLumFileCtx::finishLetterbox() {
+  if ((nullptr == getRoi()) && !roi_frame_.isEmpty()) {
+    setRoi(std::make_shared<CalcLumRoi>(roi_frame_));
   }
-  max_luminance_ = std::max(max_luminance_, frame_luminance);
+}
 
-  // update median_set. Just increase the occurance of the number
-  assert(frame_luminance <= 255);
-  median_set_[frame_luminance]++;
+void CalcLumFileCtx::setExact() {
+  fine_set_ = std::make_unique<std::array<std::atomic<int>, kFineBinsNum> >();
+  for (auto& occurances : *fine_set_) {
+    occurances.store(0, std::memory_order_relaxed);
+  }
+}
+
+void CalcLumFileCtx::reportFrameLuminanceFixed(uint32_t frame_luminance_fixed) {
+  assert(isExact());
+  reportFrameLuminance(frame_luminance_fixed >> kLumaFixedShift);
+  file_luminance_fixed_.fetch_add(frame_luminance_fixed, std::memory_order_relaxed);
+  atomicMinMax<long long>(min_fixed_, max_fixed_, frame_luminance_fixed, frame_luminance_fixed);
+  (*fine_set_)[frame_luminance_fixed >> kFineBinShift].fetch_add(1, std::memory_order_relaxed);
+}
+
+void CalcLumFileCtx::reportStats(const CalcLumStats& stats) {
+  if (0 == stats.frames) {
+    return;
+  }
+  file_luminance_.fetch_add(stats.luminance, std::memory_order_relaxed);
+  updateMinMax(stats.min_luminance, stats.max_luminance);
+
+  for (auto index = 0; index < 256; index++) {
+    if (0 != stats.median_set[index]) {
+      median_set_[index].fetch_add(stats.median_set[index], std::memory_order_relaxed);
+    }
+  }
+
+  if (!stats.isExact() || !isExact()) {
+    return;
+  }
+  file_luminance_fixed_.fetch_add(stats.luminance_fixed, std::memory_order_relaxed);
+  atomicMinMax(min_fixed_, max_fixed_, stats.min_fixed, stats.max_fixed);
+  for (auto index = 0; index < kFineBinsNum; index++) {
+    if (0 != stats.fine_set[index]) {
+      (*fine_set_)[index].fetch_add(stats.fine_set[index], std::memory_order_relaxed);
+    }
+  }
+}
+
+CalcLumStats CalcLumFileCtx::getStats() const {
+  CalcLumStats stats;
+  stats.luminance = file_luminance_.load();
+  stats.frames = frames_processed_.load();
+  stats.min_luminance = min_luminance_.load();
+  stats.max_luminance = max_luminance_.load();
+  stats.median_set = getMedianSet();
+  if (isExact()) {
+    stats.luminance_fixed = file_luminance_fixed_.load();
+    stats.min_fixed = min_fixed_.load();
+    stats.max_fixed = max_fixed_.load();
+    stats.fine_set = getFineSet();
+  }
+  return stats;
+}
+
+void CalcLumFileCtx::loadStats(const CalcLumStats& stats, int frames_total) {
+  reportStats(stats);
+  frames_read_ += stats.frames;
+  frames_processed_ += stats.frames;
+  frames_skipped_ += frames_total - stats.frames;
+  eof_ = true;
+  finished_ = true;
+}
+
+std::array<int, 256> CalcLumFileCtx::getMedianSet() const {
+  std::array<int, 256> median_set;
+  for (auto index = 0; index < 256; index++) {
+    median_set[index] = median_set_[index].load(std::memory_order_relaxed);
+  }
+  return median_set;
+}
+
+std::vector<int> CalcLumFileCtx::getFineSet() const {
+  std::vector<int> fine_set;
+  if (isExact()) {
+    fine_set.reserve(kFineBinsNum);
+    for (const auto& occurances : *fine_set_) {
+      fine_set.push_back(occurances.load(std::memory_order_relaxed));
+    }
+  }
+  return fine_set;
 }
 
 int CalcLumFileCtx::getFileAverageLuminance() {
@@ -143,13 +427,21 @@ int CalcLumFileCtx::getMaxLuminance() {
   return max_luminance_;
 }
  
-int CalcLumFileCtx::crunchMedian(std::array<int, 256>& median_set) {
-  int total_numbers = 0;
+/*
+  Median of a histogram of whole luminance values. Counters may be 32-bit (one file)
+  or 64-bit (totals of all files), they are summed in 64 bits.
+*/
+template <typename T>
+static int medianOfHistogram(const std::array<T, 256>& median_set) {
+  long long total_numbers = 0;
   for (auto it : median_set) {
     total_numbers += it;
   }
-  
-  int median_loc;
+  if (0 == total_numbers) {
+    return 0;
+  }
+
+  long long median_loc;
   bool need_two_locs = false;
   if(1 == total_numbers % 2) {
     // this is odd number in the set
@@ -183,51 +475,228 @@ int CalcLumFileCtx::crunchMedian(std::array<int, 256>& median_set) {
  return (index + second_index) / 2; 
 }
 
+int CalcLumFileCtx::crunchMedian(std::array<int, 256>& median_set) {
+  return medianOfHistogram(median_set);
+}
+
+int CalcLumFileCtx::crunchMedian(const std::array<long long, 256>& median_set) {
+  return medianOfHistogram(median_set);
+}
+
 int CalcLumFileCtx::getMedianLuminance() {
   // it should never be called before file processing ended.
   assert(eof_);
-  return crunchMedian(median_set_);
+  std::array<int, 256> median_set = getMedianSet();
+  return crunchMedian(median_set);
 }
 
-int StatsAggregator::calcMin() {
-  int min = 255;
-  // just iterate through all file contexts and find the lowest value
-  for (auto file_ctx : files_ctxs_) {
-    min = std::min(min, file_ctx->getMinLuminance());
+/*
+  Median of the fine histogram. Values in a bin are not known exactly, the lower bound of the bin is used,
+  the same way whole luminance is truncated.
+  When the number of frames is even, the median is the average of the two middle frames, not rounded.
+*/
+template <typename T>
+static double fineMedianOfHistogram(const std::vector<T>& fine_set) {
+  long long total_numbers = 0;
+  for (auto it : fine_set) {
+    total_numbers += it;
+  }
+  if (0 == total_numbers) {
+    return 0;
   }
-  return min;
+  // positions of the two middle frames, counted from 0. They are the same when the number is odd.
+  long long positions[2] = {(total_numbers - 1) / 2, total_numbers / 2};
+  int bins[2] = {0, 0};
+  for (auto i = 0; i < 2; i++) {
+    long long seen = 0;
+    int bin = 0;
+    while (seen + fine_set[bin] <= positions[i]) {
+      seen += fine_set[bin];
+      bin++;
+    }
+    bins[i] = bin;
+  }
+  double bin_width = static_cast<double>(1 << kFineBinShift) / (1 << kLumaFixedShift);
+  return (bins[0] + bins[1]) / 2.0 * bin_width;
 }
 
-int StatsAggregator::calcMax() {
-  int max = 0;
-  // just iterate through all file contexts and find the largest value
-  for (auto file_ctx : files_ctxs_) {
-    max = std::max(max, file_ctx->getMaxLuminance());
+double CalcLumFileCtx::crunchFineMedian(const std::vector<int>& fine_set) {
+  return fineMedianOfHistogram(fine_set);
+}
+
+double CalcLumFileCtx::crunchFineMedian(const std::vector<long long>& fine_set) {
+  return fineMedianOfHistogram(fine_set);
+}
+
+double CalcLumFileCtx::getExactAverageLuminance() {
+  assert(eof_ && isExact());
+  return static_cast<double>(file_luminance_fixed_) / frames_processed_ / (1 << kLumaFixedShift);
+}
+
+double CalcLumFileCtx::getExactMinLuminance() {
+  assert(eof_ && isExact());
+  return static_cast<double>(min_fixed_) / (1 << kLumaFixedShift);
+}
+
+double CalcLumFileCtx::getExactMaxLuminance() {
+  assert(eof_ && isExact());
+  return static_cast<double>(max_fixed_) / (1 << kLumaFixedShift);
+}
+
+double CalcLumFileCtx::getExactMedianLuminance() {
+  assert(eof_ && isExact());
+  return crunchFineMedian(getFineSet());
+}
+
+/*
+  Reads statistics of the files in one pass. Histograms are added with the SIMD histogram kernel.
+*/
+void StatsAggregator::foldFiles(const std::shared_ptr<CalcLumFileCtx>* files, size_t files_num,
+                                CalcLumTotals& totals, long long& frames_total) {
+  for (size_t i = 0; i < files_num; i++) {
+    const CalcLumFileCtx& file_ctx = *files[i];
+    totals.merge(file_ctx.getStats());
+    frames_total += file_ctx.getFramesTotal();
   }
-  return max;
 }
 
-int StatsAggregator::calcMean() {
-  // iterate through all file contexta. From each get number of frames and luminance
-  long long total_luminance = 0;
-  long long total_frames = 0;
-  for (auto file_ctx : files_ctxs_) {
-     total_luminance += file_ctx->getFileLuminance();
-     total_frames += file_ctx->getFramesProcessed(); 
+void StatsAggregator::update() {
+  size_t files_num = files_ctxs_.size() - files_folded_;
+  if (0 == files_num) {
+    return;
   }
-  return total_luminance/total_frames;
+  const std::shared_ptr<CalcLumFileCtx>* files = files_ctxs_.data() + files_folded_;
+  size_t max_threads = (0 < threads_num_) ? threads_num_ : std::max(1u, std::thread::hardware_concurrency());
+  size_t threads_num = std::min(max_threads, files_num / kFilesPerThread);
+  if (threads_num <= 1) {
+    foldFiles(files, files_num, totals_, frames_total_);
+  } else {
+    // each thread reduces a contiguous chunk into its own totals, they are merged afterwards
+    std::vector<CalcLumTotals> partial_totals(threads_num);
+    std::vector<long long> partial_frames(threads_num, 0);
+    std::vector<std::thread> threads;
+    size_t chunk = (files_num + threads_num - 1) / threads_num;
+    for (size_t t = 0; t < threads_num; t++) {
+      size_t first = t * chunk;
+      size_t num = std::min(chunk, files_num - first);
+      threads.emplace_back(foldFiles, files + first, num, std::ref(partial_totals[t]), std::ref(partial_frames[t]));
+    }
+    for (size_t t = 0; t < threads_num; t++) {
+      threads[t].join();
+      totals_.merge(partial_totals[t]);
+      frames_total_ += partial_frames[t];
+    }
+  }
+  files_folded_ = files_ctxs_.size();
+}
+
+int StatsAggregator::calcMin() {
+  update();
+  return (-1 != totals_.min_luminance) ? totals_.min_luminance : 255;
+}
+
+int StatsAggregator::calcMax() {
+  update();
+  return std::max(totals_.max_luminance, 0);
+}
+
+int StatsAggregator::calcMean() {
+  update();
+  return (0 < totals_.frames) ? totals_.luminance / totals_.frames : 0;
+}
+
+long long StatsAggregator::calcFramesSampled() {
+  update();
+  return totals_.frames;
+}
+
+long long StatsAggregator::calcFramesTotal() {
+  update();
+  return frames_total_;
 }
 
 int StatsAggregator::calcMedian() {
-  std::array<int, 256> total_set;
-  total_set.fill(0);
+  update();
+  return CalcLumFileCtx::crunchMedian(totals_.median_set);
+}
+
+double StatsAggregator::calcExactMin() {
+  update();
+  return (-1 != totals_.min_fixed) ? static_cast<double>(totals_.min_fixed) / (1 << kLumaFixedShift) : 255;
+}
 
-  for (auto file_ctx : files_ctxs_) {
-    const std::array<int, 256>& file_set = file_ctx->getMedianSet();
-    for (auto index = 0; index < 256; index++) {
-      total_set[index] += file_set[index];
+double StatsAggregator::calcExactMax() {
+  update();
+  return (-1 != totals_.max_fixed) ? static_cast<double>(totals_.max_fixed) / (1 << kLumaFixedShift) : 0;
+}
+
+double StatsAggregator::calcExactMean() {
+  update();
+  return (0 < totals_.frames) ? static_cast<double>(totals_.luminance_fixed) / totals_.frames / (1 << kLumaFixedShift) : 0;
+}
+
+double StatsAggregator::calcExactMedian() {
+  update();
+  return CalcLumFileCtx::crunchFineMedian(totals_.fine_set);
+}
+
+/*
+  Returns a free frame buffer. New (empty) buffer is created only when there are
+  no free buffers and the limit has not been reached yet. Otherwise pends until
+  a job returns its buffer.
+*/
+cv::Mat CalcLumFramePool::acquire() {
+  std::unique_lock<std::mutex> lk(m_);
+  if (free_frames_.empty() && (created_ < capacity_)) {
+    created_++;
+    return cv::Mat();
+  }
+  cv_.wait(lk, [this]{return !free_frames_.empty() || (created_ < capacity_);});
+  if (free_frames_.empty()) {
+    created_++;
+    return cv::Mat();
+  }
+  cv::Mat frame = std::move(free_frames_.back());
+  free_frames_.pop_back();
+  return frame;
+}
+
+void CalcLumFramePool::release(cv::Mat frame) {
+  {
+    std::lock_guard<std::mutex> lk(m_);
+    if (created_ > capacity_) {
+      // the pool has shrunk, the buffer is freed with frame
+      created_--;
+      return;
     }
-  } 
-  
-  return CalcLumFileCtx::crunchMedian(total_set);
+    free_frames_.push_back(std::move(frame));
+  }
+  cv_.notify_one();
+}
+
+void CalcLumFramePool::grow(int frames) {
+  {
+    std::lock_guard<std::mutex> lk(m_);
+    capacity_ += frames;
+  }
+  cv_.notify_all();
+}
+
+void CalcLumFramePool::shrink(int frames) {
+  std::lock_guard<std::mutex> lk(m_);
+  capacity_ -= frames;
+  while ((created_ > capacity_) && !free_frames_.empty()) {
+    free_frames_.pop_back();
+    created_--;
+  }
+}
+
+int CalcLumFramePool::getCapacity() {
+  std::lock_guard<std::mutex> lk(m_);
+  return capacity_;
+}
+
+int CalcLumFramePool::getCreatedNum() {
+  std::lock_guard<std::mutex> lk(m_);
+  return created_;
 }
@@ -1,11 +1,19 @@
 #pragma once
 #include "job.h"
+#include "stats.h"
+#include "profiler.h"
+#include "series.h"
+#include "roi.h"
+#include "resultCache.h"
 #include <opencv2/opencv.hpp>
 #include <atomic>
 #include <memory>
 #include <condition_variable>
+#include <mutex>
 #include <vector>
 
+class CalcLumFrameJob;
+
 /*
   CalcLumFileCtx class represents a context releated to a single file.
   There is only one such context per file and it is shared between threads
@@ -14,27 +22,93 @@
 class CalcLumFileCtx {
 public:
   CalcLumFileCtx() = delete;
-  CalcLumFileCtx(const std::string& file_name) : file_name_(file_name) { median_set_.fill(0); }
+  CalcLumFileCtx(const std::string& file_name);
 
   void setSyncVars(std::shared_ptr<std::condition_variable> cv,  std::shared_ptr<std::mutex> cv_m,
                    std::shared_ptr<int> files_counter) { cv_ = cv; cv_m_ = cv_m; files_counter_ = files_counter; }
+  // Jobs of the file record time of merging their results into the context.
+  void setProfiler(std::shared_ptr<CalcLumProfiler> profiler) { profiler_ = profiler; }
+  CalcLumProfiler* getProfiler() const { return profiler_.get(); }
+  // Luminance of each frame goes to the time series. It is finished when the end of the file is signaled.
+  void setSeries(std::shared_ptr<CalcLumSeries> series) { series_ = series; }
+  CalcLumSeries* getSeries() const { return series_.get(); }
+  // Region of interest selected for the run. The region of the file is resolved by the first frame
+  // and kept, so the other frames reuse it. In letterbox mode it is detected by the reader instead.
+  void setRoiSpec(std::shared_ptr<const CalcLumRoiSpec> roi_spec) { roi_spec_ = roi_spec; }
+  const CalcLumRoiSpec* getRoiSpec() const { return roi_spec_.get(); }
+  // Returns the region of the file, nullptr while it is not known.
+  const CalcLumRoi* getRoi() const { return roi_ready_.load(std::memory_order_acquire) ? roi_.get() : nullptr; }
+  // Keeps the region unless another thread has set it first. Returns the region kept.
+  const CalcLumRoi* setRoi(std::shared_ptr<const CalcLumRoi> roi);
+  // Letterbox mode. The reader calls it for frames from the beginning of the file, before any job of the file
+  // is sent. Returns true when the region is set: the bars have been found in the frame, or kLetterboxAttempts
+  // frames have been too dark to tell them and the whole frame is used.
+  bool detectLetterbox(const CalcLumFrameJob& job);
+  // Letterbox mode. The file has ended before the region was set, whole frames of the last frame tried are used.
+  void finishLetterbox();
+  // Identity of the file when it was found. Results are cached with it, so a file changed while
+  // being read is read again next time. Set by the main thread before the file is queued.
+  void setIdentity(const CalcLumFileIdentity& identity) { identity_ = identity; has_identity_ = true; }
+  // Returns false when the identity is not known, e.g. for a pipe.
+  bool getIdentity(CalcLumFileIdentity& identity) const { identity = identity_; return has_identity_; }
   void incFramesRead() { frames_read_++; }
   void incFramesProcessed() { frames_processed_++; }
+  void addFramesProcessed(int frames) { frames_processed_ += frames; }
+  // Frames skipped in frame skipping mode. They are neither decoded nor processed.
+  void incFramesSkipped() { frames_skipped_++; }
   const std::atomic<int>& getFramesRead() const {return frames_read_; }
+  int getFramesSkipped() const { return frames_skipped_.load(); }
+  // Number of frames found in the file: sampled (read) and skipped.
+  int getFramesTotal() const { return frames_read_.load() + frames_skipped_.load(); }
   int getFramesProcessed() const {return frames_processed_.load(); }
   void signalEnd();
+  // Marks the file as failed and signals its end right away, see abandon in frameJob.cc.
+  void abandon();
+  // Set when processing of the file is over: all frames have been processed,
+  // statistics have been loaded or the file could not be opened.
+  void setFinished() { finished_ = true; }
+  bool isFinished() const { return finished_; }
   void setEOF() {eof_ = true;}
+  // File may be read in several segments by different reader threads.
+  // EOF is set when all segments have been read.
+  void setSegments(int segments) { segments_left_ = segments; }
+  // Returns true when the last segment has been read.
+  bool segmentRead() { return 0 == --segments_left_; }
   void reportFrameLuminance(int);
+  // Exact mode. Frames are reported in fixed point (see kLumaFixedShift) and kept in a finer histogram too.
+  // It must be set before any frame is reported.
+  void setExact();
+  bool isExact() const { return nullptr != fine_set_; }
+  void reportFrameLuminanceFixed(uint32_t frame_luminance_fixed);
+  // Merges statistics of several frames at once.
+  void reportStats(const CalcLumStats& stats);
   int getFileAverageLuminance();
   int getMinLuminance();
   int getMaxLuminance();
   int getMedianLuminance();
-  long long getFileLuminance() const { return file_luminance_; }
+  long long getFileLuminance() const { return file_luminance_.load(); }
   static int crunchMedian(std::array<int, 256>& median_set);
-  const std::array<int, 256>& getMedianSet() const {return median_set_; }
+  static int crunchMedian(const std::array<long long, 256>& median_set);
+  // Exact mode results, they are not rounded. Median is the lower bound of its fine histogram bin.
+  double getExactAverageLuminance();
+  double getExactMinLuminance();
+  double getExactMaxLuminance();
+  double getExactMedianLuminance();
+  unsigned long long getFileLuminanceFixed() const { return file_luminance_fixed_.load(); }
+  static double crunchFineMedian(const std::vector<int>& fine_set);
+  static double crunchFineMedian(const std::vector<long long>& fine_set);
+  // Returns statistics of all processed frames. They are consistent only when no frames are being reported.
+  CalcLumStats getStats() const;
+  // Fills the context with statistics computed earlier (e.g. taken from the result cache)
+  // and marks the file as completely processed, so it does not have to be read.
+  void loadStats(const CalcLumStats& stats, int frames_total);
+  // Returns a copy of the median set. It is consistent only when no frames are being reported.
+  std::array<int, 256> getMedianSet() const;
+  // Exact mode. Returns a copy of the fine histogram, empty when not in exact mode.
+  std::vector<int> getFineSet() const;
   const std::string& getFileName() const {return file_name_; }
   void setError() { error_ = true; }
-  bool isError() { return error_; }
+  bool isError() const { return error_; }
 
 private:
   std::string file_name_;
@@ -43,40 +117,124 @@ private:
   std::shared_ptr<std::condition_variable> cv_;
   std::shared_ptr<std::mutex> cv_m_;
   std::shared_ptr<int> files_counter_;
+  std::shared_ptr<CalcLumProfiler> profiler_;
+  std::shared_ptr<CalcLumSeries> series_;
+  std::shared_ptr<const CalcLumRoiSpec> roi_spec_;
+  // region is written once under roi_m_, roi_ready_ publishes it to threads which read it without lock
+  std::mutex roi_m_;
+  std::shared_ptr<const CalcLumRoi> roi_;
+  std::atomic<bool> roi_ready_{false};
+  // letterbox detection, used by the reader thread only
+  int roi_attempts_{0};
+  CalcLumRect roi_frame_;
+  CalcLumFileIdentity identity_;
+  bool has_identity_{false};
 
   std::atomic<int> frames_read_{0};
   std::atomic<int> frames_processed_{0};
+  std::atomic<int> frames_skipped_{0};
   std::atomic<bool> eof_{false}; // when true it indicates that all frames from file has been read
+  std::atomic<int> segments_left_{1}; // number of segments still being read
+  std::atomic<bool> end_signaled_{false}; // set when end of file processing has been signaled
+  std::atomic<bool> finished_{false};
 
-  // mutex guards access to the per-file statistics
-  std::mutex ctx_m_;
-  long long file_luminance_{0};
-  int min_luminance_{-1};
-  int max_luminance_{-1};
+  // Per-file statistics. Many worker threads update them at the same time.
+  // They are atomic, so no lock is needed. Sum and median set are updated with fetch_add,
+  // min and max with compare-and-swap. Statistics are read only after all frames have been processed.
+  std::atomic<long long> file_luminance_{0};
+  std::atomic<int> min_luminance_{-1};
+  std::atomic<int> max_luminance_{-1};
   // the following array is used to calculate median value
   // since each luminance is between 0 and 255, the number of occurances of each
   // luminance is stored in array of such size.
-  std::array<int, 256> median_set_;
+  std::array<std::atomic<int>, 256> median_set_;
+
+  // Exact mode statistics, updated the same way. The histogram is allocated only in exact mode.
+  std::atomic<unsigned long long> file_luminance_fixed_{0};
+  std::atomic<long long> min_fixed_{-1};
+  std::atomic<long long> max_fixed_{-1};
+  std::unique_ptr<std::array<std::atomic<int>, kFineBinsNum> > fine_set_;
+
+  void updateMinMax(int min_luminance, int max_luminance);
+  void notifyEnd();
 
   // set when error happened during processing. It will be omitted
   // when calculating statistics
-  bool error_{false};
+  std::atomic<bool> error_{false};
 };
 
 /*
   StatsAggregator class is used to calculate stats across all successfully processed files.
+  Statistics of each file are read once, in a single pass, and kept in running totals, so all
+  results are taken from the totals. Files added since the last calculation are folded into
+  the totals by the next one, e.g. in watch mode only new files are read. Large sets of new files
+  are split into chunks reduced by several threads and partial totals are merged at the end.
+  A file must not change after it has been folded.
 */
 class StatsAggregator {
 public:
+  // threads_num limits threads reducing files, 0 means one per CPU.
+  StatsAggregator(int threads_num = 0) : threads_num_(threads_num) {}
   void addFileCtx(std::shared_ptr<CalcLumFileCtx> fileCtx) { files_ctxs_.push_back(fileCtx); }
   int calcMin();
   int calcMax();
   int calcMean();
   int calcMedian();
+  // Exact mode versions. All files must have been processed in exact mode.
+  double calcExactMin();
+  double calcExactMax();
+  double calcExactMean();
+  double calcExactMedian();
+  // Number of frames used in statistics and number of frames found in all files.
+  // They differ in frame skipping mode.
+  long long calcFramesSampled();
+  long long calcFramesTotal();
   bool empty() const {return files_ctxs_.empty();}
- 
+  // Minimum number of files reduced by one thread.
+  static const size_t kFilesPerThread = 4096;
+
 private:
+  int threads_num_;
   std::vector<std::shared_ptr<CalcLumFileCtx> > files_ctxs_;
+  // number of files already in the totals
+  size_t files_folded_{0};
+  CalcLumTotals totals_;
+  long long frames_total_{0};
+
+  // Folds files added since the last call into the totals.
+  void update();
+  static void foldFiles(const std::shared_ptr<CalcLumFileCtx>* files, size_t files_num,
+                        CalcLumTotals& totals, long long& frames_total);
+};
+
+/*
+  CalcLumFramePool keeps frame buffers for reuse. Reader threads take a buffer for each frame
+  and the job returns it to the pool when it is destroyed. cv::VideoCapture::read reuses the
+  buffer if it has the right size, so after the first few frames no memory is allocated for frames.
+  The pool creates at most capacity buffers. When all of them are in use, reader pends until
+  one is returned. This bounds memory used by frames to capacity * frame size.
+  Capacity grows when buffers are held by a reader thread which will not return them soon (see grow).
+*/
+class CalcLumFramePool {
+public:
+  CalcLumFramePool() = delete;
+  CalcLumFramePool(int capacity) : capacity_(capacity) {}
+
+  cv::Mat acquire();
+  void release(cv::Mat frame);
+  // Allows frames more buffers to be created, e.g. in place of buffers held by an abandoned reader.
+  void grow(int frames);
+  // Gives back frames buffers allowed by grow. Buffers over the capacity are freed when they are released.
+  void shrink(int frames);
+  int getCapacity();
+  int getCreatedNum();
+
+private:
+  std::mutex m_;
+  std::condition_variable cv_;
+  std::vector<cv::Mat> free_frames_;
+  int created_{0};
+  int capacity_;
 };
 
 /* 
@@ -90,11 +248,97 @@ public:
   virtual void processJob() override;
   cv::Mat& getFrame() { return frame_; }
   void setFileCtx(std::shared_ptr<CalcLumFileCtx> file_ctx) { file_ctx_ = file_ctx; }
-  virtual ~CalcLumFrameJob() override {}
+  // Takes frame buffer from the pool. It is returned to the pool when the job is destroyed.
+  void setFramePool(std::shared_ptr<CalcLumFramePool> frame_pool);
+  // Frame may point to memory owned by another object (e.g. memory mapped file).
+  // The job keeps the owner alive until it is destroyed.
+  void setFrameOwner(std::shared_ptr<const void> frame_owner) { frame_owner_ = frame_owner; }
+  // Place of the frame in the time series of the file. Not set when no series is written.
+  void setSeriesSlot(const CalcLumSeriesSlot& series_slot) { series_slot_ = series_slot; }
+  void recordSeries(int frame_luminance) {
+    if (series_slot_.isValid()) {
+      series_slot_.setLuminance(frame_luminance);
+    }
+  }
+  virtual ~CalcLumFrameJob() override;
 
-private:
+  // Only every sample_step-th pixel of every sample_step-th row is used (approximate mode).
+  // 1 means all pixels are used.
+  void setSampleStep(int sample_step) { sample_step_ = sample_step; }
+  // In exact mode luminance is reported to the file context in fixed point.
+  void setExact(bool exact) { exact_ = exact; }
+  bool isExact() const { return exact_; }
+
+  // Returns average luminance of the frame, truncated to a whole number.
+  int calcFrameLuminance() { return calcFrameLuminanceFixed() >> kLumaFixedShift; }
+  // Returns average luminance of the frame in fixed point with kLumaFixedShift fractional bits.
+  // Only the region of interest of the file is used. Frame is in BGR format.
+  virtual uint32_t calcFrameLuminanceFixed();
+
+  // Returns the rectangle between black bars of the frame, empty when it cannot be told.
+  virtual CalcLumRect detectLetterbox() const;
+  // Returns the whole frame luminance is calculated from.
+  CalcLumRect getLumaRect() const { return CalcLumRect(0, 0, frame_.cols, getLumaRows()); }
+
+protected:
   cv::Mat frame_;
+  int sample_step_{1};
+  bool exact_{false};
+
+  // Returns the region of interest of the file, nullptr when the whole frame is used.
+  const CalcLumRoi* getRoi(int rows, int cols);
+  // Number of rows luminance is calculated from.
+  virtual int getLumaRows() const { return frame_.rows; }
+
+private:
   std::shared_ptr<CalcLumFileCtx> file_ctx_;
+  std::shared_ptr<CalcLumFramePool> frame_pool_;
+  std::shared_ptr<const void> frame_owner_;
+  CalcLumSeriesSlot series_slot_;
 };
 
+/*
+  Job processing a frame delivered by decoder in its native YUV format
+  (planar YUV420 stored as a single channel image or just Y plane).
+  Only Y plane is added, no color conversion is needed. Y values are used as they are, so limited range
+  content (16-235) gives other values than the full range luma of the BGR kernel.
+  If decoder ignored the request and delivered BGR frame, BGR kernel is used.
+*/
+class CalcLumYPlaneFrameJob : public CalcLumFrameJob {
+public:
+  // Number of rows in Y plane. It is the height of the video.
+  void setLumaRows(int luma_rows) { luma_rows_ = luma_rows; }
+  virtual ~CalcLumYPlaneFrameJob() override {}
+
+  virtual uint32_t calcFrameLuminanceFixed() override;
+
+  virtual CalcLumRect detectLetterbox() const override;
+
+protected:
+  virtual int getLumaRows() const override {
+    return ((0 < luma_rows_) && (luma_rows_ < frame_.rows)) ? luma_rows_ : frame_.rows;
+  }
+
+private:
+  int luma_rows_{0};
+};
 
+/*
+  Job carrying several frames of the same file. Luminance of all frames is
+  accumulated locally and merged into file context once, so the file context is locked
+  and the scheduler queue is used once per batch instead of once per frame.
+  Frames are kept in frame jobs, so all frame formats are handled the same way as
+  by single frame jobs.
+*/
+class CalcLumBatchJob : public CalcLumJob {
+public:
+  virtual void processJob() override;
+  void addFrameJob(std::unique_ptr<CalcLumFrameJob> job) { jobs_.push_back(std::move(job)); }
+  int getFramesNum() const { return jobs_.size(); }
+  void setFileCtx(std::shared_ptr<CalcLumFileCtx> file_ctx) { file_ctx_ = file_ctx; }
+  virtual ~CalcLumBatchJob() override {}
+
+private:
+  std::vector<std::unique_ptr<CalcLumFrameJob> > jobs_;
+  std::shared_ptr<CalcLumFileCtx> file_ctx_;
+};
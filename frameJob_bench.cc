@@ -0,0 +1,149 @@
+/*
+  Benchmarks of frame jobs and statistics: processing a frame, reporting luminance of frames
+  from many threads to one file context and aggregating statistics of many files.
+  Run with: make bench
+*/
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <vector>
+#include <random>
+#include "frameJob.h"
+
+// SD, HD and 4K frames
+static const int kFrameSizes[][2] = {{720, 576}, {1920, 1080}, {3840, 2160}};
+
+static void randomFill(cv::Mat& frame) {
+  std::mt19937 gen(1);
+  for (int i = 0; i < frame.rows; i++) {
+    uint8_t* row = frame.ptr(i);
+    for (size_t j = 0; j < frame.cols * frame.elemSize(); j++) {
+      row[j] = gen();
+    }
+  }
+}
+
+/*
+  Arguments: index of frame size, exact mode (0 or 1).
+  The whole job is measured: the kernel and reporting the result to the file context.
+*/
+static void BM_ProcessJobBGR(benchmark::State& state) {
+  int cols = kFrameSizes[state.range(0)][0];
+  int rows = kFrameSizes[state.range(0)][1];
+  std::shared_ptr<CalcLumFileCtx> ctx = std::make_shared<CalcLumFileCtx>("bench");
+  if (state.range(1)) {
+    ctx->setExact();
+  }
+  CalcLumFrameJob job;
+  job.setFileCtx(ctx);
+  job.setExact(state.range(1));
+  job.getFrame().create(rows, cols, CV_8UC3);
+  randomFill(job.getFrame());
+  for (auto _ : state) {
+    job.processJob();
+  }
+  state.SetItemsProcessed(state.iterations() * rows * cols);
+}
+
+// Planar YUV420 frame, only Y plane is used.
+static void BM_ProcessJobYPlane(benchmark::State& state) {
+  int cols = kFrameSizes[state.range(0)][0];
+  int rows = kFrameSizes[state.range(0)][1];
+  std::shared_ptr<CalcLumFileCtx> ctx = std::make_shared<CalcLumFileCtx>("bench");
+  if (state.range(1)) {
+    ctx->setExact();
+  }
+  CalcLumYPlaneFrameJob job;
+  job.setFileCtx(ctx);
+  job.setExact(state.range(1));
+  job.setLumaRows(rows);
+  job.getFrame().create(rows * 3 / 2, cols, CV_8UC1);
+  randomFill(job.getFrame());
+  for (auto _ : state) {
+    job.processJob();
+  }
+  state.SetItemsProcessed(state.iterations() * rows * cols);
+}
+
+static void frameSizeArgs(benchmark::internal::Benchmark* b) {
+  for (auto size = 0; size <= 2; size++) {
+    for (auto exact = 0; exact <= 1; exact++) {
+      b->Args({size, exact});
+    }
+  }
+  b->ArgNames({"size", "exact"})->Unit(benchmark::kMicrosecond);
+}
+
+BENCHMARK(BM_ProcessJobBGR)->Apply(frameSizeArgs);
+BENCHMARK(BM_ProcessJobYPlane)->Apply(frameSizeArgs);
+
+/*
+  All threads report frames of the same file, as workers do when a single file is processed.
+  Shows the cost of atomic updates of the shared statistics under contention.
+*/
+static std::shared_ptr<CalcLumFileCtx> shared_ctx;
+
+static void BM_ReportFrameLuminance(benchmark::State& state) {
+  if (0 == state.thread_index()) {
+    shared_ctx = std::make_shared<CalcLumFileCtx>("bench");
+  }
+  int luminance = (state.thread_index() * 37) & 0xFF;
+  for (auto _ : state) {
+    shared_ctx->reportFrameLuminance(luminance);
+    shared_ctx->incFramesProcessed();
+    luminance = (luminance + 1) & 0xFF;
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (0 == state.thread_index()) {
+    shared_ctx.reset();
+  }
+}
+BENCHMARK(BM_ReportFrameLuminance)->ThreadRange(1, 16)->UseRealTime();
+
+static void BM_CrunchMedian(benchmark::State& state) {
+  std::array<int, 256> median_set;
+  std::mt19937 gen(1);
+  for (auto& occurances : median_set) {
+    occurances = gen() % 1000;
+  }
+  for (auto _ : state) {
+    std::array<int, 256> set = median_set;
+    benchmark::DoNotOptimize(CalcLumFileCtx::crunchMedian(set));
+  }
+}
+BENCHMARK(BM_CrunchMedian);
+
+/*
+  Arguments: number of file contexts.
+  All statistics displayed at the end of a run are calculated by a new aggregator, so each iteration
+  reduces all files.
+*/
+static void BM_StatsAggregator(benchmark::State& state) {
+  int files_num = state.range(0);
+  std::vector<std::shared_ptr<CalcLumFileCtx> > ctxs;
+  std::mt19937 gen(1);
+  for (auto file = 0; file < files_num; file++) {
+    std::shared_ptr<CalcLumFileCtx> ctx = std::make_shared<CalcLumFileCtx>("bench");
+    for (auto frame = 0; frame < 100; frame++) {
+      ctx->incFramesRead();
+      ctx->reportFrameLuminance(gen() % 256);
+      ctx->incFramesProcessed();
+    }
+    ctx->setEOF();
+    ctxs.push_back(ctx);
+  }
+  for (auto _ : state) {
+    StatsAggregator aggr;
+    for (const auto& ctx : ctxs) {
+      aggr.addFileCtx(ctx);
+    }
+    benchmark::DoNotOptimize(aggr.calcMin());
+    benchmark::DoNotOptimize(aggr.calcMax());
+    benchmark::DoNotOptimize(aggr.calcMean());
+    benchmark::DoNotOptimize(aggr.calcMedian());
+  }
+  state.SetItemsProcessed(state.iterations() * files_num);
+}
+BENCHMARK(BM_StatsAggregator)->RangeMultiplier(10)->Range(10, 100000)->ArgName("files")
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -366,6 +366,605 @@ TEST(StatsAggregator, calcMedianManyCtx2) {
   ASSERT_EQ(4, aggr.calcMedian()); 
 }
   
+// Files added after results have been calculated are folded in by the next calculation.
+TEST(StatsAggregator, incrementalUpdate) {
+  StatsAggregator aggr;
+  ASSERT_EQ(255, aggr.calcMin());
+  ASSERT_EQ(0, aggr.calcMax());
+
+  std::shared_ptr<CalcLumFileCtx> f = std::make_shared<CalcLumFileCtx>("test");
+  f->incFramesRead();
+  f->reportFrameLuminance(100);
+  f->incFramesProcessed();
+  f->incFramesSkipped();
+  aggr.addFileCtx(f);
+  ASSERT_EQ(100, aggr.calcMin());
+  ASSERT_EQ(100, aggr.calcMean());
+  ASSERT_EQ(2, aggr.calcFramesTotal());
+
+  f = std::make_shared<CalcLumFileCtx>("test");
+  f->incFramesRead();
+  f->reportFrameLuminance(50);
+  f->incFramesProcessed();
+  aggr.addFileCtx(f);
+  ASSERT_EQ(50, aggr.calcMin());
+  ASSERT_EQ(100, aggr.calcMax());
+  ASSERT_EQ(75, aggr.calcMean());
+  ASSERT_EQ(75, aggr.calcMedian());
+  ASSERT_EQ(2, aggr.calcFramesSampled());
+  ASSERT_EQ(3, aggr.calcFramesTotal());
+}
+
+// More than INT_MAX frames in all files, each file below it.
+TEST(StatsAggregator, moreFramesThanInt) {
+  StatsAggregator aggr;
+  for (auto file = 0; file < 3; file++) {
+    CalcLumStats stats;
+    stats.frames = 1000000000;
+    stats.luminance = 1000000000LL * (100 + file);
+    stats.min_luminance = stats.max_luminance = 100 + file;
+    stats.median_set[100 + file] = 1000000000;
+    stats.fine_set.assign(kFineBinsNum, 0);
+    stats.fine_set[(100 + file) << 4] = 1000000000;
+    stats.luminance_fixed = 1000000000ULL * ((100 + file) << kLumaFixedShift);
+    stats.min_fixed = stats.max_fixed = (100 + file) << kLumaFixedShift;
+    std::shared_ptr<CalcLumFileCtx> f = std::make_shared<CalcLumFileCtx>("test");
+    f->setExact();
+    f->loadStats(stats, stats.frames);
+    aggr.addFileCtx(f);
+  }
+  ASSERT_EQ(3000000000LL, aggr.calcFramesSampled());
+  ASSERT_EQ(3000000000LL, aggr.calcFramesTotal());
+  ASSERT_EQ(101, aggr.calcMean());
+  ASSERT_EQ(101, aggr.calcMedian());
+  ASSERT_DOUBLE_EQ(101, aggr.calcExactMean());
+  ASSERT_DOUBLE_EQ(101, aggr.calcExactMedian());
+}
+
+// Many files are reduced by several threads. Results are the same as with one thread.
+TEST(StatsAggregator, parallelReduction) {
+  StatsAggregator parallel(4), serial(1);
+  int files_num = 3 * StatsAggregator::kFilesPerThread + 7;
+  for (auto file = 0; file < files_num; file++) {
+    std::shared_ptr<CalcLumFileCtx> f = std::make_shared<CalcLumFileCtx>("test");
+    f->reportFrameLuminance(file % 251);
+    f->reportFrameLuminance((file * 7) % 256);
+    f->incFramesProcessed();
+    f->incFramesProcessed();
+    parallel.addFileCtx(f);
+    serial.addFileCtx(f);
+  }
+  ASSERT_EQ(2 * files_num, parallel.calcFramesSampled());
+  ASSERT_EQ(serial.calcMin(), parallel.calcMin());
+  ASSERT_EQ(255, parallel.calcMax());
+  ASSERT_EQ(serial.calcMean(), parallel.calcMean());
+  ASSERT_EQ(serial.calcMedian(), parallel.calcMedian());
+  ASSERT_EQ(0, parallel.calcMin());
+}
+
+TEST(frameJob, lastSegmentRead) {
+  CalcLumFileCtx file_ctx("test");
+
+  file_ctx.setSegments(3);
+  ASSERT_FALSE(file_ctx.segmentRead());
+  ASSERT_FALSE(file_ctx.segmentRead());
+  ASSERT_TRUE(file_ctx.segmentRead());
+}
+
+// End of file processing must be signaled only once, even when checked many times.
+TEST(frameJob, endSignaledOnce) {
+  CalcLumFileCtx file_ctx("test");
+  std::shared_ptr<int> counter = std::make_shared<int>(2);
+  file_ctx.setSyncVars(std::make_shared<std::condition_variable>(), std::make_shared<std::mutex>(), counter);
+
+  file_ctx.incFramesRead();
+  file_ctx.reportFrameLuminance(10);
+  file_ctx.incFramesProcessed();
+  file_ctx.signalEnd();
+  // EOF not set yet
+  ASSERT_EQ(2, *counter);
+  ASSERT_FALSE(file_ctx.isFinished());
+
+  file_ctx.setEOF();
+  file_ctx.signalEnd();
+  file_ctx.signalEnd();
+  ASSERT_EQ(1, *counter);
+  ASSERT_TRUE(file_ctx.isFinished());
+}
+
+// A file abandoned by the watchdog ends at once, although not all frames read have been processed.
+TEST(frameJob, abandonedFile) {
+  CalcLumFileCtx file_ctx("test");
+  std::shared_ptr<int> counter = std::make_shared<int>(2);
+  file_ctx.setSyncVars(std::make_shared<std::condition_variable>(), std::make_shared<std::mutex>(), counter);
+
+  file_ctx.incFramesRead();
+  file_ctx.incFramesRead();
+  file_ctx.reportFrameLuminance(10);
+  file_ctx.incFramesProcessed();
+  file_ctx.abandon();
+  ASSERT_EQ(1, *counter);
+  ASSERT_TRUE(file_ctx.isFinished());
+  ASSERT_TRUE(file_ctx.isError());
+
+  // the last job finishes later
+  file_ctx.reportFrameLuminance(10);
+  file_ctx.incFramesProcessed();
+  file_ctx.signalEnd();
+  ASSERT_EQ(1, *counter);
+
+  // file abandoned while being opened was never counted
+  CalcLumFileCtx opening_ctx("opening");
+  opening_ctx.abandon();
+  ASSERT_TRUE(opening_ctx.isFinished());
+  ASSERT_TRUE(opening_ctx.isError());
+}
+
+// Many threads report frames to the same file context at the same time. No update may be lost.
+TEST(frameJob, concurrentReports) {
+  CalcLumFileCtx file_ctx("test");
+
+  std::vector<std::thread> workers;
+  for (auto w = 0; w < 8; w++) {
+    workers.emplace_back([&file_ctx, w]{
+      for (auto i = 0; i < 10000; i++) {
+        file_ctx.reportFrameLuminance((i + w) % 200 + 10);
+        file_ctx.incFramesProcessed();
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  file_ctx.setEOF();
+
+  std::array<int, 256> median_set = file_ctx.getMedianSet();
+  int total = 0;
+  for (auto occurances : median_set) {
+    total += occurances;
+  }
+  ASSERT_EQ(80000, total);
+  ASSERT_EQ(10, file_ctx.getMinLuminance());
+  ASSERT_EQ(209, file_ctx.getMaxLuminance());
+}
+
+// Luminance calculated by the job must be the same as Y channel obtained from OpenCV
+TEST(frameJob, processJobMatchesCvtColor) {
+  std::shared_ptr<CalcLumFileCtx> f = std::make_shared<CalcLumFileCtx>("test");
+  CalcLumFrameJob job;
+  job.setFileCtx(f);
+  cv::Mat& frame = job.getFrame();
+  frame.create(121, 203, CV_8UC3);
+  cv::randu(frame, cv::Scalar(0, 0, 0), cv::Scalar(256, 256, 256));
+
+  cv::Mat yuv_frame;
+  cv::cvtColor(frame, yuv_frame, CV_BGR2YUV);
+  long long expected = 0;
+  for (int i = 0; i < yuv_frame.rows; i++) {
+    for (int j = 0; j < yuv_frame.cols; j++) {
+      expected += yuv_frame.at<cv::Vec3b>(i, j)[0];
+    }
+  }
+  expected /= (yuv_frame.rows * yuv_frame.cols);
+
+  job.processJob();
+  f->setEOF();
+  ASSERT_EQ(expected, f->getMinLuminance());
+  ASSERT_EQ(1, f->getFramesProcessed());
+}
+
+// Skipped frames are counted, but statistics are calculated from sampled frames only.
+TEST(frameJob, skippedFramesCounted) {
+  std::shared_ptr<CalcLumFileCtx> f = std::make_shared<CalcLumFileCtx>("test");
+  for (auto i = 0; i < 10; i++) {
+    if (0 == i % 3) {
+      f->incFramesRead();
+      f->reportFrameLuminance(20 * i);
+      f->incFramesProcessed();
+    } else {
+      f->incFramesSkipped();
+    }
+  }
+  f->setEOF();
+  ASSERT_EQ(4, f->getFramesRead());
+  ASSERT_EQ(6, f->getFramesSkipped());
+  ASSERT_EQ(10, f->getFramesTotal());
+  ASSERT_EQ((0 + 60 + 120 + 180) / 4, f->getFileAverageLuminance());
+
+  StatsAggregator aggr;
+  aggr.addFileCtx(f);
+  ASSERT_EQ(4, aggr.calcFramesSampled());
+  ASSERT_EQ(10, aggr.calcFramesTotal());
+  ASSERT_EQ((0 + 60 + 120 + 180) / 4, aggr.calcMean());
+}
+
+// Statistics taken out of a context and loaded into another one give the same results.
+TEST(frameJob, statsLoadedFromCache) {
+  CalcLumFileCtx processed("test");
+  for (auto luminance : {5, 100, 100, 250}) {
+    processed.reportFrameLuminance(luminance);
+    processed.incFramesRead();
+    processed.incFramesProcessed();
+  }
+  processed.incFramesSkipped();
+  processed.setEOF();
+
+  CalcLumFileCtx cached("test");
+  cached.loadStats(processed.getStats(), processed.getFramesTotal());
+  ASSERT_EQ(processed.getFileAverageLuminance(), cached.getFileAverageLuminance());
+  ASSERT_EQ(5, cached.getMinLuminance());
+  ASSERT_EQ(250, cached.getMaxLuminance());
+  ASSERT_EQ(100, cached.getMedianLuminance());
+  ASSERT_EQ(4, cached.getFramesProcessed());
+  ASSERT_EQ(5, cached.getFramesTotal());
+}
+
+// Runs a BGR frame job and returns luminance reported to the file context.
+static int jobLuminance(const cv::Mat& frame, int sample_step) {
+  CalcLumFrameJob job;
+  job.setSampleStep(sample_step);
+  frame.copyTo(job.getFrame());
+  return job.calcFrameLuminance();
+}
+
+// Approximate mode on smooth content: error must not exceed 1.
+TEST(frameJob, sampledGradientError) {
+  cv::Mat frame(360, 640, CV_8UC3);
+  for (int i = 0; i < frame.rows; i++) {
+    for (int j = 0; j < frame.cols; j++) {
+      uint8_t value = (i * 3 + j) * 255 / (360 * 3 + 640);
+      frame.at<cv::Vec3b>(i, j) = cv::Vec3b(value, value, 255 - value);
+    }
+  }
+  int exact = jobLuminance(frame, 1);
+  for (int sample_step = 2; sample_step <= 8; sample_step++) {
+    ASSERT_NEAR(exact, jobLuminance(frame, sample_step), 1) << "step = " << sample_step;
+  }
+}
+
+// Approximate mode on uniform noise: error must not exceed 3.
+TEST(frameJob, sampledNoiseError) {
+  cv::Mat frame(360, 640, CV_8UC3);
+  cv::randu(frame, cv::Scalar(0, 0, 0), cv::Scalar(256, 256, 256));
+  int exact = jobLuminance(frame, 1);
+  for (int sample_step = 2; sample_step <= 8; sample_step++) {
+    ASSERT_NEAR(exact, jobLuminance(frame, sample_step), 3) << "step = " << sample_step;
+  }
+}
+
+// Pattern repeating exactly every sample_step pixels is the worst case. Only white pixels are sampled.
+TEST(frameJob, sampledAliasingWorstCase) {
+  cv::Mat frame(64, 64, CV_8UC3, cv::Scalar(0, 0, 0));
+  for (int i = 0; i < frame.rows; i += 4) {
+    for (int j = 0; j < frame.cols; j += 4) {
+      frame.at<cv::Vec3b>(i, j) = cv::Vec3b(255, 255, 255);
+    }
+  }
+  ASSERT_EQ(255 / 16, jobLuminance(frame, 1));
+  ASSERT_EQ(255, jobLuminance(frame, 4));
+}
+
+// I420 frame delivered as single channel image. Only Y plane should be counted.
+TEST(frameJob, yPlaneJobIgnoresChroma) {
+  std::shared_ptr<CalcLumFileCtx> f = std::make_shared<CalcLumFileCtx>("test");
+  CalcLumYPlaneFrameJob job;
+  job.setFileCtx(f);
+  job.setLumaRows(48);
+  cv::Mat& frame = job.getFrame();
+  frame.create(48 * 3 / 2, 64, CV_8UC1);
+  frame.setTo(cv::Scalar(200));
+  frame(cv::Rect(0, 0, 64, 48)).setTo(cv::Scalar(100));
+
+  job.processJob();
+  f->setEOF();
+  ASSERT_EQ(100, f->getMinLuminance());
+}
+
+// When decoder delivers BGR frame anyway, the result must be the same as for BGR job
+TEST(frameJob, yPlaneJobFallsBackToBGR) {
+  std::shared_ptr<CalcLumFileCtx> f = std::make_shared<CalcLumFileCtx>("test");
+  CalcLumYPlaneFrameJob job;
+  job.setFileCtx(f);
+  job.setLumaRows(10);
+  job.getFrame().create(10, 10, CV_8UC3);
+  job.getFrame().setTo(cv::Scalar(255, 255, 255));
+
+  job.processJob();
+  f->setEOF();
+  ASSERT_EQ(255, f->getMinLuminance());
+}
+
+// Batch job must give the same stats as processing frames one by one
+TEST(frameJob, batchJobMergesStats) {
+  std::shared_ptr<CalcLumFileCtx> f = std::make_shared<CalcLumFileCtx>("test");
+  CalcLumBatchJob batch;
+  batch.setFileCtx(f);
+  int values[] = {30, 10, 20, 10};
+  for (auto value : values) {
+    std::unique_ptr<CalcLumYPlaneFrameJob> job = std::make_unique<CalcLumYPlaneFrameJob>();
+    job->getFrame().create(4, 4, CV_8UC1);
+    job->getFrame().setTo(cv::Scalar(value));
+    batch.addFrameJob(std::move(job));
+    f->incFramesRead();
+  }
+
+  batch.processJob();
+  f->setEOF();
+  ASSERT_EQ(4, f->getFramesProcessed());
+  ASSERT_EQ(10, f->getMinLuminance());
+  ASSERT_EQ(30, f->getMaxLuminance());
+  ASSERT_EQ(17, f->getFileAverageLuminance());
+  ASSERT_EQ(15, f->getMedianLuminance());
+}
+
+// Y plane job with 4 pixels, one of them one unit brighter than the others.
+static std::unique_ptr<CalcLumYPlaneFrameJob> quarterJob(int value, bool exact) {
+  std::unique_ptr<CalcLumYPlaneFrameJob> job = std::make_unique<CalcLumYPlaneFrameJob>();
+  job->getFrame().create(2, 2, CV_8UC1);
+  job->getFrame().setTo(cv::Scalar(value));
+  job->getFrame().at<uint8_t>(1, 1) = value + 1;
+  job->setExact(exact);
+  return job;
+}
+
+TEST(frameJob, exactFrameLuminance) {
+  std::unique_ptr<CalcLumYPlaneFrameJob> job = quarterJob(10, true);
+  ASSERT_EQ(10.25 * (1 << kLumaFixedShift), job->calcFrameLuminanceFixed());
+  ASSERT_EQ(10, job->calcFrameLuminance());
+
+  // BGR frame: 1/3 of pixels white
+  CalcLumFrameJob bgr;
+  bgr.getFrame().create(1, 3, CV_8UC3);
+  bgr.getFrame().setTo(cv::Scalar(0, 0, 0));
+  bgr.getFrame().at<cv::Vec3b>(0, 0) = cv::Vec3b(255, 255, 255);
+  ASSERT_EQ((255u << kLumaFixedShift) / 3, bgr.calcFrameLuminanceFixed());
+  ASSERT_EQ(85, bgr.calcFrameLuminance());
+}
+
+// Drift smaller than one unit is visible in exact mode, whole results stay the same.
+TEST(frameJob, exactFileStats) {
+  std::shared_ptr<CalcLumFileCtx> f = std::make_shared<CalcLumFileCtx>("test");
+  f->setExact();
+  for (auto value : {20, 10, 30}) {
+    std::unique_ptr<CalcLumYPlaneFrameJob> job = quarterJob(value, true);
+    job->setFileCtx(f);
+    f->incFramesRead();
+    job->processJob();
+  }
+  f->setEOF();
+  ASSERT_EQ(20, f->getFileAverageLuminance());
+  ASSERT_EQ(10, f->getMinLuminance());
+  ASSERT_DOUBLE_EQ(20.25, f->getExactAverageLuminance());
+  ASSERT_DOUBLE_EQ(10.25, f->getExactMinLuminance());
+  ASSERT_DOUBLE_EQ(30.25, f->getExactMaxLuminance());
+  ASSERT_DOUBLE_EQ(20.25, f->getExactMedianLuminance());
+
+  // batch job gives the same stats
+  std::shared_ptr<CalcLumFileCtx> b = std::make_shared<CalcLumFileCtx>("test");
+  b->setExact();
+  CalcLumBatchJob batch;
+  batch.setFileCtx(b);
+  for (auto value : {20, 10, 30}) {
+    batch.addFrameJob(quarterJob(value, true));
+    b->incFramesRead();
+  }
+  batch.processJob();
+  b->setEOF();
+  CalcLumStats single = f->getStats(), batched = b->getStats();
+  ASSERT_EQ(single.luminance_fixed, batched.luminance_fixed);
+  ASSERT_EQ(single.min_fixed, batched.min_fixed);
+  ASSERT_EQ(single.max_fixed, batched.max_fixed);
+  ASSERT_EQ(single.fine_set, batched.fine_set);
+
+  // results of all files are not rounded either
+  std::shared_ptr<CalcLumFileCtx> g = std::make_shared<CalcLumFileCtx>("test2");
+  g->setExact();
+  std::unique_ptr<CalcLumYPlaneFrameJob> job = quarterJob(40, true);
+  job->setFileCtx(g);
+  g->incFramesRead();
+  job->processJob();
+  g->setEOF();
+  StatsAggregator aggr;
+  aggr.addFileCtx(f);
+  aggr.addFileCtx(g);
+  ASSERT_DOUBLE_EQ(25.25, aggr.calcExactMean());
+  ASSERT_DOUBLE_EQ(10.25, aggr.calcExactMin());
+  ASSERT_DOUBLE_EQ(40.25, aggr.calcExactMax());
+  // average of two middle frames
+  ASSERT_DOUBLE_EQ(25.25, aggr.calcExactMedian());
+}
+
+TEST(frameJob, fineMedian) {
+  std::vector<int> fine_set(kFineBinsNum, 0);
+  ASSERT_DOUBLE_EQ(0, CalcLumFileCtx::crunchFineMedian(fine_set));
+  fine_set[1] = 1;
+  ASSERT_DOUBLE_EQ(1.0 / 16, CalcLumFileCtx::crunchFineMedian(fine_set));
+  fine_set[17] = 1;
+  ASSERT_DOUBLE_EQ(0.5 + 1.0 / 16, CalcLumFileCtx::crunchFineMedian(fine_set));
+  fine_set[kFineBinsNum - 1] = 3;
+  ASSERT_DOUBLE_EQ(255 + 15.0 / 16, CalcLumFileCtx::crunchFineMedian(fine_set));
+}
+
+// Y plane job over a frame with value outside and inside rectangle picture.
+static std::unique_ptr<CalcLumYPlaneFrameJob> pictureJob(std::shared_ptr<CalcLumFileCtx> file_ctx, int outside,
+                                                         int inside, const CalcLumRect& picture) {
+  std::unique_ptr<CalcLumYPlaneFrameJob> job = std::make_unique<CalcLumYPlaneFrameJob>();
+  job->getFrame().create(72, 128, CV_8UC1);
+  job->getFrame().setTo(cv::Scalar(outside));
+  for (int i = picture.y; i < picture.y + picture.height; i++) {
+    for (int j = picture.x; j < picture.x + picture.width; j++) {
+      job->getFrame().at<uint8_t>(i, j) = inside;
+    }
+  }
+  job->setFileCtx(file_ctx);
+  return job;
+}
+
+// Only pixels of the rectangle are used, the region is kept in the file context.
+TEST(frameJob, roiRect) {
+  std::shared_ptr<CalcLumFileCtx> f = std::make_shared<CalcLumFileCtx>("test");
+  CalcLumRect rect(10, 20, 30, 40);
+  f->setRoiSpec(std::make_shared<const CalcLumRoiSpec>(CalcLumRoiSpec::fromRect(rect)));
+  ASSERT_EQ(nullptr, f->getRoi());
+  ASSERT_EQ(100, pictureJob(f, 0, 100, rect)->calcFrameLuminance());
+  ASSERT_EQ(rect, f->getRoi()->getRect());
+
+  // BGR frame
+  CalcLumFrameJob bgr;
+  bgr.getFrame().create(72, 128, CV_8UC3);
+  bgr.getFrame().setTo(cv::Scalar(255, 255, 255));
+  bgr.getFrame().at<cv::Vec3b>(20, 10) = cv::Vec3b(0, 0, 0);
+  bgr.setFileCtx(f);
+  ASSERT_EQ((255ull << kLumaFixedShift) * (30 * 40 - 1) / (30 * 40), bgr.calcFrameLuminanceFixed());
+
+  // without a region the whole frame is used
+  std::shared_ptr<CalcLumFileCtx> g = std::make_shared<CalcLumFileCtx>("test2");
+  ASSERT_EQ(200 * 30 * 40 / (72 * 128), pictureJob(g, 0, 200, rect)->calcFrameLuminance());
+  ASSERT_EQ(nullptr, g->getRoi());
+}
+
+TEST(frameJob, roiMask) {
+  // mask of the left half of the frame, except its top left pixel
+  std::vector<uint8_t> pixels(2 * 4, 0);
+  pixels[1] = pixels[4] = pixels[5] = 1;
+  std::shared_ptr<CalcLumFileCtx> f = std::make_shared<CalcLumFileCtx>("test");
+  f->setRoiSpec(std::make_shared<const CalcLumRoiSpec>(CalcLumRoiSpec::fromMask(2, 4, pixels)));
+  std::unique_ptr<CalcLumYPlaneFrameJob> job = std::make_unique<CalcLumYPlaneFrameJob>();
+  job->getFrame().create(2, 4, CV_8UC1);
+  job->getFrame().setTo(cv::Scalar(250));
+  job->getFrame().at<uint8_t>(0, 1) = 10;
+  job->getFrame().at<uint8_t>(1, 0) = 20;
+  job->getFrame().at<uint8_t>(1, 1) = 30;
+  job->setFileCtx(f);
+  ASSERT_EQ(20 << kLumaFixedShift, job->calcFrameLuminanceFixed());
+  ASSERT_TRUE(f->getRoi()->isMasked());
+}
+
+/*
+  Bars are detected by the reader in the first frame bright enough, before any frame of the file is processed.
+  Dark frames before it use the same region as all other frames of the file.
+*/
+TEST(frameJob, roiLetterboxDetectedOnce) {
+  std::shared_ptr<CalcLumFileCtx> f = std::make_shared<CalcLumFileCtx>("test");
+  f->setRoiSpec(std::make_shared<const CalcLumRoiSpec>(CalcLumRoiSpec::letterbox()));
+  CalcLumRect picture(0, 12, 128, 48);
+  std::vector<std::unique_ptr<CalcLumYPlaneFrameJob> > jobs;
+  jobs.push_back(pictureJob(f, 16, 20, picture));
+  jobs.push_back(pictureJob(f, 0, 10, picture));
+  jobs.push_back(pictureJob(f, 16, 100, picture));
+  jobs.push_back(pictureJob(f, 50, 180, picture));
+  ASSERT_FALSE(f->detectLetterbox(*jobs[0]));
+  ASSERT_FALSE(f->detectLetterbox(*jobs[1]));
+  ASSERT_EQ(nullptr, f->getRoi());
+  ASSERT_TRUE(f->detectLetterbox(*jobs[2]));
+  ASSERT_EQ(picture, f->getRoi()->getRect());
+  // a frame of the same file without bars is not detected again
+  ASSERT_TRUE(f->detectLetterbox(*jobs[3]));
+  ASSERT_EQ(picture, f->getRoi()->getRect());
+
+  // dark frames read before the bars were found use the picture too, not (16 * 24 + 20 * 48) / 72
+  ASSERT_EQ(20, jobs[0]->calcFrameLuminance());
+  ASSERT_EQ(10, jobs[1]->calcFrameLuminance());
+  ASSERT_EQ(100, jobs[2]->calcFrameLuminance());
+  ASSERT_EQ(180, jobs[3]->calcFrameLuminance());
+
+  // when the bars cannot be told in any frame tried, whole frames are used
+  std::shared_ptr<CalcLumFileCtx> g = std::make_shared<CalcLumFileCtx>("test2");
+  g->setRoiSpec(std::make_shared<const CalcLumRoiSpec>(CalcLumRoiSpec::letterbox()));
+  for (auto frame = 0; frame < kLetterboxAttempts - 1; frame++) {
+    ASSERT_FALSE(g->detectLetterbox(*pictureJob(g, 0, 0, picture)));
+  }
+  ASSERT_TRUE(g->detectLetterbox(*pictureJob(g, 0, 0, picture)));
+  ASSERT_EQ(CalcLumRect(0, 0, 128, 72), g->getRoi()->getRect());
+
+  // file with fewer frames than attempts, all of them dark
+  std::shared_ptr<CalcLumFileCtx> h = std::make_shared<CalcLumFileCtx>("test3");
+  h->setRoiSpec(std::make_shared<const CalcLumRoiSpec>(CalcLumRoiSpec::letterbox()));
+  std::unique_ptr<CalcLumYPlaneFrameJob> dark = pictureJob(h, 16, 20, picture);
+  ASSERT_FALSE(h->detectLetterbox(*dark));
+  h->finishLetterbox();
+  ASSERT_EQ(CalcLumRect(0, 0, 128, 72), h->getRoi()->getRect());
+  ASSERT_EQ(18, dark->calcFrameLuminance());
+
+  // no frame tried, nothing is set
+  std::shared_ptr<CalcLumFileCtx> e = std::make_shared<CalcLumFileCtx>("test4");
+  e->setRoiSpec(std::make_shared<const CalcLumRoiSpec>(CalcLumRoiSpec::letterbox()));
+  e->finishLetterbox();
+  ASSERT_EQ(nullptr, e->getRoi());
+}
+
+TEST(framePool, bufferIsReused) {
+  std::shared_ptr<CalcLumFramePool> pool = std::make_shared<CalcLumFramePool>(2);
+  uint8_t* data;
+  {
+    CalcLumFrameJob job;
+    job.setFramePool(pool);
+    job.getFrame().create(1080, 1920, CV_8UC3);
+    data = job.getFrame().data;
+  }
+  // the job returned its buffer, the next job gets the same memory
+  CalcLumFrameJob job;
+  job.setFramePool(pool);
+  job.getFrame().create(1080, 1920, CV_8UC3);
+  ASSERT_EQ(data, job.getFrame().data);
+  ASSERT_EQ(1, pool->getCreatedNum());
+}
+
+TEST(framePool, acquirePendsWhenAllBuffersUsed) {
+  CalcLumFramePool pool(1);
+  cv::Mat frame = pool.acquire();
+
+  std::atomic<bool> acquired{false};
+  std::thread reader([&pool, &acquired]{ cv::Mat second = pool.acquire(); acquired = true; });
+  sleep(1);
+  ASSERT_FALSE(acquired);
+
+  pool.release(frame);
+  reader.join();
+  ASSERT_TRUE(acquired);
+  ASSERT_EQ(1, pool.getCreatedNum());
+}
+
+// Buffers held by an abandoned reader never come back in time, the pool grows instead.
+TEST(framePool, growWakesWaitingReader) {
+  CalcLumFramePool pool(1);
+  cv::Mat held = pool.acquire();
+
+  std::atomic<bool> acquired{false};
+  std::thread reader([&pool, &acquired]{ cv::Mat frame = pool.acquire(); acquired = true; });
+  sleep(1);
+  ASSERT_FALSE(acquired);
+
+  pool.grow(1);
+  reader.join();
+  ASSERT_TRUE(acquired);
+  ASSERT_EQ(2, pool.getCapacity());
+  ASSERT_EQ(2, pool.getCreatedNum());
+}
+
+// Buffers allowed by grow are freed after shrink, so the pool is back to its capacity.
+TEST(framePool, shrinkFreesExtraBuffers) {
+  CalcLumFramePool pool(1);
+  pool.grow(2);
+  cv::Mat a = pool.acquire();
+  a.create(2, 2, CV_8UC1);
+  cv::Mat b = pool.acquire();
+  cv::Mat c = pool.acquire();
+  pool.release(std::move(c));
+  ASSERT_EQ(3, pool.getCreatedNum());
+
+  pool.shrink(2);
+  ASSERT_EQ(1, pool.getCapacity());
+  // the free buffer is freed at once, the others when they are released
+  ASSERT_EQ(2, pool.getCreatedNum());
+  pool.release(std::move(b));
+  ASSERT_EQ(1, pool.getCreatedNum());
+  uint8_t* data = a.data;
+  pool.release(std::move(a));
+  ASSERT_EQ(1, pool.getCreatedNum());
+  ASSERT_EQ(data, pool.acquire().data);
+}
+
 int main(int argc, char **argv) {
  ::testing::InitGoogleTest(&argc, argv);
  return RUN_ALL_TESTS();
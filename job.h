@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 
 /* 
   Basic abstract class representing a job handled and processed by scheduler.
@@ -8,5 +9,12 @@ class CalcLumJob {
 public:
   virtual void processJob() = 0;
   virtual ~CalcLumJob() {}
+
+  // Time when the job was added to the scheduler. It is set only when profiling.
+  void setQueuedAt(uint64_t queued_at) { queued_at_ = queued_at; }
+  uint64_t getQueuedAt() const { return queued_at_; }
+
+private:
+  uint64_t queued_at_{0};
 };
 
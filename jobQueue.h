@@ -0,0 +1,104 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+/*
+  Bounded multi-producer multi-consumer queue which does not use locks.
+  It is a ring buffer of cells allocated once, so adding an item does not allocate memory.
+  Each cell has a sequence number telling whether the cell is ready to be written
+  (sequence == position) or read (sequence == position + 1). Producers and consumers
+  claim positions with compare-and-swap on enqueue_pos_ and dequeue_pos_.
+
+  The queue itself never blocks: push returns false when the queue is full and pop
+  returns false when it is empty. Both may also return false for a very short moment
+  when another thread claimed a neighbouring cell and has not finished copying the item.
+  Blocking and waking threads up is done by the scheduler.
+*/
+template <typename T>
+class CalcLumJobQueue {
+public:
+  CalcLumJobQueue() = delete;
+  explicit CalcLumJobQueue(size_t capacity) : capacity_(capacity), cells_(new Cell[capacity]) {
+    for (size_t i = 0; i < capacity_; i++) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // Moves item into the queue. Item is not touched when the queue is full.
+  bool push(T& item) {
+    Cell* cell;
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos % capacity_];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (0 == diff) {
+        // cell is free, try to claim the position
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // cell still holds an item from the previous round: the queue is full
+        return false;
+      } else {
+        // another producer claimed this position
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->data = std::move(item);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T& item) {
+    Cell* cell;
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos % capacity_];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (0 == diff) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // nothing written to this cell yet: the queue is empty
+        return false;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    item = std::move(cell->data);
+    // cell can be written again in the next round
+    cell->sequence.store(pos + capacity_, std::memory_order_release);
+    return true;
+  }
+
+  // Number of items in the queue. It is exact only when no other thread uses the queue.
+  size_t size() const {
+    size_t enqueued = enqueue_pos_.load(std::memory_order_acquire);
+    size_t dequeued = dequeue_pos_.load(std::memory_order_acquire);
+    return (enqueued > dequeued) ? (enqueued - dequeued) : 0;
+  }
+
+  size_t capacity() const { return capacity_; }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+  const size_t capacity_;
+  std::unique_ptr<Cell[]> cells_;
+
+  // Producers and consumers update different positions. Keep them in separate
+  // cache lines, so they do not invalidate each other's cache.
+  char pad0_[64];
+  std::atomic<size_t> enqueue_pos_{0};
+  char pad1_[64];
+  std::atomic<size_t> dequeue_pos_{0};
+  char pad2_[64];
+};
@@ -0,0 +1,588 @@
+#include "lumaKernel.h"
+#include <cstring>
+
+#if defined(__x86_64__)
+#define CALCLUM_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+  Plain C++ version of the kernel. It is used on non-x86 platforms and to finish
+  pixels at the end of a row which do not fill the whole SIMD register.
+*/
+static inline unsigned long long sumLumaRowScalar(const uint8_t* row, int from, int cols) {
+  unsigned long long sum = 0;
+  for (int j = from; j < cols; j++) {
+    sum += lumaOfBGR(row + j * 3);
+  }
+  return sum;
+}
+
+unsigned long long sumLumaBGRScalar(const uint8_t* data, int rows, int cols, size_t step) {
+  unsigned long long sum = 0;
+  for (int i = 0; i < rows; i++) {
+    sum += sumLumaRowScalar(data + i * step, 0, cols);
+  }
+  return sum;
+}
+
+unsigned long long sumLumaPlaneScalar(const uint8_t* data, int rows, int cols, size_t step) {
+  unsigned long long sum = 0;
+  for (int i = 0; i < rows; i++) {
+    const uint8_t* row = data + i * step;
+    for (int j = 0; j < cols; j++) {
+      sum += row[j];
+    }
+  }
+  return sum;
+}
+
+/*
+  Sampled scalar versions. They also finish sampled pixels at the end of a row for SIMD versions.
+*/
+static inline unsigned long long sumLumaRowSampledScalar(const uint8_t* row, int from, int cols, int sample_step) {
+  unsigned long long sum = 0;
+  for (int j = from; j < cols; j += sample_step) {
+    sum += lumaOfBGR(row + j * 3);
+  }
+  return sum;
+}
+
+unsigned long long sumLumaBGRSampledScalar(const uint8_t* data, int rows, int cols, size_t step, int sample_step) {
+  unsigned long long sum = 0;
+  for (int i = 0; i < rows; i += sample_step) {
+    sum += sumLumaRowSampledScalar(data + i * step, 0, cols, sample_step);
+  }
+  return sum;
+}
+
+unsigned long long sumLumaPlaneSampledScalar(const uint8_t* data, int rows, int cols, size_t step, int sample_step) {
+  unsigned long long sum = 0;
+  for (int i = 0; i < rows; i += sample_step) {
+    const uint8_t* row = data + i * step;
+    for (int j = 0; j < cols; j += sample_step) {
+      sum += row[j];
+    }
+  }
+  return sum;
+}
+
+void addHistogramScalar(int* dst, const int* src, int bins) {
+  for (int i = 0; i < bins; i++) {
+    dst[i] += src[i];
+  }
+}
+
+void addHistogramWideScalar(long long* dst, const int* src, int bins) {
+  for (int i = 0; i < bins; i++) {
+    dst[i] += src[i];
+  }
+}
+
+#ifdef CALCLUM_X86
+/*
+  SSE2 version. SSE2 does not have byte shuffle, so 4 pixels (12 bytes) are loaded
+  at once and pixels are moved into separate 32-bit lanes by byte shifts.
+  Each lane then holds B G R and one byte of the next pixel. The extra byte is multiplied
+  by zero coefficient.
+  Per-row partial sums are kept in 32-bit lanes. Each lane grows by at most 255
+  per iteration, so it cannot overflow for any realistic frame width.
+*/
+unsigned long long sumLumaBGRSSE2(const uint8_t* data, int rows, int cols, size_t step) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i coef = _mm_setr_epi16(kLumaB, kLumaG, kLumaR, 0, kLumaB, kLumaG, kLumaR, 0);
+  const __m128i round = _mm_set1_epi32(1 << (kLumaShift - 1));
+  unsigned long long sum = 0;
+
+  for (int i = 0; i < rows; i++) {
+    const uint8_t* row = data + i * step;
+    __m128i acc = zero;
+    int j = 0;
+    // 16 bytes are loaded, but only 12 are used. Make sure we do not read past the row.
+    for (; j + 6 <= cols; j += 4) {
+      __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + j * 3));
+      __m128i p01 = _mm_unpacklo_epi32(v0, _mm_srli_si128(v0, 3));
+      __m128i p23 = _mm_unpacklo_epi32(_mm_srli_si128(v0, 6), _mm_srli_si128(v0, 9));
+      __m128i pixels = _mm_unpacklo_epi64(p01, p23);
+
+      // B*kLumaB + G*kLumaG in even lanes, R*kLumaR in odd lanes.
+      __m128i m01 = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), coef);
+      __m128i m23 = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), coef);
+      __m128i even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(m01), _mm_castsi128_ps(m23),
+                                                     _MM_SHUFFLE(2, 0, 2, 0)));
+      __m128i odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(m01), _mm_castsi128_ps(m23),
+                                                    _MM_SHUFFLE(3, 1, 3, 1)));
+      __m128i y = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(even, odd), round), kLumaShift);
+      acc = _mm_add_epi32(acc, y);
+    }
+    // add 4 lanes together
+    acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 8));
+    acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 4));
+    sum += static_cast<uint32_t>(_mm_cvtsi128_si32(acc));
+    sum += sumLumaRowScalar(row, j, cols);
+  }
+  return sum;
+}
+
+/*
+  AVX2 version. 8 pixels are processed in one iteration. 4 pixels are placed in each
+  128-bit lane and expanded to 16-bit values by byte shuffle.
+*/
+__attribute__((target("avx2")))
+unsigned long long sumLumaBGRAVX2(const uint8_t* data, int rows, int cols, size_t step) {
+  const __m256i coef = _mm256_setr_epi16(kLumaB, kLumaG, kLumaR, 0, kLumaB, kLumaG, kLumaR, 0,
+                                         kLumaB, kLumaG, kLumaR, 0, kLumaB, kLumaG, kLumaR, 0);
+  const __m256i round = _mm256_set1_epi32(1 << (kLumaShift - 1));
+  // pixels 0 and 1 of each lane as 16-bit B G R 0
+  const __m256i shuf_lo = _mm256_setr_epi8(0, -1, 1, -1, 2, -1, -1, -1, 3, -1, 4, -1, 5, -1, -1, -1,
+                                           0, -1, 1, -1, 2, -1, -1, -1, 3, -1, 4, -1, 5, -1, -1, -1);
+  // pixels 2 and 3 of each lane
+  const __m256i shuf_hi = _mm256_setr_epi8(6, -1, 7, -1, 8, -1, -1, -1, 9, -1, 10, -1, 11, -1, -1, -1,
+                                           6, -1, 7, -1, 8, -1, -1, -1, 9, -1, 10, -1, 11, -1, -1, -1);
+  unsigned long long sum = 0;
+
+  for (int i = 0; i < rows; i++) {
+    const uint8_t* row = data + i * step;
+    __m256i acc = _mm256_setzero_si256();
+    int j = 0;
+    // The second 16-byte load starts at pixel 4 and ends 4 bytes after pixel 7.
+    for (; j + 10 <= cols; j += 8) {
+      const uint8_t* p = row + j * 3;
+      __m256i v = _mm256_inserti128_si256(
+          _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))),
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 12)), 1);
+      __m256i m01 = _mm256_madd_epi16(_mm256_shuffle_epi8(v, shuf_lo), coef);
+      __m256i m23 = _mm256_madd_epi16(_mm256_shuffle_epi8(v, shuf_hi), coef);
+      __m256i y = _mm256_srli_epi32(_mm256_add_epi32(_mm256_hadd_epi32(m01, m23), round), kLumaShift);
+      acc = _mm256_add_epi32(acc, y);
+    }
+    __m128i acc128 = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    acc128 = _mm_add_epi32(acc128, _mm_srli_si128(acc128, 8));
+    acc128 = _mm_add_epi32(acc128, _mm_srli_si128(acc128, 4));
+    sum += static_cast<uint32_t>(_mm_cvtsi128_si32(acc128));
+    sum += sumLumaRowScalar(row, j, cols);
+  }
+  return sum;
+}
+
+/*
+  Plane versions use "sum of absolute differences" instruction against zero.
+  It adds 8 bytes into one 64-bit lane in a single step.
+*/
+unsigned long long sumLumaPlaneSSE2(const uint8_t* data, int rows, int cols, size_t step) {
+  const __m128i zero = _mm_setzero_si128();
+  unsigned long long sum = 0;
+
+  for (int i = 0; i < rows; i++) {
+    const uint8_t* row = data + i * step;
+    __m128i acc = zero;
+    int j = 0;
+    for (; j + 16 <= cols; j += 16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + j));
+      acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+    }
+    acc = _mm_add_epi64(acc, _mm_srli_si128(acc, 8));
+    sum += static_cast<unsigned long long>(_mm_cvtsi128_si64(acc));
+    for (; j < cols; j++) {
+      sum += row[j];
+    }
+  }
+  return sum;
+}
+
+__attribute__((target("avx2")))
+unsigned long long sumLumaPlaneAVX2(const uint8_t* data, int rows, int cols, size_t step) {
+  const __m256i zero = _mm256_setzero_si256();
+  unsigned long long sum = 0;
+
+  for (int i = 0; i < rows; i++) {
+    const uint8_t* row = data + i * step;
+    __m256i acc = zero;
+    int j = 0;
+    for (; j + 32 <= cols; j += 32) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + j));
+      acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, zero));
+    }
+    __m128i acc128 = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    acc128 = _mm_add_epi64(acc128, _mm_srli_si128(acc128, 8));
+    sum += static_cast<unsigned long long>(_mm_cvtsi128_si64(acc128));
+    for (; j < cols; j++) {
+      sum += row[j];
+    }
+  }
+  return sum;
+}
+
+/*
+  Fills masks for sampled plane kernels. Bytes of a row at every sample_step-th position are 0xff, others 0.
+  The pattern repeats every sample_step registers, mask k is used for the k-th register of each period.
+*/
+static void fillSampleMasks(uint8_t* masks, int width, int sample_step) {
+  for (int k = 0; k < width * sample_step; k++) {
+    masks[k] = (0 == k % sample_step) ? 0xff : 0;
+  }
+}
+
+/*
+  SSE2 has no gather. A sampled plane row is read as by sumLumaPlaneSSE2 and bytes which are not sampled
+  are masked out. Sampled rows are read whole anyway, since every cache line of them is touched for
+  small steps. Larger steps and BGR frames use the scalar versions.
+*/
+unsigned long long sumLumaPlaneSampledSSE2(const uint8_t* data, int rows, int cols, size_t step, int sample_step) {
+  if (16 < sample_step) {
+    return sumLumaPlaneSampledScalar(data, rows, cols, step, sample_step);
+  }
+  alignas(16) uint8_t masks[16 * 16];
+  fillSampleMasks(masks, 16, sample_step);
+  const __m128i zero = _mm_setzero_si128();
+  unsigned long long sum = 0;
+  for (int i = 0; i < rows; i += sample_step) {
+    const uint8_t* row = data + i * step;
+    __m128i acc = zero;
+    int j = 0;
+    for (int k = 0; j + 16 <= cols; j += 16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + j));
+      __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i*>(masks + k * 16));
+      acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_and_si128(v, mask), zero));
+      k = (k + 1 == sample_step) ? 0 : k + 1;
+    }
+    acc = _mm_add_epi64(acc, _mm_srli_si128(acc, 8));
+    sum += static_cast<unsigned long long>(_mm_cvtsi128_si64(acc));
+    // the first sampled byte left
+    for (j = (j + sample_step - 1) / sample_step * sample_step; j < cols; j += sample_step) {
+      sum += row[j];
+    }
+  }
+  return sum;
+}
+
+/*
+  Sampled AVX2 versions. Sampled pixels are not adjacent, so 8 of them are loaded by one gather,
+  each one as a 32-bit lane. A lane of a BGR frame holds B G R and a byte of the next pixel:
+  B and R are multiplied as 16-bit values by one madd, G by another one. Every lane is loaded
+  as 4 bytes, so pixels whose load would pass the end of the row are left to the scalar loop.
+  Plane rows are rather read whole and masked as by sumLumaPlaneSampledSSE2, it is faster than the gather
+  up to sample_step 32.
+*/
+__attribute__((target("avx2")))
+static inline unsigned long long sumLanes(__m256i acc) {
+  __m128i acc128 = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+  acc128 = _mm_add_epi32(acc128, _mm_srli_si128(acc128, 8));
+  acc128 = _mm_add_epi32(acc128, _mm_srli_si128(acc128, 4));
+  return static_cast<uint32_t>(_mm_cvtsi128_si32(acc128));
+}
+
+__attribute__((target("avx2")))
+unsigned long long sumLumaBGRSampledAVX2(const uint8_t* data, int rows, int cols, size_t step, int sample_step) {
+  const __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                             _mm256_set1_epi32(sample_step * 3));
+  // B in the low half of each lane, R in the high half
+  const __m256i coef_br = _mm256_set1_epi32(kLumaB | (kLumaR << 16));
+  const __m256i coef_g = _mm256_set1_epi32(kLumaG);
+  const __m256i br_bytes = _mm256_set1_epi32(0x00ff00ff);
+  const __m256i g_byte = _mm256_set1_epi32(0xff);
+  const __m256i round = _mm256_set1_epi32(1 << (kLumaShift - 1));
+  // the last pixel of a gather is at 7 * sample_step, its 4 bytes must be inside the row
+  const int last = 7 * sample_step + 1;
+  unsigned long long sum = 0;
+  for (int i = 0; i < rows; i += sample_step) {
+    const uint8_t* row = data + i * step;
+    __m256i acc = _mm256_setzero_si256();
+    int j = 0;
+    for (; j + last < cols; j += 8 * sample_step) {
+      __m256i v = _mm256_i32gather_epi32(reinterpret_cast<const int*>(row + j * 3), offsets, 1);
+      __m256i br = _mm256_madd_epi16(_mm256_and_si256(v, br_bytes), coef_br);
+      __m256i g = _mm256_madd_epi16(_mm256_and_si256(_mm256_srli_epi32(v, 8), g_byte), coef_g);
+      acc = _mm256_add_epi32(acc, _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(br, g), round), kLumaShift));
+    }
+    sum += sumLanes(acc);
+    sum += sumLumaRowSampledScalar(row, j, cols, sample_step);
+  }
+  return sum;
+}
+
+__attribute__((target("avx2")))
+unsigned long long sumLumaPlaneSampledAVX2(const uint8_t* data, int rows, int cols, size_t step, int sample_step) {
+  unsigned long long sum = 0;
+  if (32 >= sample_step) {
+    alignas(32) uint8_t masks[32 * 32];
+    fillSampleMasks(masks, 32, sample_step);
+    const __m256i zero = _mm256_setzero_si256();
+    for (int i = 0; i < rows; i += sample_step) {
+      const uint8_t* row = data + i * step;
+      __m256i acc = zero;
+      int j = 0;
+      for (int k = 0; j + 32 <= cols; j += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + j));
+        __m256i mask = _mm256_load_si256(reinterpret_cast<const __m256i*>(masks + k * 32));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_and_si256(v, mask), zero));
+        k = (k + 1 == sample_step) ? 0 : k + 1;
+      }
+      __m128i acc128 = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+      acc128 = _mm_add_epi64(acc128, _mm_srli_si128(acc128, 8));
+      sum += static_cast<unsigned long long>(_mm_cvtsi128_si64(acc128));
+      for (j = (j + sample_step - 1) / sample_step * sample_step; j < cols; j += sample_step) {
+        sum += row[j];
+      }
+    }
+    return sum;
+  }
+
+  const __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                             _mm256_set1_epi32(sample_step));
+  const __m256i low_byte = _mm256_set1_epi32(0xff);
+  const int last = 7 * sample_step + 3;
+  for (int i = 0; i < rows; i += sample_step) {
+    const uint8_t* row = data + i * step;
+    __m256i acc = _mm256_setzero_si256();
+    int j = 0;
+    for (; j + last < cols; j += 8 * sample_step) {
+      __m256i v = _mm256_i32gather_epi32(reinterpret_cast<const int*>(row + j), offsets, 1);
+      acc = _mm256_add_epi32(acc, _mm256_and_si256(v, low_byte));
+    }
+    sum += sumLanes(acc);
+    for (; j < cols; j += sample_step) {
+      sum += row[j];
+    }
+  }
+  return sum;
+}
+
+/*
+  Histogram versions add 4 or 8 bins at once. Bins past the last full register are added one by one.
+*/
+void addHistogramSSE2(int* dst, const int* src, int bins) {
+  int i = 0;
+  for (; i + 4 <= bins; i += 4) {
+    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_add_epi32(d, v));
+  }
+  addHistogramScalar(dst + i, src + i, bins - i);
+}
+
+__attribute__((target("avx2")))
+void addHistogramAVX2(int* dst, const int* src, int bins) {
+  int i = 0;
+  for (; i + 8 <= bins; i += 8) {
+    __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_add_epi32(d, v));
+  }
+  addHistogramScalar(dst + i, src + i, bins - i);
+}
+
+/*
+  Wide versions. Counts are not negative, so they are extended to 64 bits by interleaving with zeros.
+*/
+void addHistogramWideSSE2(long long* dst, const int* src, int bins) {
+  const __m128i zero = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 4 <= bins; i += 4) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m128i* d = reinterpret_cast<__m128i*>(dst + i);
+    _mm_storeu_si128(d, _mm_add_epi64(_mm_loadu_si128(d), _mm_unpacklo_epi32(v, zero)));
+    _mm_storeu_si128(d + 1, _mm_add_epi64(_mm_loadu_si128(d + 1), _mm_unpackhi_epi32(v, zero)));
+  }
+  addHistogramWideScalar(dst + i, src + i, bins - i);
+}
+
+__attribute__((target("avx2")))
+void addHistogramWideAVX2(long long* dst, const int* src, int bins) {
+  int i = 0;
+  for (; i + 8 <= bins; i += 8) {
+    __m256i lo = _mm256_cvtepu32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+    __m256i hi = _mm256_cvtepu32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 4)));
+    __m256i* d = reinterpret_cast<__m256i*>(dst + i);
+    _mm256_storeu_si256(d, _mm256_add_epi64(_mm256_loadu_si256(d), lo));
+    _mm256_storeu_si256(d + 1, _mm256_add_epi64(_mm256_loadu_si256(d + 1), hi));
+  }
+  addHistogramWideScalar(dst + i, src + i, bins - i);
+}
+
+bool lumaKernelHasSSE2() {
+  return __builtin_cpu_supports("sse2");
+}
+
+bool lumaKernelHasAVX2() {
+  return __builtin_cpu_supports("avx2");
+}
+#else
+unsigned long long sumLumaBGRSSE2(const uint8_t* data, int rows, int cols, size_t step) {
+  return sumLumaBGRScalar(data, rows, cols, step);
+}
+
+unsigned long long sumLumaBGRAVX2(const uint8_t* data, int rows, int cols, size_t step) {
+  return sumLumaBGRScalar(data, rows, cols, step);
+}
+
+unsigned long long sumLumaPlaneSSE2(const uint8_t* data, int rows, int cols, size_t step) {
+  return sumLumaPlaneScalar(data, rows, cols, step);
+}
+
+unsigned long long sumLumaPlaneAVX2(const uint8_t* data, int rows, int cols, size_t step) {
+  return sumLumaPlaneScalar(data, rows, cols, step);
+}
+
+unsigned long long sumLumaPlaneSampledSSE2(const uint8_t* data, int rows, int cols, size_t step, int sample_step) {
+  return sumLumaPlaneSampledScalar(data, rows, cols, step, sample_step);
+}
+
+unsigned long long sumLumaBGRSampledAVX2(const uint8_t* data, int rows, int cols, size_t step, int sample_step) {
+  return sumLumaBGRSampledScalar(data, rows, cols, step, sample_step);
+}
+
+unsigned long long sumLumaPlaneSampledAVX2(const uint8_t* data, int rows, int cols, size_t step, int sample_step) {
+  return sumLumaPlaneSampledScalar(data, rows, cols, step, sample_step);
+}
+
+void addHistogramSSE2(int* dst, const int* src, int bins) {
+  addHistogramScalar(dst, src, bins);
+}
+
+void addHistogramAVX2(int* dst, const int* src, int bins) {
+  addHistogramScalar(dst, src, bins);
+}
+
+void addHistogramWideSSE2(long long* dst, const int* src, int bins) {
+  addHistogramWideScalar(dst, src, bins);
+}
+
+void addHistogramWideAVX2(long long* dst, const int* src, int bins) {
+  addHistogramWideScalar(dst, src, bins);
+}
+
+bool lumaKernelHasSSE2() {
+  return false;
+}
+
+bool lumaKernelHasAVX2() {
+  return false;
+}
+#endif
+
+typedef unsigned long long (*SumLumaFunc)(const uint8_t*, int, int, size_t);
+typedef unsigned long long (*SumLumaSampledFunc)(const uint8_t*, int, int, size_t, int);
+typedef void (*AddHistogramFunc)(int*, const int*, int);
+typedef void (*AddHistogramWideFunc)(long long*, const int*, int);
+
+struct LumaKernels {
+  SumLumaFunc bgr;
+  SumLumaFunc plane;
+  SumLumaSampledFunc bgr_sampled;
+  SumLumaSampledFunc plane_sampled;
+  AddHistogramFunc histogram;
+  AddHistogramWideFunc histogram_wide;
+  const char* name;
+};
+
+/*
+  Selects the best kernels for the CPU. It is done only once, when a kernel is used first time.
+*/
+static LumaKernels selectKernels() {
+  if (lumaKernelHasAVX2()) {
+    return {sumLumaBGRAVX2, sumLumaPlaneAVX2, sumLumaBGRSampledAVX2, sumLumaPlaneSampledAVX2,
+            addHistogramAVX2, addHistogramWideAVX2, "avx2"};
+  }
+  if (lumaKernelHasSSE2()) {
+    return {sumLumaBGRSSE2, sumLumaPlaneSSE2, sumLumaBGRSampledScalar, sumLumaPlaneSampledSSE2,
+            addHistogramSSE2, addHistogramWideSSE2, "sse2"};
+  }
+  return {sumLumaBGRScalar, sumLumaPlaneScalar, sumLumaBGRSampledScalar, sumLumaPlaneSampledScalar,
+          addHistogramScalar, addHistogramWideScalar, "scalar"};
+}
+
+static const LumaKernels& getKernels() {
+  static const LumaKernels kernels = selectKernels();
+  return kernels;
+}
+
+unsigned long long sumLumaBGR(const uint8_t* data, int rows, int cols, size_t step) {
+  return getKernels().bgr(data, rows, cols, step);
+}
+
+unsigned long long sumLumaPlane(const uint8_t* data, int rows, int cols, size_t step) {
+  return getKernels().plane(data, rows, cols, step);
+}
+
+void addHistogram(int* dst, const int* src, int bins) {
+  getKernels().histogram(dst, src, bins);
+}
+
+void addHistogramWide(long long* dst, const int* src, int bins) {
+  getKernels().histogram_wide(dst, src, bins);
+}
+
+const char* lumaKernelName() {
+  return getKernels().name;
+}
+
+unsigned long long sumLumaBGRSampled(const uint8_t* data, int rows, int cols, size_t step, int sample_step) {
+  if (sample_step <= 1) {
+    return sumLumaBGR(data, rows, cols, step);
+  }
+  return getKernels().bgr_sampled(data, rows, cols, step, sample_step);
+}
+
+unsigned long long sumLumaPlaneSampled(const uint8_t* data, int rows, int cols, size_t step, int sample_step) {
+  if (sample_step <= 1) {
+    return sumLumaPlane(data, rows, cols, step);
+  }
+  return getKernels().plane_sampled(data, rows, cols, step, sample_step);
+}
+
+/*
+  Masks mark shapes (e.g. everything but a logo), so a row of the mask has a few long runs of used pixels.
+  Without sampling the runs are found with memchr and each one is added by the fastest row kernel.
+  With sampling pixels are visited one by one. Mask bytes are 0 or 0xff, so a pixel is added as its value
+  AND its mask byte and counted as mask AND 1, without branches.
+  sum_run(row, cols) adds cols adjacent pixels, luma(row, j) returns luminance of j-th pixel of the row.
+*/
+template <typename SumRunFunc, typename LumaFunc>
+static unsigned long long sumLumaMasked(const uint8_t* data, int rows, int cols, size_t step,
+                                        const uint8_t* mask, size_t mask_step, int sample_step,
+                                        long long& samples, SumRunFunc sum_run, LumaFunc luma) {
+  unsigned long long sum = 0;
+  samples = 0;
+  for (int i = 0; i < rows; i += sample_step) {
+    const uint8_t* row = data + i * step;
+    const uint8_t* mask_row = mask + i * mask_step;
+    if (1 == sample_step) {
+      const uint8_t* run = static_cast<const uint8_t*>(std::memchr(mask_row, 0xff, cols));
+      while (nullptr != run) {
+        int begin = run - mask_row;
+        const uint8_t* run_end = static_cast<const uint8_t*>(std::memchr(run, 0, cols - begin));
+        int end = (nullptr != run_end) ? run_end - mask_row : cols;
+        sum += sum_run(row, begin, end - begin);
+        samples += end - begin;
+        run = (end < cols) ? static_cast<const uint8_t*>(std::memchr(run_end, 0xff, cols - end)) : nullptr;
+      }
+      continue;
+    }
+    unsigned int row_sum = 0;
+    int row_samples = 0;
+    for (int j = 0; j < cols; j += sample_step) {
+      row_sum += luma(row, j) & mask_row[j];
+      row_samples += mask_row[j] & 1;
+    }
+    sum += row_sum;
+    samples += row_samples;
+  }
+  return sum;
+}
+
+unsigned long long sumLumaBGRMasked(const uint8_t* data, int rows, int cols, size_t step,
+                                    const uint8_t* mask, size_t mask_step, int sample_step, long long& samples) {
+  const LumaKernels& kernels = getKernels();
+  return sumLumaMasked(data, rows, cols, step, mask, mask_step, (sample_step < 1) ? 1 : sample_step, samples,
+                       [&kernels](const uint8_t* row, int from, int run) { return kernels.bgr(row + from * 3, 1, run, 0); },
+                       [](const uint8_t* row, int j) { return lumaOfBGR(row + j * 3); });
+}
+
+unsigned long long sumLumaPlaneMasked(const uint8_t* data, int rows, int cols, size_t step,
+                                      const uint8_t* mask, size_t mask_step, int sample_step, long long& samples) {
+  const LumaKernels& kernels = getKernels();
+  return sumLumaMasked(data, rows, cols, step, mask, mask_step, (sample_step < 1) ? 1 : sample_step, samples,
+                       [&kernels](const uint8_t* row, int from, int run) { return kernels.plane(row + from, 1, run, 0); },
+                       [](const uint8_t* row, int j) { return static_cast<int>(row[j]); });
+}
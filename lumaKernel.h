@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+/*
+  Luma kernels. They calculate the sum of Y (luminance) values of all pixels in a frame
+  directly from interleaved BGR data, without converting the frame to YUV first.
+
+  Y of a pixel is calculated exactly the same way as OpenCV does it in cvtColor(CV_BGR2YUV)
+  for 8-bit images: fixed point coefficients with 14 bits of precision and rounding
+  to the closest integer. So the sum is identical to summing Y channel of cvtColor output.
+
+  When decoder delivers frames in native YUV format, luminance is just the Y plane and
+  sumLumaPlane adds all bytes of the plane.
+
+  There are several implementations of each kernel. The fastest one supported by the CPU
+  is selected at runtime by sumLumaBGR and sumLumaPlane. The others are exposed for unit tests.
+*/
+
+// Fixed point coefficients used by OpenCV for BGR->YUV conversion (yuv_shift is 14).
+const int kLumaShift = 14;
+const int kLumaB = 1868;
+const int kLumaG = 9617;
+const int kLumaR = 4899;
+
+// Y value of a single pixel.
+inline int lumaOfBGR(const uint8_t* pixel) {
+  return (pixel[0] * kLumaB + pixel[1] * kLumaG + pixel[2] * kLumaR + (1 << (kLumaShift - 1))) >> kLumaShift;
+}
+
+// data points to the first row of the frame. step is the number of bytes between rows.
+unsigned long long sumLumaBGR(const uint8_t* data, int rows, int cols, size_t step);
+
+unsigned long long sumLumaBGRScalar(const uint8_t* data, int rows, int cols, size_t step);
+unsigned long long sumLumaBGRSSE2(const uint8_t* data, int rows, int cols, size_t step);
+unsigned long long sumLumaBGRAVX2(const uint8_t* data, int rows, int cols, size_t step);
+
+// Sum of all bytes of single channel plane (e.g. Y plane of YUV420 frame).
+unsigned long long sumLumaPlane(const uint8_t* data, int rows, int cols, size_t step);
+
+unsigned long long sumLumaPlaneScalar(const uint8_t* data, int rows, int cols, size_t step);
+unsigned long long sumLumaPlaneSSE2(const uint8_t* data, int rows, int cols, size_t step);
+unsigned long long sumLumaPlaneAVX2(const uint8_t* data, int rows, int cols, size_t step);
+
+/*
+  Approximate versions. Only every sample_step-th pixel of every sample_step-th row is used,
+  starting from the first pixel of the frame. They return the sum of sampled values. Divide it by
+  lumaSamplesNum to get the average. With sample_step 1 they are the same as the exact kernels.
+  Only 1/sample_step^2 of pixels is added, but the cost does not fall as much: every cache line of
+  a sampled row is still read for small steps and sampled BGR pixels are gathered. Measured on 4K frames
+  with AVX2 (make bench), in parts of the time of the exact kernel: BGR 0.6 with sample_step 2 and 0.2 with 4,
+  Y plane 0.6 with 2 and 0.3 with 4.
+*/
+unsigned long long sumLumaBGRSampled(const uint8_t* data, int rows, int cols, size_t step, int sample_step);
+unsigned long long sumLumaPlaneSampled(const uint8_t* data, int rows, int cols, size_t step, int sample_step);
+
+unsigned long long sumLumaBGRSampledScalar(const uint8_t* data, int rows, int cols, size_t step, int sample_step);
+unsigned long long sumLumaBGRSampledAVX2(const uint8_t* data, int rows, int cols, size_t step, int sample_step);
+unsigned long long sumLumaPlaneSampledScalar(const uint8_t* data, int rows, int cols, size_t step, int sample_step);
+unsigned long long sumLumaPlaneSampledSSE2(const uint8_t* data, int rows, int cols, size_t step, int sample_step);
+unsigned long long sumLumaPlaneSampledAVX2(const uint8_t* data, int rows, int cols, size_t step, int sample_step);
+
+// Number of pixels used by the sampled kernels.
+inline long long lumaSamplesNum(int rows, int cols, int sample_step) {
+  return static_cast<long long>((rows + sample_step - 1) / sample_step) * ((cols + sample_step - 1) / sample_step);
+}
+
+/*
+  Masked versions used for a region of interest (see CalcLumRoi). mask has one byte per pixel and mask_step
+  bytes between rows. Each byte must be 0 (pixel is not used) or 0xff (pixel is used).
+  Pixels are sampled the same way as by the sampled kernels. samples receives the number of used pixels.
+  Without sampling, runs of used pixels are added by the kernels selected for the CPU.
+*/
+unsigned long long sumLumaBGRMasked(const uint8_t* data, int rows, int cols, size_t step,
+                                    const uint8_t* mask, size_t mask_step, int sample_step, long long& samples);
+unsigned long long sumLumaPlaneMasked(const uint8_t* data, int rows, int cols, size_t step,
+                                      const uint8_t* mask, size_t mask_step, int sample_step, long long& samples);
+
+// Adds histogram src to dst bin by bin. Used to merge luminance histograms of many files.
+void addHistogram(int* dst, const int* src, int bins);
+
+void addHistogramScalar(int* dst, const int* src, int bins);
+void addHistogramSSE2(int* dst, const int* src, int bins);
+void addHistogramAVX2(int* dst, const int* src, int bins);
+
+// Adds 32-bit histogram src to 64-bit histogram dst. Counts must not be negative.
+// Used to add histograms of files to totals of a run, which may exceed 2^31.
+void addHistogramWide(long long* dst, const int* src, int bins);
+
+void addHistogramWideScalar(long long* dst, const int* src, int bins);
+void addHistogramWideSSE2(long long* dst, const int* src, int bins);
+void addHistogramWideAVX2(long long* dst, const int* src, int bins);
+
+// Returns true when SSE2 or AVX2 version of the kernel can be used on this CPU.
+bool lumaKernelHasSSE2();
+bool lumaKernelHasAVX2();
+// Name of the kernels selected by sumLumaBGR and sumLumaPlane.
+const char* lumaKernelName();
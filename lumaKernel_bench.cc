@@ -0,0 +1,170 @@
+/*
+  Benchmarks of luma kernels at common frame sizes.
+  Each implementation is measured separately, so the gain of SIMD versions can be seen.
+  Run with: make bench
+*/
+#include <benchmark/benchmark.h>
+#include <vector>
+#include <random>
+#include "lumaKernel.h"
+
+typedef unsigned long long (*LumaKernel)(const uint8_t* data, int rows, int cols, size_t step);
+typedef unsigned long long (*LumaSampledKernel)(const uint8_t* data, int rows, int cols, size_t step, int sample_step);
+
+// SD, HD and 4K frames
+static const int kFrameSizes[][2] = {{720, 576}, {1920, 1080}, {3840, 2160}};
+
+static std::vector<uint8_t> randomFrame(size_t size) {
+  std::vector<uint8_t> frame(size);
+  std::mt19937 gen(1);
+  for (auto& byte : frame) {
+    byte = gen();
+  }
+  return frame;
+}
+
+/*
+  Arguments: index of frame size, number of channels of the frame.
+  Throughput is reported in pixels per second.
+*/
+static void runKernel(benchmark::State& state, LumaKernel kernel, bool needs_avx2) {
+  if (needs_avx2 && !lumaKernelHasAVX2()) {
+    state.SkipWithError("AVX2 not supported");
+    return;
+  }
+  int cols = kFrameSizes[state.range(0)][0];
+  int rows = kFrameSizes[state.range(0)][1];
+  int channels = state.range(1);
+  std::vector<uint8_t> frame = randomFrame(static_cast<size_t>(rows) * cols * channels);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(kernel(frame.data(), rows, cols, cols * channels));
+  }
+  state.SetItemsProcessed(state.iterations() * rows * cols);
+  state.SetBytesProcessed(state.iterations() * frame.size());
+}
+
+static void BM_LumaBGRScalar(benchmark::State& state) {
+  runKernel(state, sumLumaBGRScalar, false);
+}
+
+static void BM_LumaBGRSSE2(benchmark::State& state) {
+  runKernel(state, sumLumaBGRSSE2, false);
+}
+
+static void BM_LumaBGRAVX2(benchmark::State& state) {
+  runKernel(state, sumLumaBGRAVX2, true);
+}
+
+static void BM_LumaPlaneScalar(benchmark::State& state) {
+  runKernel(state, sumLumaPlaneScalar, false);
+}
+
+static void BM_LumaPlaneSSE2(benchmark::State& state) {
+  runKernel(state, sumLumaPlaneSSE2, false);
+}
+
+static void BM_LumaPlaneAVX2(benchmark::State& state) {
+  runKernel(state, sumLumaPlaneAVX2, true);
+}
+
+/*
+  Arguments: index of frame size, sample step.
+  Approximate mode reads only a part of the frame, pixels per second count the whole frame.
+  The dispatched kernel is compared with the ones used on CPUs without AVX2.
+*/
+static void runSampledKernel(benchmark::State& state, LumaSampledKernel kernel, int channels) {
+  int cols = kFrameSizes[state.range(0)][0];
+  int rows = kFrameSizes[state.range(0)][1];
+  int sample_step = state.range(1);
+  std::vector<uint8_t> frame = randomFrame(static_cast<size_t>(rows) * cols * channels);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(kernel(frame.data(), rows, cols, cols * channels, sample_step));
+  }
+  state.SetItemsProcessed(state.iterations() * rows * cols);
+}
+
+static void BM_LumaBGRSampled(benchmark::State& state) {
+  runSampledKernel(state, sumLumaBGRSampled, 3);
+}
+
+static void BM_LumaBGRSampledScalar(benchmark::State& state) {
+  runSampledKernel(state, sumLumaBGRSampledScalar, 3);
+}
+
+static void BM_LumaPlaneSampled(benchmark::State& state) {
+  runSampledKernel(state, sumLumaPlaneSampled, 1);
+}
+
+static void BM_LumaPlaneSampledScalar(benchmark::State& state) {
+  runSampledKernel(state, sumLumaPlaneSampledScalar, 1);
+}
+
+static void BM_LumaPlaneSampledSSE2(benchmark::State& state) {
+  runSampledKernel(state, sumLumaPlaneSampledSSE2, 1);
+}
+
+/*
+  Arguments: index of frame size, number of channels of the frame.
+  Masked kernels with an ellipse touching the frame edges as the mask, about 3/4 of pixels are used.
+  Pixels per second count the whole frame.
+*/
+static void BM_LumaMasked(benchmark::State& state) {
+  int cols = kFrameSizes[state.range(0)][0];
+  int rows = kFrameSizes[state.range(0)][1];
+  int channels = state.range(1);
+  std::vector<uint8_t> frame = randomFrame(static_cast<size_t>(rows) * cols * channels);
+  std::vector<uint8_t> mask(static_cast<size_t>(rows) * cols);
+  for (auto i = 0; i < rows; i++) {
+    for (auto j = 0; j < cols; j++) {
+      double x = (2.0 * j - cols) / cols, y = (2.0 * i - rows) / rows;
+      mask[static_cast<size_t>(i) * cols + j] = (x * x + y * y <= 1.0) ? 0xff : 0;
+    }
+  }
+  long long samples = 0;
+  for (auto _ : state) {
+    if (3 == channels) {
+      benchmark::DoNotOptimize(sumLumaBGRMasked(frame.data(), rows, cols, cols * 3, mask.data(), cols, 1, samples));
+    } else {
+      benchmark::DoNotOptimize(sumLumaPlaneMasked(frame.data(), rows, cols, cols, mask.data(), cols, 1, samples));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * rows * cols);
+}
+
+static void bgrArgs(benchmark::internal::Benchmark* b) {
+  for (auto size = 0; size < 3; size++) {
+    b->Args({size, 3});
+  }
+  b->ArgNames({"size", "channels"})->Unit(benchmark::kMicrosecond);
+}
+
+static void planeArgs(benchmark::internal::Benchmark* b) {
+  for (auto size = 0; size < 3; size++) {
+    b->Args({size, 1});
+  }
+  b->ArgNames({"size", "channels"})->Unit(benchmark::kMicrosecond);
+}
+
+static void sampledArgs(benchmark::internal::Benchmark* b) {
+  for (auto size = 0; size < 3; size++) {
+    for (auto step : {1, 2, 3, 4, 8}) {
+      b->Args({size, step});
+    }
+  }
+  b->ArgNames({"size", "step"})->Unit(benchmark::kMicrosecond);
+}
+
+BENCHMARK(BM_LumaBGRScalar)->Apply(bgrArgs);
+BENCHMARK(BM_LumaBGRSSE2)->Apply(bgrArgs);
+BENCHMARK(BM_LumaBGRAVX2)->Apply(bgrArgs);
+BENCHMARK(BM_LumaPlaneScalar)->Apply(planeArgs);
+BENCHMARK(BM_LumaPlaneSSE2)->Apply(planeArgs);
+BENCHMARK(BM_LumaPlaneAVX2)->Apply(planeArgs);
+BENCHMARK(BM_LumaBGRSampled)->Apply(sampledArgs);
+BENCHMARK(BM_LumaBGRSampledScalar)->Apply(sampledArgs);
+BENCHMARK(BM_LumaPlaneSampled)->Apply(sampledArgs);
+BENCHMARK(BM_LumaPlaneSampledScalar)->Apply(sampledArgs);
+BENCHMARK(BM_LumaPlaneSampledSSE2)->Apply(sampledArgs);
+BENCHMARK(BM_LumaMasked)->Apply(bgrArgs)->Apply(planeArgs);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,285 @@
+/*
+  Set of unit tests for luma kernels.
+  All SIMD versions must return exactly the same sum as the plain per-pixel calculation.
+*/
+#include <gtest/gtest.h>
+#include <vector>
+#include <random>
+#include "lumaKernel.h"
+
+// Creates a frame with random pixels. Rows may be padded (step > cols * 3).
+static std::vector<uint8_t> randomFrame(int rows, size_t step, unsigned seed) {
+  std::vector<uint8_t> frame(rows * step);
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<int> dist(0, 255);
+  for (auto& byte : frame) {
+    byte = dist(gen);
+  }
+  return frame;
+}
+
+static unsigned long long referenceSum(const uint8_t* data, int rows, int cols, size_t step) {
+  unsigned long long sum = 0;
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < cols; j++) {
+      sum += lumaOfBGR(data + i * step + j * 3);
+    }
+  }
+  return sum;
+}
+
+TEST(lumaKernel, singlePixelValues) {
+  uint8_t white[] = {255, 255, 255};
+  uint8_t black[] = {0, 0, 0};
+  uint8_t blue[] = {255, 0, 0};
+  uint8_t green[] = {0, 255, 0};
+  uint8_t red[] = {0, 0, 255};
+
+  // values produced by OpenCV cvtColor(CV_BGR2YUV)
+  ASSERT_EQ(255, lumaOfBGR(white));
+  ASSERT_EQ(0, lumaOfBGR(black));
+  ASSERT_EQ(29, lumaOfBGR(blue));
+  ASSERT_EQ(150, lumaOfBGR(green));
+  ASSERT_EQ(76, lumaOfBGR(red));
+}
+
+TEST(lumaKernel, scalarMatchesReference) {
+  std::vector<uint8_t> frame = randomFrame(17, 31 * 3, 1);
+  ASSERT_EQ(referenceSum(frame.data(), 17, 31, 31 * 3), sumLumaBGRScalar(frame.data(), 17, 31, 31 * 3));
+}
+
+TEST(lumaKernel, sse2MatchesScalar) {
+  if (!lumaKernelHasSSE2()) {
+    return;
+  }
+  // check widths around the SIMD block size to exercise tail handling
+  for (int cols = 1; cols < 40; cols++) {
+    std::vector<uint8_t> frame = randomFrame(5, cols * 3, cols);
+    ASSERT_EQ(sumLumaBGRScalar(frame.data(), 5, cols, cols * 3),
+              sumLumaBGRSSE2(frame.data(), 5, cols, cols * 3)) << "cols = " << cols;
+  }
+}
+
+TEST(lumaKernel, avx2MatchesScalar) {
+  if (!lumaKernelHasAVX2()) {
+    return;
+  }
+  for (int cols = 1; cols < 40; cols++) {
+    std::vector<uint8_t> frame = randomFrame(5, cols * 3, cols);
+    ASSERT_EQ(sumLumaBGRScalar(frame.data(), 5, cols, cols * 3),
+              sumLumaBGRAVX2(frame.data(), 5, cols, cols * 3)) << "cols = " << cols;
+  }
+}
+
+TEST(lumaKernel, paddedRows) {
+  // rows are 64 bytes apart, but only 13 pixels are used in each row
+  std::vector<uint8_t> frame = randomFrame(9, 64, 7);
+  unsigned long long expected = referenceSum(frame.data(), 9, 13, 64);
+  if (lumaKernelHasSSE2()) {
+    ASSERT_EQ(expected, sumLumaBGRSSE2(frame.data(), 9, 13, 64));
+  }
+  if (lumaKernelHasAVX2()) {
+    ASSERT_EQ(expected, sumLumaBGRAVX2(frame.data(), 9, 13, 64));
+  }
+  ASSERT_EQ(expected, sumLumaBGR(frame.data(), 9, 13, 64));
+}
+
+TEST(lumaKernel, fullHDFrame) {
+  std::vector<uint8_t> frame = randomFrame(1080, 1920 * 3, 3);
+  ASSERT_EQ(referenceSum(frame.data(), 1080, 1920, 1920 * 3), sumLumaBGR(frame.data(), 1080, 1920, 1920 * 3));
+}
+
+TEST(lumaKernel, whiteFrame) {
+  std::vector<uint8_t> frame(64 * 48 * 3, 255);
+  ASSERT_EQ(255ULL * 64 * 48, sumLumaBGR(frame.data(), 48, 64, 64 * 3));
+}
+
+TEST(lumaKernel, planeMatchesReference) {
+  for (int cols = 1; cols < 70; cols++) {
+    std::vector<uint8_t> plane = randomFrame(3, cols + 5, cols);
+    unsigned long long expected = 0;
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < cols; j++) {
+        expected += plane[i * (cols + 5) + j];
+      }
+    }
+    ASSERT_EQ(expected, sumLumaPlaneScalar(plane.data(), 3, cols, cols + 5)) << "cols = " << cols;
+    if (lumaKernelHasSSE2()) {
+      ASSERT_EQ(expected, sumLumaPlaneSSE2(plane.data(), 3, cols, cols + 5)) << "cols = " << cols;
+    }
+    if (lumaKernelHasAVX2()) {
+      ASSERT_EQ(expected, sumLumaPlaneAVX2(plane.data(), 3, cols, cols + 5)) << "cols = " << cols;
+    }
+    ASSERT_EQ(expected, sumLumaPlane(plane.data(), 3, cols, cols + 5)) << "cols = " << cols;
+  }
+}
+
+TEST(lumaKernel, whitePlane) {
+  std::vector<uint8_t> plane(3840 * 2160, 255);
+  ASSERT_EQ(255ULL * 3840 * 2160, sumLumaPlane(plane.data(), 2160, 3840, 3840));
+}
+
+TEST(lumaKernel, sampledMatchesReference) {
+  std::vector<uint8_t> frame = randomFrame(37, 50 * 3, 11);
+  for (int sample_step = 1; sample_step < 8; sample_step++) {
+    unsigned long long expected = 0;
+    long long pixels = 0;
+    for (int i = 0; i < 37; i += sample_step) {
+      for (int j = 0; j < 50; j += sample_step) {
+        expected += lumaOfBGR(frame.data() + i * 50 * 3 + j * 3);
+        pixels++;
+      }
+    }
+    ASSERT_EQ(expected, sumLumaBGRSampled(frame.data(), 37, 50, 50 * 3, sample_step)) << "step = " << sample_step;
+    ASSERT_EQ(pixels, lumaSamplesNum(37, 50, sample_step)) << "step = " << sample_step;
+  }
+}
+
+TEST(lumaKernel, sampledPlaneOfOneStep) {
+  std::vector<uint8_t> plane = randomFrame(21, 70, 5);
+  ASSERT_EQ(sumLumaPlane(plane.data(), 21, 70, 70), sumLumaPlaneSampled(plane.data(), 21, 70, 70, 1));
+
+  // only pixels 0, 4, 8 ... of rows 0, 4, 8 ... are used
+  std::vector<uint8_t> grid(16 * 16, 0);
+  for (int i = 0; i < 16; i += 4) {
+    for (int j = 0; j < 16; j += 4) {
+      grid[i * 16 + j] = 200;
+    }
+  }
+  ASSERT_EQ(200ULL * 16, sumLumaPlaneSampled(grid.data(), 16, 16, 16, 4));
+}
+
+// Every version of the sampled kernels. Widths leave pixels to the scalar loop, rows are padded
+// with bytes which must not be added.
+TEST(lumaKernel, sampledVersionsMatch) {
+  for (int cols : {1, 9, 31, 64, 97, 259}) {
+    size_t step = cols * 3 + 5;
+    std::vector<uint8_t> frame = randomFrame(23, step, cols);
+    for (int sample_step = 2; sample_step <= 40; sample_step++) {
+      unsigned long long bgr = 0, plane = 0;
+      for (int i = 0; i < 23; i += sample_step) {
+        for (int j = 0; j < cols; j += sample_step) {
+          bgr += lumaOfBGR(frame.data() + i * step + j * 3);
+          plane += frame[i * step + j];
+        }
+      }
+      // a plane as wide as the BGR row
+      int plane_cols = cols * 3;
+      unsigned long long wide_plane = 0;
+      for (int i = 0; i < 23; i += sample_step) {
+        for (int j = 0; j < plane_cols; j += sample_step) {
+          wide_plane += frame[i * step + j];
+        }
+      }
+      std::string where = "cols = " + std::to_string(cols) + ", step = " + std::to_string(sample_step);
+      ASSERT_EQ(bgr, sumLumaBGRSampledScalar(frame.data(), 23, cols, step, sample_step)) << where;
+      ASSERT_EQ(bgr, sumLumaBGRSampled(frame.data(), 23, cols, step, sample_step)) << where;
+      ASSERT_EQ(plane, sumLumaPlaneSampledScalar(frame.data(), 23, cols, step, sample_step)) << where;
+      ASSERT_EQ(wide_plane, sumLumaPlaneSampled(frame.data(), 23, plane_cols, step, sample_step)) << where;
+      if (lumaKernelHasSSE2()) {
+        ASSERT_EQ(wide_plane, sumLumaPlaneSampledSSE2(frame.data(), 23, plane_cols, step, sample_step)) << where;
+      }
+      if (lumaKernelHasAVX2()) {
+        ASSERT_EQ(bgr, sumLumaBGRSampledAVX2(frame.data(), 23, cols, step, sample_step)) << where;
+        ASSERT_EQ(wide_plane, sumLumaPlaneSampledAVX2(frame.data(), 23, plane_cols, step, sample_step)) << where;
+      }
+    }
+  }
+}
+
+// Sizes which do not fill the last register are used too.
+TEST(lumaKernel, addHistogram) {
+  std::mt19937 gen(7);
+  for (int bins : {0, 3, 256, 259, 4096}) {
+    std::vector<int> src(bins), dst(bins);
+    for (int i = 0; i < bins; i++) {
+      src[i] = gen() % 100000;
+      dst[i] = gen() % 100000;
+    }
+    std::vector<int> expected = dst;
+    addHistogramScalar(expected.data(), src.data(), bins);
+    for (int i = 0; i < bins; i++) {
+      ASSERT_EQ(dst[i] + src[i], expected[i]);
+    }
+    std::vector<int> sse2 = dst, avx2 = dst, best = dst;
+    if (lumaKernelHasSSE2()) {
+      addHistogramSSE2(sse2.data(), src.data(), bins);
+      ASSERT_EQ(expected, sse2) << "bins = " << bins;
+    }
+    if (lumaKernelHasAVX2()) {
+      addHistogramAVX2(avx2.data(), src.data(), bins);
+      ASSERT_EQ(expected, avx2) << "bins = " << bins;
+    }
+    addHistogram(best.data(), src.data(), bins);
+    ASSERT_EQ(expected, best) << "bins = " << bins;
+  }
+}
+
+// Mask is wider than the frame (mask_step > cols), as a mask row may be padded too.
+TEST(lumaKernel, maskedMatchesReference) {
+  std::vector<uint8_t> frame = randomFrame(23, 40 * 3, 13);
+  std::vector<uint8_t> plane = randomFrame(23, 40, 17);
+  std::vector<uint8_t> mask = randomFrame(23, 48, 19);
+  for (auto& byte : mask) {
+    byte = (byte < 100) ? 0 : 0xff;
+  }
+  for (int sample_step = 1; sample_step < 4; sample_step++) {
+    unsigned long long expected_bgr = 0, expected_plane = 0;
+    long long expected_samples = 0;
+    for (int i = 0; i < 23; i += sample_step) {
+      for (int j = 0; j < 40; j += sample_step) {
+        if (0 != mask[i * 48 + j]) {
+          expected_bgr += lumaOfBGR(frame.data() + i * 40 * 3 + j * 3);
+          expected_plane += plane[i * 40 + j];
+          expected_samples++;
+        }
+      }
+    }
+    long long samples = 0;
+    ASSERT_EQ(expected_bgr, sumLumaBGRMasked(frame.data(), 23, 40, 40 * 3, mask.data(), 48, sample_step, samples));
+    ASSERT_EQ(expected_samples, samples) << "step = " << sample_step;
+    ASSERT_EQ(expected_plane, sumLumaPlaneMasked(plane.data(), 23, 40, 40, mask.data(), 48, sample_step, samples));
+    ASSERT_EQ(expected_samples, samples) << "step = " << sample_step;
+  }
+
+  // full mask is the same as no mask
+  std::vector<uint8_t> full(23 * 40, 0xff);
+  long long samples = 0;
+  ASSERT_EQ(sumLumaBGR(frame.data(), 23, 40, 40 * 3),
+            sumLumaBGRMasked(frame.data(), 23, 40, 40 * 3, full.data(), 40, 1, samples));
+  ASSERT_EQ(23 * 40, samples);
+}
+
+// Counts close to the 32-bit limit are added to 64-bit counts without overflow.
+TEST(lumaKernel, addHistogramWide) {
+  std::mt19937 gen(9);
+  for (int bins : {0, 3, 256, 259, 4096}) {
+    std::vector<int> src(bins);
+    std::vector<long long> dst(bins);
+    for (int i = 0; i < bins; i++) {
+      src[i] = 2147483647 - gen() % 1000;
+      dst[i] = 3000000000LL + gen() % 1000;
+    }
+    std::vector<long long> expected = dst;
+    addHistogramWideScalar(expected.data(), src.data(), bins);
+    for (int i = 0; i < bins; i++) {
+      ASSERT_EQ(dst[i] + src[i], expected[i]);
+    }
+    std::vector<long long> sse2 = dst, avx2 = dst, best = dst;
+    if (lumaKernelHasSSE2()) {
+      addHistogramWideSSE2(sse2.data(), src.data(), bins);
+      ASSERT_EQ(expected, sse2) << "bins = " << bins;
+    }
+    if (lumaKernelHasAVX2()) {
+      addHistogramWideAVX2(avx2.data(), src.data(), bins);
+      ASSERT_EQ(expected, avx2) << "bins = " << bins;
+    }
+    addHistogramWide(best.data(), src.data(), bins);
+    ASSERT_EQ(expected, best) << "bins = " << bins;
+  }
+}
+
+int main(int argc, char **argv) {
+ ::testing::InitGoogleTest(&argc, argv);
+ return RUN_ALL_TESTS();
+}
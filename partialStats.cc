@@ -0,0 +1,133 @@
+#include "partialStats.h"
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <unistd.h>
+
+static const char kPartialMagic[8] = {'C', 'L', 'P', 'A', 'R', 'T', 'S', '\0'};
+static const uint32_t kPartialVersion = 1;
+
+const char* const CalcLumPartialStats::kMixedSignature = "mixed";
+
+template <typename T>
+static void writeValue(std::ofstream& out, const T& value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+static bool readValue(std::ifstream& in, T& value) {
+  return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+static void writeString(std::ofstream& out, const std::string& value) {
+  writeValue(out, static_cast<uint32_t>(value.size()));
+  out.write(value.data(), value.size());
+}
+
+static bool readString(std::ifstream& in, std::string& value) {
+  uint32_t len = 0;
+  if (!readValue(in, len) || (len > 65536)) {
+    return false;
+  }
+  value.assign(len, '\0');
+  return static_cast<bool>(in.read(&value[0], len));
+}
+
+bool CalcLumPartialStats::add(const std::string& file_name, const CalcLumStats& stats, int frames_total) {
+  if (!index_.emplace(file_name, entries_.size()).second) {
+    duplicates_++;
+    return false;
+  }
+  Entry entry;
+  entry.file_name = file_name;
+  entry.frames_total = frames_total;
+  entry.stats = stats;
+  entries_.push_back(entry);
+  return true;
+}
+
+bool CalcLumPartialStats::isExact() const {
+  return !entries_.empty() && (static_cast<size_t>(getExactNum()) == entries_.size());
+}
+
+int CalcLumPartialStats::getExactNum() const {
+  int exact = 0;
+  for (const auto& entry : entries_) {
+    if (entry.stats.isExact()) {
+      exact++;
+    }
+  }
+  return exact;
+}
+
+/*
+  All entries are read first, so a truncated file does not add anything.
+*/
+bool CalcLumPartialStats::load(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return false;
+  }
+
+  char magic[sizeof(kPartialMagic)];
+  uint32_t version = 0;
+  std::string signature;
+  uint64_t entries_num = 0;
+  if (!in.read(magic, sizeof(magic)) || (0 != std::memcmp(magic, kPartialMagic, sizeof(magic))) ||
+      !readValue(in, version) || (kPartialVersion != version) || !readString(in, signature) ||
+      !readValue(in, entries_num)) {
+    return false;
+  }
+
+  std::vector<Entry> entries;
+  for (uint64_t counter = 0; counter < entries_num; counter++) {
+    Entry entry;
+    if (!readString(in, entry.file_name) || !readValue(in, entry.frames_total) || !entry.stats.read(in)) {
+      return false;
+    }
+    entries.push_back(entry);
+  }
+
+  if (signature_.empty()) {
+    signature_ = signature;
+  } else if (signature_ != signature) {
+    signature_ = kMixedSignature;
+  }
+  mixed_signatures_ = (kMixedSignature == signature_);
+  for (const auto& entry : entries) {
+    add(entry.file_name, entry.stats, entry.frames_total);
+  }
+  return true;
+}
+
+bool CalcLumPartialStats::save(const std::string& path) const {
+  // Write to a temporary file first, rename is atomic.
+  std::string tmp_path = path + ".tmp." + std::to_string(getpid());
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      return false;
+    }
+    out.write(kPartialMagic, sizeof(kPartialMagic));
+    writeValue(out, kPartialVersion);
+    writeString(out, signature_);
+    writeValue(out, static_cast<uint64_t>(entries_.size()));
+    for (const auto& entry : entries_) {
+      writeString(out, entry.file_name);
+      writeValue(out, entry.frames_total);
+      entry.stats.write(out);
+    }
+    out.flush();
+    if (!out) {
+      out.close();
+      unlink(tmp_path.c_str());
+      return false;
+    }
+  }
+  if (0 != rename(tmp_path.c_str(), path.c_str())) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include "stats.h"
+
+/*
+  Partial statistics of a run: per-file statistics with full histograms, written at exit.
+  Runs on different machines (e.g. each one processing a shard of the directories) write their own
+  partial file and merging the files gives exactly the same min, max, mean and median as if all
+  videos had been processed in one run. Merged statistics can be saved again, so files may be
+  merged in several levels.
+
+  The file is binary: magic, version, signature of the parameters the statistics were calculated with,
+  number of files and then files one by one: name length and name, number of frames and statistics
+  (see CalcLumStats::write). Like the result cache it uses native byte order. It is written to a temporary
+  file renamed over the old one, so an interrupted run never leaves a broken file.
+  Files calculated with different parameters are saved with kMixedSignature, so they stay mixed when merged again.
+  Methods are not thread safe.
+*/
+class CalcLumPartialStats {
+public:
+  static const char* const kMixedSignature;
+
+  struct Entry {
+    std::string file_name;
+    int frames_total{0};
+    CalcLumStats stats;
+  };
+
+  // Returns false when the file is already there. It is not added again then.
+  bool add(const std::string& file_name, const CalcLumStats& stats, int frames_total);
+  // Adds all files of a partial stats file. Returns false when it cannot be read or is not valid,
+  // nothing is added then.
+  bool load(const std::string& path);
+  bool save(const std::string& path) const;
+
+  const std::vector<Entry>& getEntries() const { return entries_; }
+  // Number of files which have been given more than once and ignored.
+  int getDuplicatesNum() const { return duplicates_; }
+  // True when all files have been processed in exact mode.
+  bool isExact() const;
+  // Number of files processed in exact mode.
+  int getExactNum() const;
+
+  // Parameters which change results, see cacheSignature in calclum.cc.
+  void setSignature(const std::string& signature) { signature_ = signature; }
+  const std::string& getSignature() const { return signature_; }
+  // Set by load when the files have been calculated with different parameters or a file
+  // merged from such files has been loaded. The signature is kMixedSignature then.
+  bool hasMixedSignatures() const { return mixed_signatures_; }
+
+private:
+  std::vector<Entry> entries_;
+  // index of each file in entries_
+  std::map<std::string, size_t> index_;
+  int duplicates_{0};
+  std::string signature_;
+  bool mixed_signatures_{false};
+};
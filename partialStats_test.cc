@@ -0,0 +1,153 @@
+/*
+  Set of unit tests for partial statistics files.
+*/
+#include <gtest/gtest.h>
+#include <fstream>
+#include <cstdlib>
+#include <unistd.h>
+#include "partialStats.h"
+
+// Each test works in its own temporary directory.
+class PartialStatsTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    char dir_template[] = "/tmp/calclum_partial_XXXXXX";
+    dir_ = mkdtemp(dir_template);
+  }
+
+  void TearDown() override {
+    std::string cmd = "rm -rf " + dir_;
+    ASSERT_EQ(0, system(cmd.c_str()));
+  }
+
+  static CalcLumStats statsOf(std::initializer_list<int> frames) {
+    CalcLumStats stats;
+    for (auto luminance : frames) {
+      stats.addFrame(luminance);
+    }
+    return stats;
+  }
+
+  std::string dir_;
+};
+
+TEST_F(PartialStatsTest, saveAndLoad) {
+  CalcLumPartialStats partial;
+  partial.setSignature("params");
+  ASSERT_TRUE(partial.add("/videos/a.mp4", statsOf({10, 200, 200}), 5));
+  ASSERT_TRUE(partial.add("/videos/b.mp4", statsOf({7}), 1));
+  ASSERT_TRUE(partial.save(dir_ + "/node1.part"));
+
+  CalcLumPartialStats loaded;
+  ASSERT_TRUE(loaded.load(dir_ + "/node1.part"));
+  ASSERT_EQ("params", loaded.getSignature());
+  ASSERT_EQ(2u, loaded.getEntries().size());
+  const CalcLumPartialStats::Entry& entry = loaded.getEntries()[0];
+  ASSERT_EQ("/videos/a.mp4", entry.file_name);
+  ASSERT_EQ(5, entry.frames_total);
+  ASSERT_EQ(3, entry.stats.frames);
+  ASSERT_EQ(410, entry.stats.luminance);
+  ASSERT_EQ(10, entry.stats.min_luminance);
+  ASSERT_EQ(200, entry.stats.max_luminance);
+  ASSERT_EQ(2, entry.stats.median_set[200]);
+  ASSERT_FALSE(loaded.isExact());
+}
+
+// Files of several nodes merged together give the histogram of all frames.
+TEST_F(PartialStatsTest, mergeNodes) {
+  CalcLumPartialStats node1, node2;
+  node1.setSignature("params");
+  node2.setSignature("params");
+  node1.add("/videos/1/a.mp4", statsOf({10, 20}), 2);
+  node2.add("/videos/2/b.mp4", statsOf({20, 30, 40}), 3);
+  ASSERT_TRUE(node1.save(dir_ + "/node1.part"));
+  ASSERT_TRUE(node2.save(dir_ + "/node2.part"));
+
+  CalcLumPartialStats merged;
+  ASSERT_TRUE(merged.load(dir_ + "/node1.part"));
+  ASSERT_TRUE(merged.load(dir_ + "/node2.part"));
+  // the same file given twice is counted once
+  ASSERT_TRUE(merged.load(dir_ + "/node2.part"));
+  ASSERT_EQ(1, merged.getDuplicatesNum());
+  ASSERT_FALSE(merged.hasMixedSignatures());
+
+  CalcLumStats total;
+  for (const auto& entry : merged.getEntries()) {
+    total.merge(entry.stats);
+  }
+  ASSERT_EQ(5, total.frames);
+  ASSERT_EQ(120, total.luminance);
+  ASSERT_EQ(2, total.median_set[20]);
+
+  // merged stats saved again are the same
+  ASSERT_TRUE(merged.save(dir_ + "/all.part"));
+  CalcLumPartialStats again;
+  ASSERT_TRUE(again.load(dir_ + "/all.part"));
+  ASSERT_EQ(2u, again.getEntries().size());
+}
+
+TEST_F(PartialStatsTest, exactAndMixedParams) {
+  CalcLumStats exact;
+  exact.addFrameFixed((10 << kLumaFixedShift) + 123);
+  CalcLumPartialStats node1, node2;
+  node1.setSignature("exact=1");
+  node1.add("a", exact, 1);
+  node2.setSignature("exact=0");
+  node2.add("b", statsOf({10}), 1);
+  ASSERT_TRUE(node1.save(dir_ + "/node1.part"));
+  ASSERT_TRUE(node2.save(dir_ + "/node2.part"));
+
+  CalcLumPartialStats merged;
+  ASSERT_TRUE(merged.load(dir_ + "/node1.part"));
+  ASSERT_TRUE(merged.isExact());
+  ASSERT_EQ(exact.fine_set, merged.getEntries()[0].stats.fine_set);
+  ASSERT_TRUE(merged.load(dir_ + "/node2.part"));
+  ASSERT_FALSE(merged.isExact());
+  ASSERT_EQ(1, merged.getExactNum());
+  ASSERT_TRUE(merged.hasMixedSignatures());
+  ASSERT_EQ(CalcLumPartialStats::kMixedSignature, merged.getSignature());
+
+  // mixed files saved and loaded again stay mixed, even alone
+  ASSERT_TRUE(merged.save(dir_ + "/mixed.part"));
+  CalcLumPartialStats again;
+  ASSERT_TRUE(again.load(dir_ + "/mixed.part"));
+  ASSERT_TRUE(again.hasMixedSignatures());
+}
+
+// The file is replaced at once, no temporary file is left behind.
+TEST_F(PartialStatsTest, saveReplacesFile) {
+  CalcLumPartialStats first, second;
+  first.add("a", statsOf({1}), 1);
+  second.add("b", statsOf({2}), 1);
+  second.add("c", statsOf({3}), 1);
+  ASSERT_TRUE(first.save(dir_ + "/node.part"));
+  ASSERT_TRUE(second.save(dir_ + "/node.part"));
+  ASSERT_FALSE(second.save(dir_ + "/missing/node.part"));
+
+  CalcLumPartialStats loaded;
+  ASSERT_TRUE(loaded.load(dir_ + "/node.part"));
+  ASSERT_EQ(2u, loaded.getEntries().size());
+  std::string cmd = "test 1 = $(ls " + dir_ + " | wc -l)";
+  ASSERT_EQ(0, system(cmd.c_str()));
+}
+
+TEST_F(PartialStatsTest, invalidFilesAreRejected) {
+  CalcLumPartialStats partial;
+  ASSERT_FALSE(partial.load(dir_ + "/missing.part"));
+
+  CalcLumPartialStats node;
+  node.add("a", statsOf({1, 2, 3}), 3);
+  node.add("b", statsOf({4}), 1);
+  ASSERT_TRUE(node.save(dir_ + "/node.part"));
+  std::ifstream in(dir_ + "/node.part", std::ios::binary);
+  std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  std::ofstream out(dir_ + "/truncated.part", std::ios::binary | std::ios::trunc);
+  out.write(content.data(), content.size() - 10);
+  out.close();
+
+  // nothing is added from a truncated file
+  ASSERT_FALSE(partial.load(dir_ + "/truncated.part"));
+  ASSERT_TRUE(partial.getEntries().empty());
+  // nor from a file of another kind
+  ASSERT_FALSE(partial.load("/etc/passwd"));
+}
@@ -0,0 +1,172 @@
+#include "profiler.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <csignal>
+#include <pthread.h>
+
+CalcLumHistogram::CalcLumHistogram() {
+  for (auto& bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+int CalcLumHistogram::getBucketIndex(uint64_t value) {
+  if (0 == value) {
+    return 0;
+  }
+  int bucket = 64 - __builtin_clzll(value);
+  return (bucket < kBucketsNum) ? bucket : kBucketsNum - 1;
+}
+
+uint64_t CalcLumHistogram::getBucketLimit(int bucket) {
+  if (kBucketsNum - 1 == bucket) {
+    return UINT64_MAX;
+  }
+  return (1ULL << bucket) - 1;
+}
+
+void CalcLumHistogram::add(uint64_t value) {
+  buckets_[getBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+  uint64_t max = max_.load(std::memory_order_relaxed);
+  while ((value > max) && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+  }
+}
+
+uint64_t CalcLumHistogram::getPercentile(double percentile) const {
+  uint64_t count = getCount();
+  if (0 == count) {
+    return 0;
+  }
+  // rank of the value, counted from 1
+  uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(percentile / 100 * count + 0.5));
+  uint64_t seen = 0;
+  for (auto bucket = 0; bucket < kBucketsNum; bucket++) {
+    seen += getBucket(bucket);
+    if (seen >= rank) {
+      // no value is larger than the maximum
+      return std::min(getBucketLimit(bucket), getMax());
+    }
+  }
+  return getMax();
+}
+
+CalcLumProfiler::CalcLumProfiler() : started_(now()) {
+}
+
+CalcLumProfiler::~CalcLumProfiler() {
+  if (nullptr != signal_thread_) {
+    stop_signal_thread_ = true;
+    pthread_kill(signal_thread_->native_handle(), SIGUSR1);
+    signal_thread_->join();
+  }
+}
+
+const char* CalcLumProfiler::getStageName(CalcLumStage stage) {
+  switch (stage) {
+  case CalcLumStage::Decode:
+    return "decode";
+  case CalcLumStage::FrameWait:
+    return "frame_wait";
+  case CalcLumStage::AddJobWait:
+    return "add_job_wait";
+  case CalcLumStage::QueueWait:
+    return "queue_wait";
+  case CalcLumStage::ProcessJob:
+    return "process_job";
+  case CalcLumStage::Merge:
+    return "merge";
+  case CalcLumStage::QueueDepth:
+    return "queue_depth";
+  case CalcLumStage::StagesNum:
+    break;
+  }
+  return "unknown";
+}
+
+/*
+  Prints one line per stage. Times are in microseconds, percentiles are approximate (power of two buckets).
+  Totals of stages running on many threads at once may be larger than the elapsed time.
+*/
+void CalcLumProfiler::printSummary(std::ostream& out) const {
+  std::ostringstream summary;
+  summary << std::fixed << std::setprecision(1);
+  summary << "Pipeline profile after " << (now() - started_) / 1e6 << " ms:" << std::endl;
+  summary << "  " << std::left << std::setw(14) << "stage" << std::right << std::setw(12) << "count" <<
+      std::setw(14) << "total ms" << std::setw(12) << "mean us" << std::setw(12) << "p50 us" <<
+      std::setw(12) << "p99 us" << std::setw(12) << "max us" << std::endl;
+  for (auto stage = 0; stage < static_cast<int>(CalcLumStage::QueueDepth); stage++) {
+    const CalcLumHistogram& h = histograms_[stage];
+    uint64_t count = h.getCount();
+    summary << "  " << std::left << std::setw(14) << getStageName(static_cast<CalcLumStage>(stage)) << std::right <<
+        std::setw(12) << count << std::setw(14) << h.getSum() / 1e6 <<
+        std::setw(12) << ((0 < count) ? h.getSum() / 1e3 / count : 0.0) <<
+        std::setw(12) << h.getPercentile(50) / 1e3 << std::setw(12) << h.getPercentile(99) / 1e3 <<
+        std::setw(12) << h.getMax() / 1e3 << std::endl;
+  }
+  const CalcLumHistogram& depth = getHistogram(CalcLumStage::QueueDepth);
+  summary << "  queue depth when adding a job: mean " <<
+      ((0 < depth.getCount()) ? static_cast<double>(depth.getSum()) / depth.getCount() : 0.0) <<
+      ", p99 " << depth.getPercentile(99) << ", max " << depth.getMax() << std::endl;
+  // one write, so lines printed by other threads are not mixed into the table
+  out << summary.str() << std::flush;
+}
+
+void CalcLumProfiler::writeJSON(std::ostream& out) const {
+  out << "{\"elapsed_ns\": " << now() - started_ << ", \"stages\": {";
+  for (auto stage = 0; stage < static_cast<int>(CalcLumStage::StagesNum); stage++) {
+    const CalcLumHistogram& h = histograms_[stage];
+    out << ((0 < stage) ? ", " : "") << "\"" << getStageName(static_cast<CalcLumStage>(stage)) << "\": {" <<
+        "\"count\": " << h.getCount() << ", \"sum\": " << h.getSum() << ", \"max\": " << h.getMax() <<
+        ", \"p50\": " << h.getPercentile(50) << ", \"p90\": " << h.getPercentile(90) <<
+        ", \"p99\": " << h.getPercentile(99) << ", \"buckets\": [";
+    // buckets are listed up to the last non-empty one
+    int last = CalcLumHistogram::kBucketsNum - 1;
+    while ((0 < last) && (0 == h.getBucket(last))) {
+      last--;
+    }
+    for (auto bucket = 0; bucket <= last; bucket++) {
+      out << ((0 < bucket) ? ", " : "") << h.getBucket(bucket);
+    }
+    out << "]}";
+  }
+  out << "}}" << std::endl;
+}
+
+bool CalcLumProfiler::writeJSON(const std::string& file_name) const {
+  std::ofstream out(file_name);
+  writeJSON(out);
+  return static_cast<bool>(out);
+}
+
+void CalcLumProfiler::startSignalThread() {
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &set, nullptr);
+  signal_thread_ = std::make_unique<std::thread>(signalFunc, this);
+}
+
+/*
+  The signal is blocked in all threads and taken here with sigwait, so the summary
+  is printed on a normal thread and not in a signal handler.
+*/
+void CalcLumProfiler::signalFunc(CalcLumProfiler *p) {
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGUSR1);
+  while (true) {
+    int sig;
+    if (0 != sigwait(&set, &sig)) {
+      continue;
+    }
+    if (p->stop_signal_thread_) {
+      return;
+    }
+    p->printSummary(std::cout);
+  }
+}
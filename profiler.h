@@ -0,0 +1,115 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <memory>
+
+/*
+  CalcLumHistogram counts values in buckets of powers of two: bucket 0 holds 0,
+  bucket i holds values from 2^(i-1) to 2^i - 1. Adding a value is a few relaxed
+  atomic operations, so many threads may add values at the same time without a lock.
+  Percentiles are approximate, they return the upper bound of the bucket.
+*/
+class CalcLumHistogram {
+public:
+  static const int kBucketsNum = 48;
+
+  CalcLumHistogram();
+  void add(uint64_t value);
+
+  uint64_t getCount() const { return count_.load(std::memory_order_relaxed); }
+  uint64_t getSum() const { return sum_.load(std::memory_order_relaxed); }
+  uint64_t getMax() const { return max_.load(std::memory_order_relaxed); }
+  uint64_t getBucket(int bucket) const { return buckets_[bucket].load(std::memory_order_relaxed); }
+  // percentile is between 0 and 100
+  uint64_t getPercentile(double percentile) const;
+
+  static int getBucketIndex(uint64_t value);
+  // the largest value counted in the bucket
+  static uint64_t getBucketLimit(int bucket);
+
+private:
+  std::array<std::atomic<uint64_t>, kBucketsNum> buckets_;
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_{0};
+  std::atomic<uint64_t> max_{0};
+};
+
+/*
+  Stages of the pipeline measured by the profiler. Times are in nanoseconds.
+   - Decode: reading one frame from the decoder (grab and retrieve) on a reader thread,
+   - FrameWait: reader waiting for a free frame buffer in the pool,
+   - AddJobWait: reader blocked in CalcLumScheduler::addJob because the queue is full,
+   - QueueWait: time from adding a job to the scheduler until a worker takes it,
+   - ProcessJob: worker running processJob of one job (kernel and merge),
+   - Merge: merging results of a job into the file context.
+  QueueDepth is not a time, it is the number of jobs in the queue when a job is added.
+*/
+enum class CalcLumStage { Decode, FrameWait, AddJobWait, QueueWait, ProcessJob, Merge, QueueDepth, StagesNum };
+
+/*
+  CalcLumProfiler collects histograms of pipeline stages. It is created when profiling is
+  turned on and passed to the scheduler, the reader and file contexts. Without it nothing is measured.
+  The summary tells whether a run is bound by decoding (Decode is large, workers wait in QueueWait
+  for nothing to come), by workers (FrameWait and AddJobWait are large) or by merging statistics.
+
+  The summary can be printed at any time by sending SIGUSR1 to the process, see startSignalThread.
+*/
+class CalcLumProfiler {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  CalcLumProfiler();
+  ~CalcLumProfiler();
+
+  // Time in nanoseconds from an arbitrary point, to be used with record.
+  static uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+  }
+  void record(CalcLumStage stage, uint64_t value) { histograms_[static_cast<int>(stage)].add(value); }
+  const CalcLumHistogram& getHistogram(CalcLumStage stage) const { return histograms_[static_cast<int>(stage)]; }
+  static const char* getStageName(CalcLumStage stage);
+
+  void printSummary(std::ostream& out) const;
+  void writeJSON(std::ostream& out) const;
+  bool writeJSON(const std::string& file_name) const;
+
+  // Blocks SIGUSR1 in the calling thread and starts a thread which prints the summary
+  // each time SIGUSR1 is received. It must be called before other threads are created,
+  // so they inherit the blocked signal.
+  void startSignalThread();
+
+  /*
+    Measures time of a scope. With nullptr profiler nothing is measured, so the timer
+    can be always present in the code.
+  */
+  class Timer {
+  public:
+    Timer(CalcLumProfiler* profiler, CalcLumStage stage) : profiler_(profiler), stage_(stage) {
+      if (nullptr != profiler_) {
+        start_ = now();
+      }
+    }
+    ~Timer() {
+      if (nullptr != profiler_) {
+        profiler_->record(stage_, now() - start_);
+      }
+    }
+  private:
+    CalcLumProfiler* profiler_;
+    CalcLumStage stage_;
+    uint64_t start_{0};
+  };
+
+private:
+  std::array<CalcLumHistogram, static_cast<int>(CalcLumStage::StagesNum)> histograms_;
+  uint64_t started_;
+  std::unique_ptr<std::thread> signal_thread_;
+  std::atomic<bool> stop_signal_thread_{false};
+
+  static void signalFunc(CalcLumProfiler *);
+};
@@ -0,0 +1,97 @@
+/*
+  Set of unit tests for the pipeline profiler.
+*/
+#include <gtest/gtest.h>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "profiler.h"
+
+TEST(histogram, bucketIndex) {
+  ASSERT_EQ(0, CalcLumHistogram::getBucketIndex(0));
+  ASSERT_EQ(1, CalcLumHistogram::getBucketIndex(1));
+  ASSERT_EQ(2, CalcLumHistogram::getBucketIndex(2));
+  ASSERT_EQ(2, CalcLumHistogram::getBucketIndex(3));
+  ASSERT_EQ(11, CalcLumHistogram::getBucketIndex(1024));
+  ASSERT_EQ(11, CalcLumHistogram::getBucketIndex(2047));
+  // very large values go to the last bucket
+  ASSERT_EQ(CalcLumHistogram::kBucketsNum - 1, CalcLumHistogram::getBucketIndex(UINT64_MAX));
+  for (auto bucket = 1; bucket < CalcLumHistogram::kBucketsNum - 1; bucket++) {
+    ASSERT_EQ(bucket, CalcLumHistogram::getBucketIndex(CalcLumHistogram::getBucketLimit(bucket)));
+    ASSERT_EQ(bucket + 1, CalcLumHistogram::getBucketIndex(CalcLumHistogram::getBucketLimit(bucket) + 1));
+  }
+}
+
+TEST(histogram, percentiles) {
+  CalcLumHistogram h;
+  ASSERT_EQ(0u, h.getPercentile(50));
+  // 90 short values and 10 long ones
+  for (auto i = 0; i < 90; i++) {
+    h.add(100);
+  }
+  for (auto i = 0; i < 10; i++) {
+    h.add(5000);
+  }
+  ASSERT_EQ(100u, h.getCount());
+  ASSERT_EQ(90u * 100 + 10 * 5000, h.getSum());
+  ASSERT_EQ(5000u, h.getMax());
+  // percentile is the upper bound of the bucket
+  ASSERT_EQ(127u, h.getPercentile(50));
+  ASSERT_EQ(127u, h.getPercentile(90));
+  // but never more than the maximum
+  ASSERT_EQ(5000u, h.getPercentile(99));
+}
+
+TEST(histogram, concurrentAdds) {
+  CalcLumHistogram h;
+  std::vector<std::thread> threads;
+  for (auto t = 0; t < 8; t++) {
+    threads.emplace_back([&h, t]{
+      for (auto i = 0; i < 10000; i++) {
+        h.add(t * 10000 + i);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(80000u, h.getCount());
+  ASSERT_EQ(79999u, h.getMax());
+  ASSERT_EQ(79999ull * 80000 / 2, h.getSum());
+  uint64_t buckets = 0;
+  for (auto bucket = 0; bucket < CalcLumHistogram::kBucketsNum; bucket++) {
+    buckets += h.getBucket(bucket);
+  }
+  ASSERT_EQ(80000u, buckets);
+}
+
+TEST(profiler, timer) {
+  CalcLumProfiler profiler;
+  {
+    CalcLumProfiler::Timer timer(&profiler, CalcLumStage::Decode);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  ASSERT_EQ(1u, profiler.getHistogram(CalcLumStage::Decode).getCount());
+  ASSERT_LE(2000000u, profiler.getHistogram(CalcLumStage::Decode).getMax());
+  ASSERT_EQ(0u, profiler.getHistogram(CalcLumStage::Merge).getCount());
+
+  // without profiler nothing happens
+  CalcLumProfiler::Timer timer(nullptr, CalcLumStage::Decode);
+}
+
+TEST(profiler, reports) {
+  CalcLumProfiler profiler;
+  profiler.record(CalcLumStage::ProcessJob, 1500);
+  profiler.record(CalcLumStage::QueueDepth, 3);
+
+  std::ostringstream summary;
+  profiler.printSummary(summary);
+  ASSERT_NE(std::string::npos, summary.str().find("process_job"));
+  ASSERT_NE(std::string::npos, summary.str().find("max 3"));
+
+  std::ostringstream json;
+  profiler.writeJSON(json);
+  ASSERT_NE(std::string::npos, json.str().find("\"process_job\": {\"count\": 1, \"sum\": 1500, \"max\": 1500"));
+  ASSERT_NE(std::string::npos, json.str().find("\"queue_depth\": {\"count\": 1"));
+  ASSERT_EQ('}', json.str()[json.str().size() - 2]);
+}
@@ -0,0 +1,58 @@
+#include "rawFrame.h"
+#include <cstdlib>
+
+size_t CalcLumRawFormat::getFrameSize() const {
+  size_t pixels = static_cast<size_t>(width) * height;
+  switch (format) {
+  case CalcLumPixelFormat::Y:
+    return pixels;
+  case CalcLumPixelFormat::YUV420:
+    // chroma planes have half width and half height, rounded up
+    return pixels + 2 * static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2);
+  case CalcLumPixelFormat::YUV422:
+    return pixels + 2 * static_cast<size_t>((width + 1) / 2) * height;
+  case CalcLumPixelFormat::YUV444:
+    return pixels * 3;
+  case CalcLumPixelFormat::BGR:
+    return pixels * 3;
+  }
+  return pixels;
+}
+
+/*
+  Planar frame is stored as single channel image, so chroma planes take additional rows.
+  When the frame does not fill the whole last row, the rest of the row is not used.
+*/
+int CalcLumRawFormat::getMatRows() const {
+  if (isPlanar()) {
+    return (getFrameSize() + width - 1) / width;
+  }
+  return height;
+}
+
+bool CalcLumRawFormat::parseSize(const std::string& size) {
+  size_t x = size.find('x');
+  if (std::string::npos == x) {
+    return false;
+  }
+  width = std::atoi(size.substr(0, x).c_str());
+  height = std::atoi(size.substr(x + 1).c_str());
+  return isValid();
+}
+
+bool CalcLumRawFormat::parseFormat(const std::string& name) {
+  if (name == "y") {
+    format = CalcLumPixelFormat::Y;
+  } else if ((name == "yuv420") || (name == "i420")) {
+    format = CalcLumPixelFormat::YUV420;
+  } else if (name == "yuv422") {
+    format = CalcLumPixelFormat::YUV422;
+  } else if (name == "yuv444") {
+    format = CalcLumPixelFormat::YUV444;
+  } else if (name == "bgr") {
+    format = CalcLumPixelFormat::BGR;
+  } else {
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+/*
+  Pixel formats of raw (not compressed) frames.
+   - Y: only luma plane, 1 byte per pixel
+   - YUV420: planar I420, Y plane followed by U and V planes of quarter size
+   - YUV422, YUV444: planar, U and V planes have half width or full size
+   - BGR: interleaved 8-bit BGR, as used by OpenCV
+*/
+enum class CalcLumPixelFormat { Y, YUV420, YUV422, YUV444, BGR };
+
+/*
+  Geometry and pixel format of raw frames. All frames have the same size.
+  A frame is stored in cv::Mat the same way as OpenCV delivers native YUV frames:
+  planar formats as a single channel image with Y plane in the first height rows.
+*/
+struct CalcLumRawFormat {
+  int width{0};
+  int height{0};
+  CalcLumPixelFormat format{CalcLumPixelFormat::YUV420};
+
+  bool isValid() const { return (0 < width) && (0 < height); }
+  // number of bytes of one frame
+  size_t getFrameSize() const;
+  // rows, columns and number of 8-bit channels of cv::Mat holding one frame
+  int getMatRows() const;
+  int getMatCols() const { return width; }
+  int getChannels() const { return (CalcLumPixelFormat::BGR == format) ? 3 : 1; }
+  // true when luminance is taken from Y plane
+  bool isPlanar() const { return CalcLumPixelFormat::BGR != format; }
+
+  // Parses geometry given as WIDTHxHEIGHT, e.g. 1920x1080.
+  bool parseSize(const std::string& size);
+  // Parses format name: y, yuv420 (or i420), yuv422, yuv444 or bgr.
+  bool parseFormat(const std::string& name);
+};
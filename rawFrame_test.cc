@@ -0,0 +1,67 @@
+/*
+  Set of unit tests for raw frame formats.
+*/
+#include <gtest/gtest.h>
+#include "rawFrame.h"
+
+TEST(rawFrame, parseSize) {
+  CalcLumRawFormat format;
+  ASSERT_TRUE(format.parseSize("1920x1080"));
+  ASSERT_EQ(1920, format.width);
+  ASSERT_EQ(1080, format.height);
+  ASSERT_FALSE(format.parseSize("1920"));
+  ASSERT_FALSE(format.parseSize("0x1080"));
+}
+
+TEST(rawFrame, parseFormat) {
+  CalcLumRawFormat format;
+  ASSERT_TRUE(format.parseFormat("y"));
+  ASSERT_EQ(CalcLumPixelFormat::Y, format.format);
+  ASSERT_TRUE(format.parseFormat("bgr"));
+  ASSERT_EQ(CalcLumPixelFormat::BGR, format.format);
+  ASSERT_TRUE(format.parseFormat("i420"));
+  ASSERT_EQ(CalcLumPixelFormat::YUV420, format.format);
+  ASSERT_FALSE(format.parseFormat("nv12"));
+}
+
+TEST(rawFrame, frameSizes) {
+  CalcLumRawFormat format;
+  format.parseSize("64x48");
+  format.parseFormat("y");
+  ASSERT_EQ(64u * 48, format.getFrameSize());
+  ASSERT_EQ(48, format.getMatRows());
+  ASSERT_EQ(1, format.getChannels());
+
+  format.parseFormat("bgr");
+  ASSERT_EQ(64u * 48 * 3, format.getFrameSize());
+  ASSERT_EQ(48, format.getMatRows());
+  ASSERT_EQ(3, format.getChannels());
+
+  format.parseFormat("yuv420");
+  ASSERT_EQ(64u * 48 * 3 / 2, format.getFrameSize());
+  ASSERT_EQ(72, format.getMatRows());
+  ASSERT_EQ(1, format.getChannels());
+
+  format.parseFormat("yuv422");
+  ASSERT_EQ(64u * 48 * 2, format.getFrameSize());
+  ASSERT_EQ(96, format.getMatRows());
+
+  format.parseFormat("yuv444");
+  ASSERT_EQ(64u * 48 * 3, format.getFrameSize());
+  ASSERT_EQ(144, format.getMatRows());
+  ASSERT_EQ(1, format.getChannels());
+}
+
+// Chroma planes of odd sized frames are rounded up. Mat must be large enough for the whole frame.
+TEST(rawFrame, oddSizeYUV420) {
+  CalcLumRawFormat format;
+  format.parseSize("5x3");
+  format.parseFormat("yuv420");
+  ASSERT_EQ(15u + 2 * 3 * 2, format.getFrameSize());
+  ASSERT_GE(static_cast<size_t>(format.getMatRows() * format.getMatCols()), format.getFrameSize());
+}
+
+int main(int argc, char **argv) {
+ ::testing::InitGoogleTest(&argc, argv);
+ return RUN_ALL_TESTS();
+}
@@ -0,0 +1,158 @@
+#include "rawVideo.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char kY4MMagic[] = "YUV4MPEG2";
+static const char kY4MFrame[] = "FRAME";
+
+CalcLumMappedVideo::~CalcLumMappedVideo() {
+  if (nullptr != data_) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+  }
+}
+
+static bool hasExtension(const std::string& file_name, const char* ext) {
+  size_t len = std::strlen(ext);
+  if (file_name.size() <= len) {
+    return false;
+  }
+  std::string file_ext = file_name.substr(file_name.size() - len);
+  std::transform(file_ext.begin(), file_ext.end(), file_ext.begin(), ::tolower);
+  return file_ext == ext;
+}
+
+bool CalcLumMappedVideo::isRawVideo(const std::string& file_name) {
+  return hasExtension(file_name, ".yuv") || hasExtension(file_name, ".y4m");
+}
+
+bool CalcLumMappedVideo::open(const std::string& file_name, const CalcLumRawFormat& yuv_format) {
+  int fd = ::open(file_name.c_str(), O_RDONLY);
+  if (-1 == fd) {
+    return false;
+  }
+  struct stat file_stat;
+  if ((0 != fstat(fd, &file_stat)) || (0 == file_stat.st_size)) {
+    close(fd);
+    return false;
+  }
+  size_ = file_stat.st_size;
+  void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  // mapping stays valid after the file is closed
+  close(fd);
+  if (MAP_FAILED == data) {
+    return false;
+  }
+  data_ = static_cast<const uint8_t*>(data);
+  // Frames are read from the beginning to the end, let the kernel read ahead.
+  madvise(data, size_, MADV_SEQUENTIAL);
+
+  if ((size_ >= sizeof(kY4MMagic) - 1) && (0 == std::memcmp(data_, kY4MMagic, sizeof(kY4MMagic) - 1))) {
+    return findY4MFrames();
+  }
+  if (!yuv_format.isValid()) {
+    return false;
+  }
+  format_ = yuv_format;
+  findYUVFrames();
+  return true;
+}
+
+/*
+  Stream header looks like: YUV4MPEG2 W1920 H1080 F25:1 Ip A1:1 C420jpeg
+  Only W, H and C parameters matter. Without C the format is 4:2:0.
+*/
+size_t CalcLumMappedVideo::parseY4MHeader(const uint8_t* data, size_t size, CalcLumRawFormat& format) {
+  const uint8_t* end = static_cast<const uint8_t*>(std::memchr(data, '\n', size));
+  if ((nullptr == end) || (size < sizeof(kY4MMagic) - 1) ||
+      (0 != std::memcmp(data, kY4MMagic, sizeof(kY4MMagic) - 1))) {
+    return 0;
+  }
+  std::string header(reinterpret_cast<const char*>(data), end - data);
+
+  format = CalcLumRawFormat();
+  format.format = CalcLumPixelFormat::YUV420;
+  size_t pos = sizeof(kY4MMagic) - 1;
+  while (pos < header.size()) {
+    size_t next = header.find(' ', pos + 1);
+    if (std::string::npos == next) {
+      next = header.size();
+    }
+    std::string param = header.substr(pos + 1, next - pos - 1);
+    pos = next;
+    if (param.empty()) {
+      continue;
+    }
+    std::string value = param.substr(1);
+    switch (param[0]) {
+    case 'W':
+      format.width = std::atoi(value.c_str());
+      break;
+    case 'H':
+      format.height = std::atoi(value.c_str());
+      break;
+    case 'C':
+      // 420jpeg, 420paldv, 420mpeg2 differ only in chroma siting
+      if ((value == "420") || (value == "420jpeg") || (value == "420paldv") || (value == "420mpeg2")) {
+        format.format = CalcLumPixelFormat::YUV420;
+      } else if (value == "422") {
+        format.format = CalcLumPixelFormat::YUV422;
+      } else if (value == "444") {
+        format.format = CalcLumPixelFormat::YUV444;
+      } else if (value == "mono") {
+        format.format = CalcLumPixelFormat::Y;
+      } else {
+        // e.g. high bit depth or alpha channel
+        return 0;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  if (!format.isValid()) {
+    return 0;
+  }
+  return end - data + 1;
+}
+
+/*
+  Each frame starts with FRAME header, which may have parameters, and ends with new line.
+  Headers are short, so only the first bytes of each frame are touched here.
+  An incomplete frame at the end of the file is ignored.
+*/
+bool CalcLumMappedVideo::findY4MFrames() {
+  size_t offset = parseY4MHeader(data_, size_, format_);
+  if (0 == offset) {
+    return false;
+  }
+  const size_t frame_size = format_.getFrameSize();
+  while (offset + sizeof(kY4MFrame) - 1 <= size_) {
+    if (0 != std::memcmp(data_ + offset, kY4MFrame, sizeof(kY4MFrame) - 1)) {
+      break;
+    }
+    const uint8_t* end = static_cast<const uint8_t*>(std::memchr(data_ + offset, '\n', size_ - offset));
+    if (nullptr == end) {
+      break;
+    }
+    offset = end - data_ + 1;
+    if (offset + frame_size > size_) {
+      break;
+    }
+    frame_offsets_.push_back(offset);
+    offset += frame_size;
+  }
+  return true;
+}
+
+void CalcLumMappedVideo::findYUVFrames() {
+  const size_t frame_size = format_.getFrameSize();
+  for (size_t offset = 0; offset + frame_size <= size_; offset += frame_size) {
+    frame_offsets_.push_back(offset);
+  }
+}
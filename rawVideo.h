@@ -0,0 +1,51 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "rawFrame.h"
+
+/*
+  CalcLumMappedVideo gives access to frames of a raw video file mapped into memory.
+  Supported files:
+   - .y4m (YUV4MPEG2): geometry and pixel format are read from the stream header,
+     each frame is preceded by its own FRAME header,
+   - .yuv: frames follow each other without any header, geometry and pixel format
+     must be given by the user.
+
+  Frames are not copied. getFrame returns a pointer into the mapping, which is valid
+  as long as the object exists. The mapping is read-only and advised as sequential,
+  so the kernel reads ahead and drops pages which have been used.
+*/
+class CalcLumMappedVideo {
+public:
+  CalcLumMappedVideo() {}
+  CalcLumMappedVideo(const CalcLumMappedVideo&) = delete;
+  CalcLumMappedVideo& operator=(const CalcLumMappedVideo&) = delete;
+  ~CalcLumMappedVideo();
+
+  // Returns true when the file name has extension of a raw video file (.yuv or .y4m).
+  static bool isRawVideo(const std::string& file_name);
+
+  // Maps the file and finds all frames. yuv_format is used for .yuv files only.
+  // Returns false when the file cannot be mapped or geometry is not known.
+  bool open(const std::string& file_name, const CalcLumRawFormat& yuv_format);
+
+  const CalcLumRawFormat& getFormat() const { return format_; }
+  int getFramesNum() const { return frame_offsets_.size(); }
+  // Pointer to the first byte of frame's data. A frame is getFormat().getFrameSize() bytes long.
+  const uint8_t* getFrame(int frame) const { return data_ + frame_offsets_[frame]; }
+
+  // Parses YUV4MPEG2 stream header ending with new line. Returns length of the header
+  // including new line, or 0 when it is not valid or the pixel format is not supported.
+  static size_t parseY4MHeader(const uint8_t* data, size_t size, CalcLumRawFormat& format);
+
+private:
+  const uint8_t* data_{nullptr};
+  size_t size_{0};
+  CalcLumRawFormat format_;
+  std::vector<size_t> frame_offsets_;
+
+  bool findY4MFrames();
+  void findYUVFrames();
+};
@@ -0,0 +1,107 @@
+/*
+  Set of unit tests for memory mapped raw video files.
+*/
+#include <gtest/gtest.h>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include "rawVideo.h"
+
+class RawVideoTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    char dir_template[] = "/tmp/calclum_raw_XXXXXX";
+    dir_ = mkdtemp(dir_template);
+  }
+
+  void TearDown() override {
+    std::string cmd = "rm -rf " + dir_;
+    ASSERT_EQ(0, system(cmd.c_str()));
+  }
+
+  void writeFile(const std::string& name, const std::string& content) {
+    std::ofstream out(dir_ + "/" + name, std::ios::binary | std::ios::trunc);
+    out << content;
+  }
+
+  std::string dir_;
+};
+
+static size_t parseHeader(const std::string& header, CalcLumRawFormat& format) {
+  return CalcLumMappedVideo::parseY4MHeader(reinterpret_cast<const uint8_t*>(header.data()), header.size(), format);
+}
+
+TEST(rawVideo, isRawVideo) {
+  ASSERT_TRUE(CalcLumMappedVideo::isRawVideo("/videos/capture.yuv"));
+  ASSERT_TRUE(CalcLumMappedVideo::isRawVideo("capture.Y4M"));
+  ASSERT_FALSE(CalcLumMappedVideo::isRawVideo("capture.mp4"));
+  ASSERT_FALSE(CalcLumMappedVideo::isRawVideo(".yuv"));
+}
+
+TEST(rawVideo, parseY4MHeader) {
+  CalcLumRawFormat format;
+  std::string header = "YUV4MPEG2 W1920 H1080 F25:1 Ip A1:1 C420jpeg XYSCSS=420JPEG\n";
+  ASSERT_EQ(header.size(), parseHeader(header + "FRAME\n", format));
+  ASSERT_EQ(1920, format.width);
+  ASSERT_EQ(1080, format.height);
+  ASSERT_EQ(CalcLumPixelFormat::YUV420, format.format);
+
+  ASSERT_NE(0u, parseHeader("YUV4MPEG2 W64 H48 Cmono\n", format));
+  ASSERT_EQ(CalcLumPixelFormat::Y, format.format);
+  ASSERT_NE(0u, parseHeader("YUV4MPEG2 H48 W64 C444\n", format));
+  ASSERT_EQ(CalcLumPixelFormat::YUV444, format.format);
+  ASSERT_EQ(64, format.width);
+  // default chroma subsampling is 4:2:0
+  ASSERT_NE(0u, parseHeader("YUV4MPEG2 W64 H48\n", format));
+  ASSERT_EQ(CalcLumPixelFormat::YUV420, format.format);
+}
+
+TEST(rawVideo, invalidY4MHeaders) {
+  CalcLumRawFormat format;
+  // no new line
+  ASSERT_EQ(0u, parseHeader("YUV4MPEG2 W64 H48", format));
+  // no height
+  ASSERT_EQ(0u, parseHeader("YUV4MPEG2 W64\n", format));
+  // 10-bit samples are not supported
+  ASSERT_EQ(0u, parseHeader("YUV4MPEG2 W64 H48 C420p10\n", format));
+  ASSERT_EQ(0u, parseHeader("RIFF W64 H48\n", format));
+}
+
+TEST_F(RawVideoTest, y4mFrames) {
+  // 4x2 mono frames, second frame header has a parameter, the third frame is incomplete
+  writeFile("video.y4m", std::string("YUV4MPEG2 W4 H2 Cmono\n") +
+            "FRAME\n" + std::string(8, '\x10') +
+            "FRAME Ixyz\n" + std::string(8, '\x20') +
+            "FRAME\n" + std::string(3, '\x30'));
+  CalcLumMappedVideo video;
+  ASSERT_TRUE(video.open(dir_ + "/video.y4m", CalcLumRawFormat()));
+  ASSERT_EQ(2, video.getFramesNum());
+  ASSERT_EQ(8u, video.getFormat().getFrameSize());
+  ASSERT_EQ(0, std::memcmp(video.getFrame(0), std::string(8, '\x10').data(), 8));
+  ASSERT_EQ(0, std::memcmp(video.getFrame(1), std::string(8, '\x20').data(), 8));
+}
+
+TEST_F(RawVideoTest, yuvFramesNeedFormat) {
+  // three 4x2 I420 frames (12 bytes each) and 5 bytes of an incomplete frame
+  writeFile("video.yuv", std::string(12, 'a') + std::string(12, 'b') + std::string(12, 'c') + "ddddd");
+  CalcLumMappedVideo unknown;
+  ASSERT_FALSE(unknown.open(dir_ + "/video.yuv", CalcLumRawFormat()));
+
+  CalcLumRawFormat format;
+  format.parseSize("4x2");
+  format.parseFormat("yuv420");
+  CalcLumMappedVideo video;
+  ASSERT_TRUE(video.open(dir_ + "/video.yuv", format));
+  ASSERT_EQ(3, video.getFramesNum());
+  ASSERT_EQ('c', video.getFrame(2)[0]);
+}
+
+TEST_F(RawVideoTest, missingFile) {
+  CalcLumMappedVideo video;
+  ASSERT_FALSE(video.open(dir_ + "/missing.y4m", CalcLumRawFormat()));
+}
+
+int main(int argc, char **argv) {
+ ::testing::InitGoogleTest(&argc, argv);
+ return RUN_ALL_TESTS();
+}
@@ -0,0 +1,759 @@
+#include "reader.h"
+#include "sniffer.h"
+#include <algorithm>
+#include <unistd.h>
+#include <errno.h>
+
+// Files shorter than this are not split into segments. Each seek costs decoding
+// from the previous key frame, so very short segments are not worth it.
+static const int kMinSegmentFrames = 500;
+
+// In auto batch mode jobs carry at least that many pixels, but no more than kMaxBatchSize frames.
+static const int kBatchPixels = 1920 * 1080;
+static const int kMaxBatchSize = 32;
+
+// How often the watchdog checks reader threads.
+static const std::chrono::seconds kWatchdogPeriod(1);
+
+CalcLumReader::CalcLumReader(CalcLumScheduler& scheduler, const CalcLumConfig& config, int readers_num) :
+  scheduler_(scheduler), config_(config), readers_num_(readers_num) {
+  // By default there are enough buffers for all jobs which can exist at the same time:
+  // waiting in the queue, being processed and held by each reader (the last job and
+  // the frame being read). Fewer buffers limit memory further. Each reader holds up to one
+  // batch while waiting for the next buffer, so there must be more buffers than that.
+  batch_size_ = (0 < config_.batch_size) ? config_.batch_size : kMaxBatchSize;
+  int frame_buffers = config_.frame_buffers;
+  if (0 >= frame_buffers) {
+    frame_buffers = (scheduler_.getMaxOutstandingJobs() + config_.threads_num + readers_num_) * batch_size_ +
+                    readers_num_;
+  }
+  frame_pool_ = std::make_shared<CalcLumFramePool>(std::max(frame_buffers, readers_num_ * batch_size_ + 1));
+}
+
+CalcLumReader::~CalcLumReader() {
+  finish();
+}
+
+// Start required number of reader threads and the watchdog.
+void CalcLumReader::start() {
+  std::lock_guard<std::mutex> lk(files_m_);
+  for (auto counter = 0; counter < readers_num_; counter++) {
+    slots_.push_back(std::make_shared<ReaderSlot>());
+    threads_.push_back(std::make_unique<std::thread>(readerFunc, this, counter, slots_.back()));
+  }
+  live_readers_ = readers_num_;
+  if (0 < config_.decode_timeout) {
+    watchdog_ = std::make_unique<std::thread>(watchdogFunc, this);
+  }
+}
+
+void CalcLumReader::addFile(std::shared_ptr<CalcLumFileCtx> file_ctx) {
+  {
+    std::lock_guard<std::mutex> lk(files_m_);
+    ReadTask task;
+    task.file_ctx = file_ctx;
+    tasks_.push_back(task);
+  }
+  files_cv_.notify_one();
+}
+
+void CalcLumReader::finish() {
+  {
+    std::unique_lock<std::mutex> lk(files_m_);
+    no_more_files_ = true;
+    files_cv_.notify_all();
+    // Threads are not joined right away. A stuck one would block here, while the watchdog
+    // may still replace it with a new one.
+    files_cv_.wait(lk, [this]{return 0 == live_readers_;});
+    stop_watchdog_ = true;
+  }
+  watchdog_cv_.notify_all();
+  if (nullptr != watchdog_) {
+    watchdog_->join();
+    watchdog_.reset();
+  }
+
+  for (const std::unique_ptr<std::thread>& it : threads_) {
+    // all threads have finished already
+    it->join();
+  }
+  threads_.clear();
+  slots_.clear();
+}
+
+/*
+  Takes the next task from the queue. It pends when the queue is empty.
+  Returns false when the queue is empty, no more files will be added and
+  no other reader can add segments.
+*/
+bool CalcLumReader::getNextTask(ReadTask& task) {
+  std::unique_lock<std::mutex> lk(files_m_);
+  files_cv_.wait(lk, [this]{return !tasks_.empty() || (no_more_files_ && (0 == busy_readers_));});
+  if (tasks_.empty()) {
+    return false;
+  }
+  task = tasks_.front();
+  tasks_.pop_front();
+  busy_readers_++;
+  return true;
+}
+
+void CalcLumReader::taskDone() {
+  {
+    std::lock_guard<std::mutex> lk(files_m_);
+    busy_readers_--;
+  }
+  files_cv_.notify_all();
+}
+
+/*
+  This is reader thread. It reads files and segments one by one until the queue is empty.
+  A pinned reader thread allocates and decodes frames on its node. Jobs it adds
+  are then processed by workers on the same node (see CalcLumScheduler::pushWorkerJob).
+*/
+void CalcLumReader::readerFunc(CalcLumReader *r, int reader, std::shared_ptr<ReaderSlot> slot) {
+  if (nullptr != r->topology_) {
+    CalcLumTopology::pinCurrentThread(r->topology_->getNodeCpus(r->topology_->getReaderNode(reader)));
+  }
+  ReadTask task;
+  while (r->getNextTask(task)) {
+    r->readFile(task, *slot);
+    task.file_ctx.reset();
+    if (slot->isAbandoned()) {
+      // The watchdog has replaced this thread and the reader may not exist any more.
+      return;
+    }
+    r->taskDone();
+  }
+  {
+    std::lock_guard<std::mutex> lk(r->files_m_);
+    r->live_readers_--;
+  }
+  r->files_cv_.notify_all();
+}
+
+void CalcLumReader::ReaderSlot::enter(std::shared_ptr<CalcLumFileCtx> ctx) {
+  std::lock_guard<std::mutex> lk(m);
+  in_decoder = true;
+  since = std::chrono::steady_clock::now();
+  file_ctx = ctx;
+}
+
+bool CalcLumReader::ReaderSlot::leave() {
+  std::lock_guard<std::mutex> lk(m);
+  in_decoder = false;
+  file_ctx.reset();
+  return !abandoned;
+}
+
+bool CalcLumReader::ReaderSlot::isAbandoned() {
+  std::lock_guard<std::mutex> lk(m);
+  return abandoned;
+}
+
+/*
+  Watchdog thread. Once a period it checks whether a reader has been stuck in the decoder.
+*/
+void CalcLumReader::watchdogFunc(CalcLumReader *r) {
+  const std::chrono::seconds timeout(r->config_.decode_timeout);
+  std::unique_lock<std::mutex> lk(r->files_m_);
+  while (!r->stop_watchdog_) {
+    r->watchdog_cv_.wait_for(lk, kWatchdogPeriod);
+    for (size_t reader = 0; reader < r->slots_.size(); reader++) {
+      r->checkReader(reader, timeout);
+    }
+  }
+}
+
+/*
+  Called by the watchdog with files_m_ held. When the reader has been inside a decoder call
+  for longer than timeout, its file is abandoned (see CalcLumFileCtx::abandon), so processing
+  of other files does not wait for it. Another thread takes over the reader's place in the pool.
+  Frame buffers held by the stuck thread are returned to the pool only when it exits, so the pool
+  grows by as many buffers as a reader can hold. Otherwise the new thread could wait for them forever.
+*/
+void CalcLumReader::checkReader(int reader, std::chrono::steady_clock::duration timeout) {
+  std::shared_ptr<ReaderSlot> slot = slots_[reader];
+  std::shared_ptr<CalcLumFileCtx> fileCtx;
+  {
+    std::lock_guard<std::mutex> lk(slot->m);
+    if (!slot->in_decoder || (std::chrono::steady_clock::now() - slot->since < timeout)) {
+      return;
+    }
+    slot->abandoned = true;
+    fileCtx = slot->file_ctx;
+  }
+  std::cout << fileCtx->getFileName() << "->> Decoder not responding for " << config_.decode_timeout <<
+      " s, file abandoned" << std::endl;
+  fileCtx->abandon();
+
+  threads_[reader]->detach();
+  // a batch and the frame being decoded
+  frame_pool_->grow(batch_size_ + 1);
+  // the stuck thread does not call taskDone
+  busy_readers_--;
+  slots_[reader] = std::make_shared<ReaderSlot>();
+  threads_[reader] = std::make_unique<std::thread>(readerFunc, this, reader, slots_[reader]);
+  files_cv_.notify_all();
+}
+
+/*
+  Creates a job without a frame buffer.
+  y_plane selects the job calculating luminance from Y plane with luma_rows rows.
+*/
+std::unique_ptr<CalcLumFrameJob> CalcLumReader::newFrameJob(bool y_plane, int luma_rows) const {
+  std::unique_ptr<CalcLumFrameJob> job;
+  if (y_plane) {
+    std::unique_ptr<CalcLumYPlaneFrameJob> yJob = std::make_unique<CalcLumYPlaneFrameJob>();
+    yJob->setLumaRows(luma_rows);
+    job = std::move(yJob);
+  } else {
+    job = std::make_unique<CalcLumFrameJob>();
+  }
+  job->setSampleStep(config_.sample_step);
+  job->setExact(config_.exact);
+  return job;
+}
+
+/*
+  Creates a job with a frame buffer taken from the pool. It may pend until a buffer is free.
+*/
+std::unique_ptr<CalcLumFrameJob> CalcLumReader::createJob(bool y_plane, int luma_rows) {
+  std::unique_ptr<CalcLumFrameJob> job = newFrameJob(y_plane, luma_rows);
+  CalcLumProfiler::Timer timer(profiler_.get(), CalcLumStage::FrameWait);
+  job->setFramePool(frame_pool_);
+  return job;
+}
+
+/*
+  Opens the file. Backends which support it (FFmpeg since OpenCV 4.5.2) give up opening
+  and reading by themselves after the decode timeout. Others are left to the watchdog.
+*/
+bool CalcLumReader::openCapture(cv::VideoCapture& vc, const cv::String& fileName) {
+#if (CV_VERSION_MAJOR > 4) || ((CV_VERSION_MAJOR == 4) && \
+    ((CV_VERSION_MINOR > 5) || ((CV_VERSION_MINOR == 5) && (CV_VERSION_REVISION >= 2))))
+  if (0 < config_.decode_timeout) {
+    int timeout_ms = config_.decode_timeout * 1000;
+    return vc.open(fileName, cv::CAP_ANY,
+                   {cv::CAP_PROP_OPEN_TIMEOUT_MSEC, timeout_ms, cv::CAP_PROP_READ_TIMEOUT_MSEC, timeout_ms});
+  }
+#endif
+  return vc.open(fileName);
+}
+
+/*
+  Sets decoder options after the file has been opened. Returns number of rows in Y plane
+  when frames are delivered in native YUV format.
+*/
+int CalcLumReader::setupCapture(cv::VideoCapture& vc, const cv::String& fileName) {
+  // Ask decoder not to convert frames to BGR. Frames come in decoder's native format
+  // and only Y plane is used. Not all backends support it. If the frame still comes
+  // as BGR, the job falls back to BGR processing.
+  int luma_rows = 0;
+  if (config_.native_yuv) {
+    if (!vc.set(cv::CAP_PROP_CONVERT_RGB, false)) {
+      std::cout << fileName << "->> Native YUV format not supported, using BGR" << std::endl;
+    }
+    luma_rows = vc.get(cv::CAP_PROP_FRAME_HEIGHT);
+  }
+  return luma_rows;
+}
+
+/*
+  Positions decoder at the specified frame. OpenCV seeks to the nearest key frame
+  before it and decodes frames up to the requested one, so the position is frame exact.
+  Returns false if backend cannot seek or position after seek is not the requested one.
+*/
+bool CalcLumReader::seekToFrame(cv::VideoCapture& vc, int frame) {
+  if (!vc.set(cv::CAP_PROP_POS_FRAMES, frame)) {
+    return false;
+  }
+  return frame == static_cast<int>(vc.get(cv::CAP_PROP_POS_FRAMES));
+}
+
+/*
+  Splits long file into segments of equal length. All segments but the first one are put
+  at the front of the queue, so other reader threads start reading them immediately.
+  The last segment is read until end of file, so no frames are lost when the
+  frame count reported by the decoder is not accurate.
+  Returns number of frames in the first segment or -1 when the file is not split.
+*/
+int CalcLumReader::splitFile(cv::VideoCapture& vc, std::shared_ptr<CalcLumFileCtx> fileCtx) {
+  int frames = vc.get(cv::CAP_PROP_FRAME_COUNT);
+  int segments = std::min(config_.segments, frames / kMinSegmentFrames);
+  if (segments < 2) {
+    return -1;
+  }
+  int segment_len = frames / segments;
+
+  // Check that decoder can seek to exact frame and go back to the beginning.
+  if (!seekToFrame(vc, segment_len) || !seekToFrame(vc, 0)) {
+    std::cout << fileCtx->getFileName() << "->> Cannot seek, reading whole file" << std::endl;
+    // position is unknown now, so start from scratch
+    vc.release();
+    if (!openCapture(vc, fileCtx->getFileName())) {
+      return -1;
+    }
+    setupCapture(vc, fileCtx->getFileName());
+    return -1;
+  }
+
+  fileCtx->setSegments(segments);
+  {
+    std::lock_guard<std::mutex> lk(files_m_);
+    for (int segment = segments - 1; segment > 0; segment--) {
+      ReadTask task;
+      task.file_ctx = fileCtx;
+      task.first_frame = segment * segment_len;
+      task.frames_num = (segment == segments - 1) ? -1 : segment_len;
+      tasks_.push_front(task);
+    }
+  }
+  files_cv_.notify_all();
+  return segment_len;
+}
+
+/*
+  Letterbox mode. Frames from the beginning of the file are decoded until the bars are found in one of them
+  (see CalcLumFileCtx::detectLetterbox), then the decoder is positioned at the first frame again. The region
+  is set before any job of the file is sent and before the file is split, so all frames use the same one.
+  Returns false when the reader has been abandoned meanwhile.
+*/
+bool CalcLumReader::detectLetterbox(cv::VideoCapture& vc, std::shared_ptr<CalcLumFileCtx> fileCtx, int luma_rows,
+                                    ReaderSlot& slot) {
+  // frames are decoded into a job of its own, it is never sent
+  std::unique_ptr<CalcLumFrameJob> job = newFrameJob(config_.native_yuv, luma_rows);
+  int frames = 0;
+  bool detected = false;
+  while (!detected) {
+    slot.enter(fileCtx);
+    uint64_t decode_start = (nullptr != profiler_) ? CalcLumProfiler::now() : 0;
+    bool read = vc.grab() && vc.retrieve(job->getFrame());
+    if (!slot.leave()) {
+      return false;
+    }
+    if (nullptr != profiler_) {
+      profiler_->record(CalcLumStage::Decode, CalcLumProfiler::now() - decode_start);
+    }
+    if (!read) {
+      break;
+    }
+    frames++;
+    detected = fileCtx->detectLetterbox(*job);
+  }
+  fileCtx->finishLetterbox();
+  if (0 == frames) {
+    return true;
+  }
+
+  slot.enter(fileCtx);
+  bool rewound = seekToFrame(vc, 0);
+  if (!rewound) {
+    // position is unknown now, so start from scratch
+    vc.release();
+    rewound = openCapture(vc, fileCtx->getFileName());
+  }
+  if (!slot.leave()) {
+    return false;
+  }
+  if (rewound) {
+    setupCapture(vc, fileCtx->getFileName());
+  }
+  return true;
+}
+
+/*
+  Counts the file as being processed and passes run-wide objects to its context.
+  Other reader threads update the counter too, so it is done under lock.
+*/
+void CalcLumReader::startFile(std::shared_ptr<CalcLumFileCtx> fileCtx) {
+  fileCtx->setSyncVars(cv_, cv_m_, files_counter_);
+  fileCtx->setProfiler(profiler_);
+  fileCtx->setRoiSpec(config_.roi);
+  if (nullptr != series_writer_) {
+    fileCtx->setSeries(series_writer_->addFile(fileCtx->getFileName()));
+  }
+  std::lock_guard<std::mutex> lk(*cv_m_);
+  (*files_counter_)++;
+}
+
+/*
+  Returns place of the frame in the time series of the file, or an invalid slot when no series is written.
+*/
+CalcLumSeriesSlot CalcLumReader::getSeriesSlot(std::shared_ptr<CalcLumFileCtx> fileCtx, int frame) {
+  CalcLumSeries* series = fileCtx->getSeries();
+  return (nullptr != series) ? series->getSlot(frame) : CalcLumSeriesSlot();
+}
+
+/*
+  Method opens a file (or a segment of the file) and sends frames to the scheduler for processing.
+  Decoder calls are made between slot.enter and slot.leave, so the watchdog can see a stuck decoder.
+  When the reader has been abandoned meanwhile, it returns at once.
+*/
+void CalcLumReader::readFile(ReadTask task, ReaderSlot& slot) {
+  cv::VideoCapture vc;
+  std::shared_ptr<CalcLumFileCtx> fileCtx = task.file_ctx;
+  const cv::String& fileName = fileCtx->getFileName();
+  bool whole_file = (0 == task.first_frame) && (-1 == task.frames_num);
+
+  if (whole_file && CalcLumMappedVideo::isRawVideo(fileName)) {
+    readMappedFile(fileCtx);
+    return;
+  }
+
+  // Some decoders open files which are not videos at all and then hang, so look at the content first.
+  if (whole_file && config_.sniff && (CalcLumContainer::Unknown == CalcLumSniffer::sniffFile(fileName))) {
+    std::cout << fileName << "->> Not a video file" << std::endl;
+    fileCtx->setError();
+    fileCtx->setFinished();
+    return;
+  }
+
+  slot.enter(fileCtx);
+  bool opened = openCapture(vc, fileName);
+  if (!slot.leave()) {
+    return;
+  }
+  if (!opened) {
+    std::cout << fileName << "->> Invalid file" << std::endl; 
+    fileCtx->setError();
+    if (!whole_file) {
+      // other segments of the file are being read. Just finish this one.
+      finishSegment(fileCtx, nullptr);
+    } else {
+      fileCtx->setFinished();
+    }
+    vc.release();
+    return;
+  }
+
+  int luma_rows = setupCapture(vc, fileName);
+
+  if (whole_file) {
+    // From now on the file is counted as being processed.
+    startFile(fileCtx);
+    if (isLetterbox() && !detectLetterbox(vc, fileCtx, luma_rows, slot)) {
+      return;
+    }
+    if (config_.segments > 1) {
+      slot.enter(fileCtx);
+      task.frames_num = splitFile(vc, fileCtx);
+      if (!slot.leave()) {
+        return;
+      }
+    }
+  } else {
+    slot.enter(fileCtx);
+    bool seeked = seekToFrame(vc, task.first_frame);
+    if (!slot.leave()) {
+      return;
+    }
+    if (!seeked) {
+      std::cout << fileName << "->> Cannot seek to frame " << task.first_frame << std::endl;
+      fileCtx->setError();
+      finishSegment(fileCtx, nullptr);
+      vc.release();
+      return;
+    }
+  }
+
+  readSegment(vc, fileCtx, task.first_frame, task.frames_num, luma_rows, slot);
+  vc.release();
+}
+
+/*
+  Returns number of frames put into one job. Small frames are processed very quickly,
+  so the cost of the queue and of locking file context would dominate. In auto mode
+  frames are batched until a job has at least as many pixels as one full HD frame.
+*/
+int CalcLumReader::getBatchSize(const cv::Mat& frame) const {
+  if (0 < config_.batch_size) {
+    return config_.batch_size;
+  }
+  int pixels = std::max(frame.rows * frame.cols, 1);
+  return std::min(std::max(kBatchPixels / pixels, 1), kMaxBatchSize);
+}
+
+/*
+  Sends a frame job to the scheduler, alone or in a batch. The batch size is selected
+  when the first frame of the segment is known.
+  The last job is held until the next frame has been read, so it can be sent after
+  EOF has been set (see finishSegment).
+*/
+void CalcLumReader::sendFrameJob(PendingJobs& pending, std::unique_ptr<CalcLumFrameJob> job,
+                                 std::shared_ptr<CalcLumFileCtx> fileCtx) {
+  if(0 == pending.batch_size) {
+    pending.batch_size = getBatchSize(job->getFrame());
+  }
+  job->setFileCtx(fileCtx);
+
+  if(1 == pending.batch_size) {
+    if(nullptr != pending.last_job) {
+      scheduler_.addJob(std::move(pending.last_job));
+    }
+    pending.last_job = std::move(job);
+    return;
+  }
+
+  // Full batch is sent only when the next frame has been read.
+  if((nullptr == pending.batch) || (pending.batch->getFramesNum() == pending.batch_size)) {
+    if(nullptr != pending.batch) {
+      scheduler_.addJob(std::move(pending.batch));
+    }
+    pending.batch = std::make_unique<CalcLumBatchJob>();
+    pending.batch->setFileCtx(fileCtx);
+  }
+  pending.batch->addFrameJob(std::move(job));
+}
+
+/*
+  Sends jobs held until the region of the file was known. The buffers the pool has grown by meanwhile
+  (grown) are given back, those over the pool size are freed as the held jobs finish.
+*/
+void CalcLumReader::sendHeldJobs(PendingJobs& pending, std::vector<std::unique_ptr<CalcLumFrameJob> >& held,
+                                 int grown, std::shared_ptr<CalcLumFileCtx> fileCtx) {
+  frame_pool_->shrink(grown);
+  for(auto& job : held) {
+    sendFrameJob(pending, std::move(job), fileCtx);
+  }
+  held.clear();
+}
+
+std::unique_ptr<CalcLumJob> CalcLumReader::takeLastJob(PendingJobs& pending) {
+  if(nullptr != pending.batch) {
+    return std::move(pending.batch);
+  }
+  return std::move(pending.last_job);
+}
+
+/*
+  Reads frames_num frames (or until end of file when frames_num is -1) and sends them
+  to the scheduler. Frames are sent one per job or in batches.
+  Reading stops early when the file has been abandoned by the watchdog.
+*/
+void CalcLumReader::readSegment(cv::VideoCapture& vc, std::shared_ptr<CalcLumFileCtx> fileCtx,
+                                int first_frame, int frames_num, int luma_rows, ReaderSlot& slot) {
+  PendingJobs pending;
+  int frames = 0;
+  while(((-1 == frames_num) || (frames < frames_num)) && !fileCtx->isFinished()) {
+    // Frames which are not sampled are only grabbed: the decoder moves on,
+    // but the frame is not converted to BGR nor copied to a job.
+    // Sampling depends on frame number in the file, so it does not depend on segments.
+    if((1 < config_.frame_step) && (0 != (first_frame + frames) % config_.frame_step)) {
+      slot.enter(fileCtx);
+      bool grabbed = vc.grab();
+      if(!slot.leave()) {
+        return;
+      }
+      if(!grabbed) {
+        break;
+      }
+      CalcLumSeriesSlot series_slot = getSeriesSlot(fileCtx, first_frame + frames);
+      if(series_slot.isValid()) {
+        series_slot.setSkipped();
+      }
+      frames++;
+      fileCtx->incFramesSkipped();
+      continue;
+    }
+    // create a new frame processing job
+    std::unique_ptr<CalcLumFrameJob> newJob = createJob(config_.native_yuv, luma_rows);
+    // read new frame to the job class
+    slot.enter(fileCtx);
+    uint64_t decode_start = (nullptr != profiler_) ? CalcLumProfiler::now() : 0;
+    bool read = vc.grab() && vc.retrieve(newJob->getFrame());
+    if(!slot.leave()) {
+      return;
+    }
+    if(nullptr != profiler_) {
+      profiler_->record(CalcLumStage::Decode, CalcLumProfiler::now() - decode_start);
+    }
+    if(!read) {
+      break;
+    }
+    CalcLumSeriesSlot series_slot = getSeriesSlot(fileCtx, first_frame + frames);
+    if(series_slot.isValid()) {
+      // position of the frame just read, decoders which do not know it report 0 or less
+      double pts_ms = vc.get(cv::CAP_PROP_POS_MSEC);
+      series_slot.setPts((0 < pts_ms) || (0 == first_frame + frames) ? static_cast<int64_t>(pts_ms * 1000) : -1);
+      newJob->setSeriesSlot(series_slot);
+    }
+    frames++;
+    fileCtx->incFramesRead();
+    sendFrameJob(pending, std::move(newJob), fileCtx);
+  }
+  finishSegment(fileCtx, takeLastJob(pending));
+}
+
+/*
+  Reads raw frames of fixed size from a stream (stdin or a named pipe) until it is closed.
+  Each frame is read with large read() calls straight into the frame buffer of a pooled job,
+  no decoder and no intermediate copy is involved.
+  The stream is read on the calling thread. It is a single file for statistics.
+*/
+void CalcLumReader::readRawStream(int fd, std::shared_ptr<CalcLumFileCtx> fileCtx, const CalcLumRawFormat& format) {
+  startFile(fileCtx);
+
+  PendingJobs pending;
+  const size_t frame_size = format.getFrameSize();
+  // skipped frames are read into this buffer and dropped
+  std::vector<uint8_t> skip_buf;
+  // In letterbox mode jobs are held until the bars have been found in one of them. The pool grows by
+  // the buffers held meanwhile and shrinks back to its size when they are sent.
+  std::vector<std::unique_ptr<CalcLumFrameJob> > held;
+  int grown = 0;
+  bool detecting = isLetterbox();
+  int frames = 0;
+  while(true) {
+    bool sampled = (1 >= config_.frame_step) || (0 == frames % config_.frame_step);
+    std::unique_ptr<CalcLumFrameJob> newJob;
+    uint8_t* dst;
+    if(sampled) {
+      newJob = createJob(format.isPlanar(), format.height);
+      cv::Mat& frame = newJob->getFrame();
+      // buffers from the pool already have the right size, so nothing is allocated
+      frame.create(format.getMatRows(), format.getMatCols(), CV_8UC(format.getChannels()));
+      dst = frame.data;
+    } else {
+      skip_buf.resize(frame_size);
+      dst = skip_buf.data();
+    }
+
+    // reading from the stream is the decoding stage here
+    uint64_t read_start = (nullptr != profiler_) ? CalcLumProfiler::now() : 0;
+    size_t filled = 0;
+    while(filled < frame_size) {
+      ssize_t len = read(fd, dst + filled, frame_size - filled);
+      if((-1 == len) && (EINTR == errno)) {
+        continue;
+      }
+      if(len <= 0) {
+        break;
+      }
+      filled += len;
+    }
+    if(nullptr != profiler_) {
+      profiler_->record(CalcLumStage::Decode, CalcLumProfiler::now() - read_start);
+    }
+    if(filled < frame_size) {
+      if(0 < filled) {
+        std::cout << fileCtx->getFileName() << "->> Incomplete frame at the end of stream ignored" << std::endl;
+      }
+      break;
+    }
+
+    CalcLumSeriesSlot series_slot = getSeriesSlot(fileCtx, frames);
+    frames++;
+    if(!sampled) {
+      if(series_slot.isValid()) {
+        series_slot.setSkipped();
+      }
+      fileCtx->incFramesSkipped();
+      continue;
+    }
+    // a stream has no timestamps
+    if(series_slot.isValid()) {
+      newJob->setSeriesSlot(series_slot);
+    }
+    fileCtx->incFramesRead();
+    if(detecting) {
+      detecting = !fileCtx->detectLetterbox(*newJob);
+      held.push_back(std::move(newJob));
+      if(detecting) {
+        // held buffers do not come back to the pool until the region is known
+        frame_pool_->grow(1);
+        grown++;
+        continue;
+      }
+      sendHeldJobs(pending, held, grown, fileCtx);
+      continue;
+    }
+    sendFrameJob(pending, std::move(newJob), fileCtx);
+  }
+  if(detecting) {
+    fileCtx->finishLetterbox();
+    sendHeldJobs(pending, held, grown, fileCtx);
+  }
+  finishSegment(fileCtx, takeLastJob(pending));
+}
+
+/*
+  Raw video files (.yuv, .y4m) are mapped into memory instead of being decoded.
+  Jobs are created with frames pointing straight into the mapping, nothing is read or copied
+  here. Frame buffers from the pool are not used, the number of jobs is limited by the scheduler.
+  Each job keeps the mapping alive, so it is unmapped when the last frame has been processed.
+*/
+void CalcLumReader::readMappedFile(std::shared_ptr<CalcLumFileCtx> fileCtx) {
+  std::shared_ptr<CalcLumMappedVideo> video = std::make_shared<CalcLumMappedVideo>();
+  if (!video->open(fileCtx->getFileName(), config_.raw_format)) {
+    std::cout << fileCtx->getFileName() << "->> Invalid raw video file (use -g and -F for .yuv files)" << std::endl;
+    fileCtx->setError();
+    fileCtx->setFinished();
+    return;
+  }
+  startFile(fileCtx);
+
+  const CalcLumRawFormat& format = video->getFormat();
+  // cv::Mat only points to the frame. It is never written.
+  auto frameAt = [&](int frame) {
+    return cv::Mat(format.getMatRows(), format.getMatCols(), CV_8UC(format.getChannels()),
+                   const_cast<uint8_t*>(video->getFrame(frame)));
+  };
+  if (isLetterbox()) {
+    // the region is set before any job of the file is sent
+    std::unique_ptr<CalcLumFrameJob> job = newFrameJob(format.isPlanar(), format.height);
+    for (int frame = 0; frame < video->getFramesNum(); frame++) {
+      job->getFrame() = frameAt(frame);
+      if (fileCtx->detectLetterbox(*job)) {
+        break;
+      }
+    }
+    fileCtx->finishLetterbox();
+  }
+
+  PendingJobs pending;
+  for (int frame = 0; frame < video->getFramesNum(); frame++) {
+    CalcLumSeriesSlot series_slot = getSeriesSlot(fileCtx, frame);
+    if ((1 < config_.frame_step) && (0 != frame % config_.frame_step)) {
+      if (series_slot.isValid()) {
+        series_slot.setSkipped();
+      }
+      fileCtx->incFramesSkipped();
+      continue;
+    }
+    std::unique_ptr<CalcLumFrameJob> newJob = newFrameJob(format.isPlanar(), format.height);
+    newJob->getFrame() = frameAt(frame);
+    newJob->setFrameOwner(video);
+    if (series_slot.isValid()) {
+      newJob->setSeriesSlot(series_slot);
+    }
+    fileCtx->incFramesRead();
+    sendFrameJob(pending, std::move(newJob), fileCtx);
+  }
+  finishSegment(fileCtx, takeLastJob(pending));
+}
+
+/*
+  Called when a segment (or the whole file) has been read.
+  When it is the last segment of the file, EOF is set in the file context.
+  Then the last job is sent. EOF is set now, so we get notified when the last frame has been processed.
+  If there is no job to send, end of file processing is checked here.
+*/
+void CalcLumReader::finishSegment(std::shared_ptr<CalcLumFileCtx> fileCtx,
+                                  std::unique_ptr<CalcLumJob> last_job) {
+  if (fileCtx->segmentRead()) {
+    if (0 == fileCtx->getFramesRead()) {
+      // file was opened, but not a single frame could be read from it
+      std::cout << fileCtx->getFileName() << "->> No frames found" << std::endl;
+      fileCtx->setError();
+    }
+    // mark that entire file has been read
+    fileCtx->setEOF();
+  }
+
+  if (nullptr != last_job) {
+    scheduler_.addJob(std::move(last_job));
+  } else {
+    fileCtx->signalEnd();
+  }
+}
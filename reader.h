@@ -0,0 +1,154 @@
+#pragma once
+#include <vector>
+#include <list>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <chrono>
+#include "frameJob.h"
+#include "scheduler.h"
+#include "config.h"
+#include "rawFrame.h"
+#include "rawVideo.h"
+
+/*
+  CalcLumReader class reads video files and sends their frames to the scheduler.
+  It runs a pool of reader threads. Each reader thread takes the next file from the queue,
+  opens its own cv::VideoCapture and reads the file frame by frame.
+  This way several files are decoded in parallel.
+  Long files can also be split into segments. Each segment is read by a different
+  reader thread with its own cv::VideoCapture seeked to the first frame of the segment.
+  Raw video files (.yuv, .y4m) are not decoded, they are mapped into memory.
+  Files which do not look like a video (see CalcLumSniffer) are not opened at all.
+
+  A watchdog thread checks how long each reader has been inside a decoder call. When it is
+  longer than the decode timeout, the file is abandoned with an error and the reader thread
+  is replaced by a new one. The stuck thread cannot be stopped, it is left running and exits
+  when the decoder returns.
+*/
+class CalcLumReader {
+public:
+  CalcLumReader() = delete;
+  CalcLumReader(CalcLumScheduler& scheduler, const CalcLumConfig& config, int readers_num);
+  ~CalcLumReader();
+
+  // Sync vars are passed to each file context. They are used to signal that all frames
+  // from a file have been processed. See CalcLumFileCtx::setSyncVars.
+  void setSyncVars(std::shared_ptr<std::condition_variable> cv, std::shared_ptr<std::mutex> cv_m,
+                   std::shared_ptr<int> files_counter) { cv_ = cv; cv_m_ = cv_m; files_counter_ = files_counter; }
+  // Reader threads are pinned to CPUs of a node, spread evenly over all nodes.
+  // Must be called before start.
+  void setTopology(std::shared_ptr<const CalcLumTopology> topology) { topology_ = topology; }
+  // Decoding time and time waiting for frame buffers are recorded. It is passed to file contexts too.
+  void setProfiler(std::shared_ptr<CalcLumProfiler> profiler) { profiler_ = profiler; }
+  // Each file read gets its time series in the writer. Frames get their timestamps from the decoder.
+  void setSeriesWriter(std::shared_ptr<CalcLumSeriesWriter> series_writer) { series_writer_ = series_writer; }
+  void start();
+  int getReadersNum() const { return threads_.size(); }
+  std::shared_ptr<CalcLumFramePool> getFramePool() const { return frame_pool_; }
+
+  // Adds a file to the queue of files to be read.
+  void addFile(std::shared_ptr<CalcLumFileCtx> file_ctx);
+  // Reads raw frames from a stream and sends them to the scheduler. See readRawStream in reader.cc.
+  void readRawStream(int fd, std::shared_ptr<CalcLumFileCtx> file_ctx, const CalcLumRawFormat& format);
+  // Indicates that no more files will be added and waits until reader threads
+  // have read all queued files. Stuck readers are abandoned meanwhile.
+  void finish();
+
+private:
+  CalcLumScheduler& scheduler_;
+  CalcLumConfig config_;
+  int readers_num_;
+  std::vector<std::unique_ptr<std::thread> > threads_;
+  // frame buffers shared by all reader threads
+  std::shared_ptr<CalcLumFramePool> frame_pool_;
+  // largest number of frames in a job, auto batches included
+  int batch_size_;
+  // when set, reader threads are pinned to CPUs
+  std::shared_ptr<const CalcLumTopology> topology_;
+  // when set, reading is measured
+  std::shared_ptr<CalcLumProfiler> profiler_;
+  // when set, luminance of each frame is written
+  std::shared_ptr<CalcLumSeriesWriter> series_writer_;
+
+  std::shared_ptr<std::condition_variable> cv_;
+  std::shared_ptr<std::mutex> cv_m_;
+  std::shared_ptr<int> files_counter_;
+
+  // A piece of work for a reader thread: a whole file or a segment of it.
+  struct ReadTask {
+    std::shared_ptr<CalcLumFileCtx> file_ctx;
+    // first frame of the segment
+    int first_frame{0};
+    // number of frames in the segment. -1 means read until end of file.
+    int frames_num{-1};
+  };
+
+  // queue of files and segments waiting to be read, guarded by files_m_
+  std::mutex files_m_;
+  std::condition_variable files_cv_;
+  std::list<ReadTask> tasks_;
+  // set when no more files will be added to the queue
+  bool no_more_files_{false};
+  // number of reader threads reading a file. A busy reader may still add segments to the queue.
+  int busy_readers_{0};
+  // number of reader threads which have not exited yet, abandoned ones are not counted
+  int live_readers_{0};
+
+  // State of a reader thread watched by the watchdog. It is shared with the thread, so an abandoned
+  // thread can check it after the reader has been destroyed.
+  struct ReaderSlot {
+    std::mutex m;
+    // set while the reader is inside a decoder call, since tells for how long
+    bool in_decoder{false};
+    std::chrono::steady_clock::time_point since;
+    std::shared_ptr<CalcLumFileCtx> file_ctx;
+    bool abandoned{false};
+
+    void enter(std::shared_ptr<CalcLumFileCtx> file_ctx);
+    // Returns false when the thread has been abandoned. It must exit then without touching the reader.
+    bool leave();
+    bool isAbandoned();
+  };
+  // one slot per reader thread, guarded by files_m_
+  std::vector<std::shared_ptr<ReaderSlot> > slots_;
+  std::unique_ptr<std::thread> watchdog_;
+  std::condition_variable watchdog_cv_;
+  // guarded by files_m_
+  bool stop_watchdog_{false};
+
+  // Jobs of a segment not sent to the scheduler yet.
+  struct PendingJobs {
+    std::unique_ptr<CalcLumJob> last_job;
+    std::unique_ptr<CalcLumBatchJob> batch;
+    // number of frames in a job. 0 means it is not known until the first frame has been read
+    int batch_size{0};
+  };
+
+  bool getNextTask(ReadTask& task);
+  void taskDone();
+  void startFile(std::shared_ptr<CalcLumFileCtx> file_ctx);
+  static CalcLumSeriesSlot getSeriesSlot(std::shared_ptr<CalcLumFileCtx> file_ctx, int frame);
+  void readFile(ReadTask task, ReaderSlot& slot);
+  bool openCapture(cv::VideoCapture& vc, const cv::String& fileName);
+  int setupCapture(cv::VideoCapture& vc, const cv::String& fileName);
+  int splitFile(cv::VideoCapture& vc, std::shared_ptr<CalcLumFileCtx> file_ctx);
+  bool isLetterbox() const { return (nullptr != config_.roi) && (CalcLumRoiMode::Letterbox == config_.roi->getMode()); }
+  bool detectLetterbox(cv::VideoCapture& vc, std::shared_ptr<CalcLumFileCtx> file_ctx, int luma_rows, ReaderSlot& slot);
+  void readSegment(cv::VideoCapture& vc, std::shared_ptr<CalcLumFileCtx> file_ctx, int first_frame, int frames_num,
+                   int luma_rows, ReaderSlot& slot);
+  void readMappedFile(std::shared_ptr<CalcLumFileCtx> file_ctx);
+  void finishSegment(std::shared_ptr<CalcLumFileCtx> file_ctx, std::unique_ptr<CalcLumJob> last_job);
+  int getBatchSize(const cv::Mat& frame) const;
+  std::unique_ptr<CalcLumFrameJob> newFrameJob(bool y_plane, int luma_rows) const;
+  std::unique_ptr<CalcLumFrameJob> createJob(bool y_plane, int luma_rows);
+  void sendFrameJob(PendingJobs& pending, std::unique_ptr<CalcLumFrameJob> job, std::shared_ptr<CalcLumFileCtx> file_ctx);
+  void sendHeldJobs(PendingJobs& pending, std::vector<std::unique_ptr<CalcLumFrameJob> >& held, int grown,
+                    std::shared_ptr<CalcLumFileCtx> file_ctx);
+  std::unique_ptr<CalcLumJob> takeLastJob(PendingJobs& pending);
+  static bool seekToFrame(cv::VideoCapture& vc, int frame);
+  void checkReader(int reader, std::chrono::steady_clock::duration timeout);
+  static void readerFunc(CalcLumReader *, int reader, std::shared_ptr<ReaderSlot> slot);
+  static void watchdogFunc(CalcLumReader *);
+};
@@ -0,0 +1,185 @@
+#include "resultCache.h"
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <climits>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+static const char kCacheMagic[8] = {'C', 'L', 'C', 'A', 'C', 'H', 'E', '\0'};
+static const uint32_t kCacheVersion = 2;
+
+template <typename T>
+static void writeValue(std::ofstream& out, const T& value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+static bool readValue(std::ifstream& in, T& value) {
+  return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+// Creates all missing directories of the path, like mkdir -p.
+static void makeDirs(const std::string& dir) {
+  for (size_t pos = dir.find('/', 1); ; pos = dir.find('/', pos + 1)) {
+    mkdir(dir.substr(0, pos).c_str(), 0755);
+    if (std::string::npos == pos) {
+      break;
+    }
+  }
+}
+
+bool CalcLumFileIdentity::fromFile(const std::string& path, CalcLumFileIdentity& identity) {
+  struct stat file_stat;
+  // only regular files can be cached. A pipe may look the same next time, but carry other frames.
+  if ((0 != stat(path.c_str(), &file_stat)) || !S_ISREG(file_stat.st_mode)) {
+    return false;
+  }
+  identity.size = file_stat.st_size;
+  identity.mtime_sec = file_stat.st_mtim.tv_sec;
+  identity.mtime_nsec = file_stat.st_mtim.tv_nsec;
+  identity.inode = file_stat.st_ino;
+  identity.device = file_stat.st_dev;
+  return true;
+}
+
+CalcLumResultCache::CalcLumResultCache(const std::string& cache_path, const std::string& params_signature) :
+  cache_path_(cache_path), params_signature_(params_signature) {
+}
+
+std::string CalcLumResultCache::getDefaultPath() {
+  const char* cache_home = std::getenv("XDG_CACHE_HOME");
+  if ((nullptr != cache_home) && ('\0' != cache_home[0])) {
+    return std::string(cache_home) + "/calclum/results.bin";
+  }
+  const char* home = std::getenv("HOME");
+  return std::string((nullptr != home) ? home : ".") + "/.cache/calclum/results.bin";
+}
+
+/*
+  Same file may be given with different relative paths. Absolute path is used as the key.
+*/
+std::string CalcLumResultCache::makeKey(const std::string& file_path) const {
+  char resolved[PATH_MAX];
+  std::string path = (nullptr != realpath(file_path.c_str(), resolved)) ? std::string(resolved) : file_path;
+  return params_signature_ + '\n' + path;
+}
+
+bool CalcLumResultCache::lookup(const std::string& file_path, CalcLumStats& stats, int& frames_total) const {
+  CalcLumFileIdentity identity;
+  // a removed file never matches
+  return CalcLumFileIdentity::fromFile(file_path, identity) && lookup(file_path, identity, stats, frames_total);
+}
+
+bool CalcLumResultCache::lookup(const std::string& file_path, const CalcLumFileIdentity& identity,
+                                CalcLumStats& stats, int& frames_total) const {
+  auto it = entries_.find(makeKey(file_path));
+  if ((entries_.end() == it) || !(identity == it->second.identity)) {
+    // file has been modified or replaced
+    return false;
+  }
+  stats = it->second.stats;
+  frames_total = it->second.frames_total;
+  return true;
+}
+
+void CalcLumResultCache::store(const std::string& file_path, const CalcLumStats& stats, int frames_total) {
+  CalcLumFileIdentity identity;
+  if (CalcLumFileIdentity::fromFile(file_path, identity)) {
+    store(file_path, identity, stats, frames_total);
+  }
+}
+
+void CalcLumResultCache::store(const std::string& file_path, const CalcLumFileIdentity& identity,
+                               const CalcLumStats& stats, int frames_total) {
+  Entry entry;
+  entry.identity = identity;
+  entry.stats = stats;
+  entry.frames_total = frames_total;
+  entries_[makeKey(file_path)] = entry;
+}
+
+/*
+  File layout: magic, version, number of entries and then entries one by one.
+  Entry: key length and key, file identity, number of frames and statistics (see CalcLumStats::write).
+*/
+bool CalcLumResultCache::load() {
+  entries_.clear();
+  std::ifstream in(cache_path_, std::ios::binary);
+  if (!in) {
+    return false;
+  }
+
+  char magic[sizeof(kCacheMagic)];
+  uint32_t version = 0;
+  uint64_t entries_num = 0;
+  if (!in.read(magic, sizeof(magic)) || (0 != std::memcmp(magic, kCacheMagic, sizeof(magic))) ||
+      !readValue(in, version) || (kCacheVersion != version) || !readValue(in, entries_num)) {
+    return false;
+  }
+
+  std::map<std::string, Entry> entries;
+  for (uint64_t counter = 0; counter < entries_num; counter++) {
+    uint32_t key_len = 0;
+    if (!readValue(in, key_len) || (key_len > 65536)) {
+      return false;
+    }
+    std::string key(key_len, '\0');
+    Entry entry;
+    CalcLumFileIdentity& id = entry.identity;
+    if (!in.read(&key[0], key_len) ||
+        !readValue(in, id.size) || !readValue(in, id.mtime_sec) || !readValue(in, id.mtime_nsec) ||
+        !readValue(in, id.inode) || !readValue(in, id.device) || !readValue(in, entry.frames_total) ||
+        !entry.stats.read(in)) {
+      // truncated file. Do not use any entry, they may be partially written.
+      return false;
+    }
+    entries[key] = entry;
+  }
+  entries_.swap(entries);
+  return true;
+}
+
+bool CalcLumResultCache::save() const {
+  size_t slash = cache_path_.rfind('/');
+  if ((std::string::npos != slash) && (0 != slash)) {
+    makeDirs(cache_path_.substr(0, slash));
+  }
+
+  // Write to a temporary file first. Rename is atomic, so readers see either the old or the new cache.
+  std::string tmp_path = cache_path_ + ".tmp." + std::to_string(getpid());
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      return false;
+    }
+    out.write(kCacheMagic, sizeof(kCacheMagic));
+    writeValue(out, kCacheVersion);
+    writeValue(out, static_cast<uint64_t>(entries_.size()));
+    for (const auto& it : entries_) {
+      const CalcLumFileIdentity& id = it.second.identity;
+      writeValue(out, static_cast<uint32_t>(it.first.size()));
+      out.write(it.first.data(), it.first.size());
+      writeValue(out, id.size);
+      writeValue(out, id.mtime_sec);
+      writeValue(out, id.mtime_nsec);
+      writeValue(out, id.inode);
+      writeValue(out, id.device);
+      writeValue(out, it.second.frames_total);
+      it.second.stats.write(out);
+    }
+    out.flush();
+    if (!out) {
+      out.close();
+      unlink(tmp_path.c_str());
+      return false;
+    }
+  }
+  if (0 != rename(tmp_path.c_str(), cache_path_.c_str())) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
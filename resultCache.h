@@ -0,0 +1,77 @@
+#pragma once
+#include <string>
+#include <map>
+#include "stats.h"
+
+/*
+  Identity of a file on disk. When any of these changes, the file is processed again.
+*/
+struct CalcLumFileIdentity {
+  long long size{0};
+  long long mtime_sec{0};
+  long long mtime_nsec{0};
+  long long inode{0};
+  long long device{0};
+
+  bool operator==(const CalcLumFileIdentity& other) const {
+    return (size == other.size) && (mtime_sec == other.mtime_sec) && (mtime_nsec == other.mtime_nsec) &&
+           (inode == other.inode) && (device == other.device);
+  }
+  // Reads identity of the file with stat(). Returns false when the file cannot be accessed
+  // or it is not a regular file.
+  static bool fromFile(const std::string& path, CalcLumFileIdentity& identity);
+};
+
+/*
+  Persistent cache of per-file statistics. Files which have not changed since the last run
+  are not decoded again, their statistics are taken from the cache.
+
+  An entry is keyed by the absolute path of the file and by a signature of the parameters
+  which change the results (e.g. sampling). It is valid only when the file identity
+  (size, mtime, inode, device) is the same as when the entry was stored.
+
+  The cache is a compact binary file. It is read once at startup and written once at exit,
+  to a temporary file renamed over the old one, so an interrupted run never leaves a broken cache.
+  The file uses native byte order, it is not meant to be moved between machines.
+  Methods are not thread safe. The cache is used only by the main thread.
+*/
+class CalcLumResultCache {
+public:
+  CalcLumResultCache() = delete;
+  CalcLumResultCache(const std::string& cache_path, const std::string& params_signature);
+
+  // Default location: $XDG_CACHE_HOME/calclum/results.bin or ~/.cache/calclum/results.bin
+  static std::string getDefaultPath();
+
+  // Reads entries from the cache file. Returns false when the file does not exist or is not valid.
+  // The cache is empty then.
+  bool load();
+  // Writes all entries to the cache file. Missing directories are created.
+  bool save() const;
+
+  // Returns true and fills stats when the file has not changed since it was stored.
+  bool lookup(const std::string& file_path, CalcLumStats& stats, int& frames_total) const;
+  // Same, with identity of the file read by the caller.
+  bool lookup(const std::string& file_path, const CalcLumFileIdentity& identity, CalcLumStats& stats,
+              int& frames_total) const;
+  void store(const std::string& file_path, const CalcLumStats& stats, int frames_total);
+  // Stores stats under the identity the file had when it was read. When the file changes later,
+  // the entry does not match it.
+  void store(const std::string& file_path, const CalcLumFileIdentity& identity, const CalcLumStats& stats,
+             int frames_total);
+  size_t getEntriesNum() const { return entries_.size(); }
+
+private:
+  struct Entry {
+    CalcLumFileIdentity identity;
+    int frames_total{0};
+    CalcLumStats stats;
+  };
+
+  std::string cache_path_;
+  std::string params_signature_;
+  // key is params signature and absolute path of the file
+  std::map<std::string, Entry> entries_;
+
+  std::string makeKey(const std::string& file_path) const;
+};
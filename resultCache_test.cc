@@ -0,0 +1,154 @@
+/*
+  Set of unit tests for the persistent result cache.
+*/
+#include <gtest/gtest.h>
+#include <fstream>
+#include <cstdlib>
+#include <unistd.h>
+#include "resultCache.h"
+
+// Each test works in its own temporary directory.
+class ResultCacheTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    char dir_template[] = "/tmp/calclum_cache_XXXXXX";
+    dir_ = mkdtemp(dir_template);
+    video_ = dir_ + "/video.mp4";
+    writeFile(video_, "0123456789");
+    cache_path_ = dir_ + "/cache/results.bin";
+  }
+
+  void TearDown() override {
+    std::string cmd = "rm -rf " + dir_;
+    ASSERT_EQ(0, system(cmd.c_str()));
+  }
+
+  static void writeFile(const std::string& path, const std::string& content) {
+    std::ofstream out(path, std::ios::trunc);
+    out << content;
+  }
+
+  static CalcLumStats someStats() {
+    CalcLumStats stats;
+    stats.addFrame(10);
+    stats.addFrame(200);
+    stats.addFrame(200);
+    return stats;
+  }
+
+  std::string dir_;
+  std::string video_;
+  std::string cache_path_;
+};
+
+TEST_F(ResultCacheTest, missingCacheIsEmpty) {
+  CalcLumResultCache cache(cache_path_, "params");
+  ASSERT_FALSE(cache.load());
+  ASSERT_EQ(0u, cache.getEntriesNum());
+}
+
+TEST_F(ResultCacheTest, storedStatsSurviveSaveAndLoad) {
+  {
+    CalcLumResultCache cache(cache_path_, "params");
+    cache.store(video_, someStats(), 5);
+    ASSERT_TRUE(cache.save());
+  }
+
+  CalcLumResultCache cache(cache_path_, "params");
+  ASSERT_TRUE(cache.load());
+  CalcLumStats stats;
+  int frames_total = 0;
+  ASSERT_TRUE(cache.lookup(video_, stats, frames_total));
+  ASSERT_EQ(5, frames_total);
+  ASSERT_EQ(3, stats.frames);
+  ASSERT_EQ(410, stats.luminance);
+  ASSERT_EQ(10, stats.min_luminance);
+  ASSERT_EQ(200, stats.max_luminance);
+  ASSERT_EQ(2, stats.median_set[200]);
+  ASSERT_EQ(1, stats.median_set[10]);
+  // different paths of the same file are the same entry
+  ASSERT_TRUE(cache.lookup(dir_ + "/../" + dir_.substr(dir_.rfind('/') + 1) + "/./video.mp4", stats, frames_total));
+}
+
+TEST_F(ResultCacheTest, exactStatsSurviveSaveAndLoad) {
+  CalcLumStats exact;
+  exact.addFrameFixed((10 << kLumaFixedShift) + 1000);
+  exact.addFrameFixed((200 << kLumaFixedShift) + 40000);
+  {
+    CalcLumResultCache cache(cache_path_, "params");
+    cache.store(video_, exact, 2);
+    ASSERT_TRUE(cache.save());
+  }
+
+  CalcLumResultCache cache(cache_path_, "params");
+  ASSERT_TRUE(cache.load());
+  CalcLumStats stats;
+  int frames_total = 0;
+  ASSERT_TRUE(cache.lookup(video_, stats, frames_total));
+  ASSERT_TRUE(stats.isExact());
+  ASSERT_EQ(exact.luminance_fixed, stats.luminance_fixed);
+  ASSERT_EQ(exact.min_fixed, stats.min_fixed);
+  ASSERT_EQ(exact.max_fixed, stats.max_fixed);
+  ASSERT_EQ(exact.fine_set, stats.fine_set);
+  ASSERT_EQ(210, stats.luminance);
+}
+
+TEST_F(ResultCacheTest, modifiedFileIsProcessedAgain) {
+  CalcLumResultCache cache(cache_path_, "params");
+  cache.store(video_, someStats(), 3);
+  writeFile(video_, "01234567890123");
+
+  CalcLumStats stats;
+  int frames_total = 0;
+  ASSERT_FALSE(cache.lookup(video_, stats, frames_total));
+}
+
+// Stats are stored under the identity the file had when it was found. A file written again
+// while it was being read does not match them.
+TEST_F(ResultCacheTest, fileChangedWhileReadIsProcessedAgain) {
+  CalcLumFileIdentity found;
+  ASSERT_TRUE(CalcLumFileIdentity::fromFile(video_, found));
+  writeFile(video_, "01234567890123");
+
+  CalcLumResultCache cache(cache_path_, "params");
+  cache.store(video_, found, someStats(), 3);
+  CalcLumStats stats;
+  int frames_total = 0;
+  ASSERT_FALSE(cache.lookup(video_, stats, frames_total));
+  ASSERT_TRUE(cache.lookup(video_, found, stats, frames_total));
+  ASSERT_EQ(3, frames_total);
+}
+
+TEST_F(ResultCacheTest, differentParamsDoNotMatch) {
+  {
+    CalcLumResultCache cache(cache_path_, "sample_step=4");
+    cache.store(video_, someStats(), 3);
+    ASSERT_TRUE(cache.save());
+  }
+
+  CalcLumResultCache cache(cache_path_, "sample_step=1");
+  ASSERT_TRUE(cache.load());
+  CalcLumStats stats;
+  int frames_total = 0;
+  ASSERT_FALSE(cache.lookup(video_, stats, frames_total));
+  // entries of other params are kept
+  ASSERT_EQ(1u, cache.getEntriesNum());
+}
+
+TEST_F(ResultCacheTest, truncatedCacheIsIgnored) {
+  {
+    CalcLumResultCache cache(cache_path_, "params");
+    cache.store(video_, someStats(), 3);
+    ASSERT_TRUE(cache.save());
+  }
+  ASSERT_EQ(0, truncate(cache_path_.c_str(), 40));
+
+  CalcLumResultCache cache(cache_path_, "params");
+  ASSERT_FALSE(cache.load());
+  ASSERT_EQ(0u, cache.getEntriesNum());
+}
+
+int main(int argc, char **argv) {
+ ::testing::InitGoogleTest(&argc, argv);
+ return RUN_ALL_TESTS();
+}
@@ -0,0 +1,181 @@
+#include "roi.h"
+#include "lumaKernel.h"
+#include <algorithm>
+#include <cstdlib>
+
+CalcLumRect CalcLumRect::clip(int rows, int cols) const {
+  int left = std::max(x, 0);
+  int top = std::max(y, 0);
+  int right = std::min(x + width, cols);
+  int bottom = std::min(y + height, rows);
+  if ((right <= left) || (bottom <= top)) {
+    return CalcLumRect();
+  }
+  return CalcLumRect(left, top, right - left, bottom - top);
+}
+
+bool CalcLumRect::parse(const std::string& rect) {
+  int values[4];
+  size_t pos = 0;
+  for (auto i = 0; i < 4; i++) {
+    char* end = nullptr;
+    long value = std::strtol(rect.c_str() + pos, &end, 10);
+    size_t next = end - rect.c_str();
+    char separator = (i < 3) ? ',' : '\0';
+    if ((next == pos) || (rect.c_str()[next] != separator) || (value < 0) || (value > 65535)) {
+      return false;
+    }
+    values[i] = value;
+    pos = next + 1;
+  }
+  if ((0 == values[2]) || (0 == values[3])) {
+    return false;
+  }
+  *this = CalcLumRect(values[0], values[1], values[2], values[3]);
+  return true;
+}
+
+CalcLumRoiSpec CalcLumRoiSpec::fromRect(const CalcLumRect& rect) {
+  CalcLumRoiSpec spec;
+  spec.mode_ = CalcLumRoiMode::Rect;
+  spec.rect_ = rect;
+  return spec;
+}
+
+CalcLumRoiSpec CalcLumRoiSpec::fromMask(int rows, int cols, std::vector<uint8_t> mask) {
+  CalcLumRoiSpec spec;
+  spec.mode_ = CalcLumRoiMode::Mask;
+  spec.mask_rows_ = rows;
+  spec.mask_cols_ = cols;
+  spec.mask_ = std::move(mask);
+  return spec;
+}
+
+CalcLumRoiSpec CalcLumRoiSpec::letterbox() {
+  CalcLumRoiSpec spec;
+  spec.mode_ = CalcLumRoiMode::Letterbox;
+  return spec;
+}
+
+std::shared_ptr<const CalcLumRoi> CalcLumRoiSpec::resolve(int rows, int cols) const {
+  CalcLumRect frame(0, 0, cols, rows);
+  if (CalcLumRoiMode::Mask == mode_) {
+    std::shared_ptr<const CalcLumRoi> roi = resolveMask(rows, cols);
+    return (nullptr != roi) ? roi : std::make_shared<CalcLumRoi>(frame);
+  }
+  CalcLumRect rect = (CalcLumRoiMode::Rect == mode_) ? rect_.clip(rows, cols) : frame;
+  return std::make_shared<CalcLumRoi>(rect.isEmpty() ? frame : rect);
+}
+
+/*
+  Mask is scaled to the frame size by taking the nearest mask pixel. Only the bounding box of the used
+  pixels is read by the kernels. When all pixels of the box are used, the mask is dropped, the box
+  alone gives the same result with the faster unmasked kernels.
+*/
+std::shared_ptr<const CalcLumRoi> CalcLumRoiSpec::resolveMask(int rows, int cols) const {
+  if ((0 == mask_rows_) || (0 == mask_cols_)) {
+    return nullptr;
+  }
+  std::vector<uint8_t> scaled(static_cast<size_t>(rows) * cols);
+  int top = rows, bottom = -1, left = cols, right = -1;
+  for (auto i = 0; i < rows; i++) {
+    const uint8_t* mask_row = mask_.data() + static_cast<size_t>(i) * mask_rows_ / rows * mask_cols_;
+    uint8_t* row = scaled.data() + static_cast<size_t>(i) * cols;
+    for (auto j = 0; j < cols; j++) {
+      row[j] = (0 != mask_row[static_cast<size_t>(j) * mask_cols_ / cols]) ? 0xff : 0;
+      if (0 != row[j]) {
+        top = std::min(top, i);
+        bottom = i;
+        left = std::min(left, j);
+        right = std::max(right, j);
+      }
+    }
+  }
+  if (bottom < 0) {
+    return nullptr;
+  }
+
+  CalcLumRect rect(left, top, right - left + 1, bottom - top + 1);
+  std::vector<uint8_t> mask;
+  mask.reserve(static_cast<size_t>(rect.width) * rect.height);
+  for (auto i = top; i <= bottom; i++) {
+    const uint8_t* row = scaled.data() + static_cast<size_t>(i) * cols;
+    mask.insert(mask.end(), row + left, row + right + 1);
+  }
+  if (std::all_of(mask.begin(), mask.end(), [](uint8_t value) { return 0 != value; })) {
+    return std::make_shared<CalcLumRoi>(rect);
+  }
+  return std::make_shared<CalcLumRoi>(rect, std::move(mask));
+}
+
+std::string CalcLumRoiSpec::getSignature() const {
+  switch (mode_) {
+  case CalcLumRoiMode::Rect:
+    return "rect:" + std::to_string(rect_.x) + "," + std::to_string(rect_.y) + "," +
+           std::to_string(rect_.width) + "," + std::to_string(rect_.height);
+  case CalcLumRoiMode::Mask: {
+    // FNV-1a of the used pixels, the values themselves do not matter
+    uint64_t checksum = 14695981039346656037ull;
+    for (auto value : mask_) {
+      checksum = (checksum ^ ((0 != value) ? 1 : 0)) * 1099511628211ull;
+    }
+    return "mask:" + std::to_string(mask_cols_) + "x" + std::to_string(mask_rows_) + ":" + std::to_string(checksum);
+  }
+  case CalcLumRoiMode::Letterbox:
+    return "letterbox";
+  default:
+    return "frame";
+  }
+}
+
+/*
+  Rows are checked first. Columns are checked only between the top and bottom bars,
+  otherwise bars would lower the average of every column.
+  luma(row, j) returns luminance of j-th pixel of the row.
+*/
+template <typename LumaFunc>
+static CalcLumRect detectLetterbox(const uint8_t* data, int rows, int cols, size_t step, LumaFunc luma) {
+  int top = -1, bottom = -1;
+  for (auto i = 0; i < rows; i++) {
+    const uint8_t* row = data + i * step;
+    unsigned long long sum = 0;
+    for (auto j = 0; j < cols; j++) {
+      sum += luma(row, j);
+    }
+    if (sum > static_cast<unsigned long long>(kLetterboxLimit) * cols) {
+      top = (top < 0) ? i : top;
+      bottom = i;
+    }
+  }
+  if ((top < 0) || ((bottom - top + 1) * kLetterboxMinContent < rows)) {
+    return CalcLumRect();
+  }
+
+  std::vector<unsigned long long> col_sums(cols, 0);
+  for (auto i = top; i <= bottom; i++) {
+    const uint8_t* row = data + i * step;
+    for (auto j = 0; j < cols; j++) {
+      col_sums[j] += luma(row, j);
+    }
+  }
+  unsigned long long limit = static_cast<unsigned long long>(kLetterboxLimit) * (bottom - top + 1);
+  int left = 0, right = cols - 1;
+  while ((left < cols) && (col_sums[left] <= limit)) {
+    left++;
+  }
+  while ((right > left) && (col_sums[right] <= limit)) {
+    right--;
+  }
+  if ((right - left + 1) * kLetterboxMinContent < cols) {
+    return CalcLumRect();
+  }
+  return CalcLumRect(left, top, right - left + 1, bottom - top + 1);
+}
+
+CalcLumRect detectLetterboxBGR(const uint8_t* data, int rows, int cols, size_t step) {
+  return detectLetterbox(data, rows, cols, step, [](const uint8_t* row, int j) { return lumaOfBGR(row + j * 3); });
+}
+
+CalcLumRect detectLetterboxPlane(const uint8_t* data, int rows, int cols, size_t step, int pixel_step) {
+  return detectLetterbox(data, rows, cols, step, [pixel_step](const uint8_t* row, int j) { return row[j * pixel_step]; });
+}
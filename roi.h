@@ -0,0 +1,106 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+/*
+  Rectangle in frame coordinates. x and y are the column and row of its top left pixel.
+*/
+struct CalcLumRect {
+  int x{0};
+  int y{0};
+  int width{0};
+  int height{0};
+
+  CalcLumRect() = default;
+  CalcLumRect(int x, int y, int width, int height) : x(x), y(y), width(width), height(height) {}
+  bool isEmpty() const { return (width <= 0) || (height <= 0); }
+  bool operator==(const CalcLumRect& other) const {
+    return (x == other.x) && (y == other.y) && (width == other.width) && (height == other.height);
+  }
+  // Returns the part of the rectangle which is inside a frame of rows x cols pixels.
+  CalcLumRect clip(int rows, int cols) const;
+  // Parses rectangle given as X,Y,WIDTH,HEIGHT, e.g. 0,140,1920,800.
+  bool parse(const std::string& rect);
+};
+
+/*
+  Region of interest of frames of one size: a rectangle and optionally a mask of it.
+  Only pixels inside the rectangle are read. When there is a mask, only pixels whose mask is set are used.
+  Mask has one byte per pixel of the rectangle, rows of width bytes one after another,
+  and each byte is 0 (not used) or 0xff (used), so kernels can use it without branches.
+*/
+class CalcLumRoi {
+public:
+  CalcLumRoi() = delete;
+  CalcLumRoi(const CalcLumRect& rect) : rect_(rect) {}
+  CalcLumRoi(const CalcLumRect& rect, std::vector<uint8_t> mask) : rect_(rect), mask_(std::move(mask)) {}
+
+  const CalcLumRect& getRect() const { return rect_; }
+  bool isMasked() const { return !mask_.empty(); }
+  const uint8_t* getMask() const { return mask_.data(); }
+
+private:
+  CalcLumRect rect_;
+  std::vector<uint8_t> mask_;
+};
+
+/*
+  How the region of interest is selected:
+   - Frame: the whole frame is used
+   - Rect: fixed rectangle, cut to the frame size
+   - Mask: image with non zero pixels marking the region, scaled to the frame size when it differs
+   - Letterbox: black bars at the edges of the frame are detected and left out
+*/
+enum class CalcLumRoiMode { Frame, Rect, Mask, Letterbox };
+
+// Average luminance of a row or column of a black bar is not above the limit. Video black is 16.
+const int kLetterboxLimit = 24;
+// Bars are not detected when less than 1/kLetterboxMinContent of the width or height would be left,
+// such frame is most likely a dark scene.
+const int kLetterboxMinContent = 4;
+// Number of frames letterbox detection is tried on. When none of them is bright enough to tell
+// the bars, the whole frame is used.
+const int kLetterboxAttempts = 50;
+
+/*
+  Region of interest given on the command line. It is the same for all files. Files may have
+  different frame sizes, so the region is resolved for the size of each file (see resolve).
+  Letterbox is detected from frame data by the reader instead (see CalcLumFileCtx::detectLetterbox).
+*/
+class CalcLumRoiSpec {
+public:
+  CalcLumRoiSpec() = default;
+  static CalcLumRoiSpec fromRect(const CalcLumRect& rect);
+  // Mask of rows x cols pixels, one byte per pixel without padding. Non zero pixels are used.
+  static CalcLumRoiSpec fromMask(int rows, int cols, std::vector<uint8_t> mask);
+  static CalcLumRoiSpec letterbox();
+
+  CalcLumRoiMode getMode() const { return mode_; }
+  // Returns the region for frames of rows x cols pixels. When nothing of the rectangle or the mask is
+  // left in the frame, the whole frame is used. Not to be used in letterbox mode.
+  std::shared_ptr<const CalcLumRoi> resolve(int rows, int cols) const;
+  // Describes the region, so results calculated with different regions are not mixed (see cacheSignature).
+  // Mask is described by its size and a checksum of its pixels.
+  std::string getSignature() const;
+
+private:
+  CalcLumRoiMode mode_{CalcLumRoiMode::Frame};
+  CalcLumRect rect_;
+  int mask_rows_{0};
+  int mask_cols_{0};
+  std::vector<uint8_t> mask_;
+
+  std::shared_ptr<const CalcLumRoi> resolveMask(int rows, int cols) const;
+};
+
+/*
+  Letterbox detection. Rows at the top and bottom and columns at the left and right edge whose
+  average luminance is not above kLetterboxLimit are black bars. Returns the rectangle between the bars,
+  empty rectangle when the frame is too dark to tell them (see kLetterboxMinContent).
+*/
+CalcLumRect detectLetterboxBGR(const uint8_t* data, int rows, int cols, size_t step);
+// Y plane version. pixel_step is the number of bytes between luma values of a row, 2 for packed YUV 4:2:2.
+CalcLumRect detectLetterboxPlane(const uint8_t* data, int rows, int cols, size_t step, int pixel_step);
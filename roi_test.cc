@@ -0,0 +1,121 @@
+/*
+  Set of unit tests for regions of interest and letterbox detection.
+*/
+#include <gtest/gtest.h>
+#include <vector>
+#include "roi.h"
+
+// Creates Y plane with a bright picture of the given rectangle and black (16) bars around it.
+static std::vector<uint8_t> letterboxedPlane(int rows, int cols, const CalcLumRect& picture) {
+  std::vector<uint8_t> plane(rows * cols, 16);
+  for (int i = picture.y; i < picture.y + picture.height; i++) {
+    for (int j = picture.x; j < picture.x + picture.width; j++) {
+      plane[i * cols + j] = 40 + (i * 7 + j * 3) % 200;
+    }
+  }
+  return plane;
+}
+
+TEST(roi, parseRect) {
+  CalcLumRect rect;
+  ASSERT_TRUE(rect.parse("0,140,1920,800"));
+  ASSERT_EQ(CalcLumRect(0, 140, 1920, 800), rect);
+  ASSERT_FALSE(rect.parse("0,140,1920"));
+  ASSERT_FALSE(rect.parse("0,140,1920,800,1"));
+  ASSERT_FALSE(rect.parse("0,-1,1920,800"));
+  ASSERT_FALSE(rect.parse("0,0,0,800"));
+  ASSERT_FALSE(rect.parse("a,0,10,10"));
+  // rect is not changed by invalid text
+  ASSERT_EQ(CalcLumRect(0, 140, 1920, 800), rect);
+}
+
+// Rectangle is cut to the frame. When nothing is left, the whole frame is used.
+TEST(roi, resolveRect) {
+  CalcLumRoiSpec spec = CalcLumRoiSpec::fromRect(CalcLumRect(100, 50, 300, 100));
+  ASSERT_EQ(CalcLumRect(100, 50, 300, 100), spec.resolve(480, 640)->getRect());
+  ASSERT_EQ(CalcLumRect(100, 50, 220, 70), spec.resolve(120, 320)->getRect());
+  ASSERT_EQ(CalcLumRect(0, 0, 80, 40), spec.resolve(40, 80)->getRect());
+  ASSERT_FALSE(spec.resolve(480, 640)->isMasked());
+  ASSERT_EQ(CalcLumRect(0, 0, 640, 480), CalcLumRoiSpec().resolve(480, 640)->getRect());
+}
+
+// Mask is scaled to the frame, only the bounding box of set pixels is kept.
+TEST(roi, resolveMask) {
+  // 4x4 mask with the 2x2 block at column 1, row 2 set, except its last pixel
+  std::vector<uint8_t> pixels(16, 0);
+  pixels[2 * 4 + 1] = 1;
+  pixels[2 * 4 + 2] = 255;
+  pixels[3 * 4 + 1] = 7;
+  CalcLumRoiSpec spec = CalcLumRoiSpec::fromMask(4, 4, pixels);
+
+  std::shared_ptr<const CalcLumRoi> roi = spec.resolve(4, 4);
+  ASSERT_EQ(CalcLumRect(1, 2, 2, 2), roi->getRect());
+  ASSERT_TRUE(roi->isMasked());
+  ASSERT_EQ(std::vector<uint8_t>({0xff, 0xff, 0xff, 0}), std::vector<uint8_t>(roi->getMask(), roi->getMask() + 4));
+
+  // twice as large frame, every mask pixel covers 2x2 pixels
+  roi = spec.resolve(8, 8);
+  ASSERT_EQ(CalcLumRect(2, 4, 4, 4), roi->getRect());
+  ASSERT_EQ(0xff, roi->getMask()[0]);
+  ASSERT_EQ(0, roi->getMask()[3 * 4 + 3]);
+
+  // all pixels of the box are set, so the rectangle alone is used
+  pixels[3 * 4 + 2] = 1;
+  roi = CalcLumRoiSpec::fromMask(4, 4, pixels).resolve(4, 4);
+  ASSERT_EQ(CalcLumRect(1, 2, 2, 2), roi->getRect());
+  ASSERT_FALSE(roi->isMasked());
+}
+
+TEST(roi, signatures) {
+  std::vector<uint8_t> pixels(16, 0);
+  pixels[5] = 1;
+  std::string mask1 = CalcLumRoiSpec::fromMask(4, 4, pixels).getSignature();
+  pixels[5] = 200;
+  ASSERT_EQ(mask1, CalcLumRoiSpec::fromMask(4, 4, pixels).getSignature());
+  pixels[6] = 1;
+  ASSERT_NE(mask1, CalcLumRoiSpec::fromMask(4, 4, pixels).getSignature());
+  ASSERT_NE(CalcLumRoiSpec::fromRect(CalcLumRect(0, 0, 10, 10)).getSignature(),
+            CalcLumRoiSpec::fromRect(CalcLumRect(0, 0, 10, 11)).getSignature());
+  ASSERT_EQ("letterbox", CalcLumRoiSpec::letterbox().getSignature());
+}
+
+TEST(roi, detectLetterboxPlane) {
+  // 2.39:1 picture in 16:9 frame and pillarbox 4:3 picture
+  for (const auto& picture : {CalcLumRect(0, 12, 128, 48), CalcLumRect(16, 0, 96, 72)}) {
+    std::vector<uint8_t> plane = letterboxedPlane(72, 128, picture);
+    ASSERT_EQ(picture, detectLetterboxPlane(plane.data(), 72, 128, 128, 1));
+  }
+
+  // frame without bars
+  std::vector<uint8_t> plane = letterboxedPlane(72, 128, CalcLumRect(0, 0, 128, 72));
+  ASSERT_EQ(CalcLumRect(0, 0, 128, 72), detectLetterboxPlane(plane.data(), 72, 128, 128, 1));
+
+  // packed YUV 4:2:2, every other byte is luma
+  std::vector<uint8_t> packed(72 * 256, 128);
+  for (int i = 0; i < 72; i++) {
+    for (int j = 0; j < 128; j++) {
+      packed[i * 256 + j * 2] = plane[i * 128 + j] * ((i < 10) ? 0 : 1);
+    }
+  }
+  ASSERT_EQ(CalcLumRect(0, 10, 128, 62), detectLetterboxPlane(packed.data(), 72, 128, 256, 2));
+}
+
+// Dark frames and frames with a small bright spot do not tell where the bars are.
+TEST(roi, darkFrameIsNotDetected) {
+  std::vector<uint8_t> plane(72 * 128, 16);
+  ASSERT_TRUE(detectLetterboxPlane(plane.data(), 72, 128, 128, 1).isEmpty());
+  plane = letterboxedPlane(72, 128, CalcLumRect(60, 30, 8, 8));
+  ASSERT_TRUE(detectLetterboxPlane(plane.data(), 72, 128, 128, 1).isEmpty());
+}
+
+// Bars of a BGR frame are found from luminance of its pixels.
+TEST(roi, detectLetterboxBGR) {
+  std::vector<uint8_t> frame(40 * 64 * 3, 0);
+  for (int i = 5; i < 35; i++) {
+    for (int j = 0; j < 64; j++) {
+      // pure blue has luminance 29, just above the limit
+      frame[(i * 64 + j) * 3] = 255;
+    }
+  }
+  ASSERT_EQ(CalcLumRect(0, 5, 64, 30), detectLetterboxBGR(frame.data(), 40, 64, 64 * 3));
+}
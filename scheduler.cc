@@ -1,11 +1,27 @@
 #include "scheduler.h"
+#include <errno.h>
+#include <algorithm>
+
+// sem_wait may be interrupted by a signal. Just wait again.
+static void semWait(sem_t* sem) {
+  while ((0 != sem_wait(sem)) && (EINTR == errno)) {
+  }
+}
 
 /*
   Main scheduler class.
 */
-CalcLumScheduler::CalcLumScheduler(int threads_num) : threads_num_(threads_num) {
+CalcLumScheduler::CalcLumScheduler(int threads_num, CalcLumSchedulingMode mode) :
+  threads_num_(threads_num), mode_(mode), jobs_(max_outstanding_jobs_) {
   sem_init(&jobs_in_queue_, 0, 0);  
+  sem_init(&free_slots_, 0, max_outstanding_jobs_);
 
+  if (CalcLumSchedulingMode::WorkStealing == mode_) {
+    // jobs may be added before any thread is started, so there is always at least one queue
+    for (auto counter = 0; counter < std::max(threads_num_, 1); counter++) {
+      worker_queues_.push_back(std::make_unique<WorkerQueue>());
+    }
+  }
 };
 
 CalcLumScheduler::~CalcLumScheduler() {
@@ -13,12 +29,22 @@ CalcLumScheduler::~CalcLumScheduler() {
     // wait until all threads finish
     it->join();
   }
+  sem_destroy(&jobs_in_queue_);
+  sem_destroy(&free_slots_);
+}
+
+void CalcLumScheduler::setTopology(std::shared_ptr<const CalcLumTopology> topology) {
+  topology_ = topology;
+  node_workers_.assign(topology_->getNodesNum(), std::vector<int>());
+  for (auto worker = 0; worker < threads_num_; worker++) {
+    node_workers_[topology_->getWorkerNode(worker)].push_back(worker);
+  }
 }
 
 // Start required number of worker threads.
 void CalcLumScheduler::start() {
   for (auto counter = 0; counter < threads_num_; counter++) {
-    threads_.push_back(std::make_unique<std::thread>(processingFunc, this));
+    threads_.push_back(std::make_unique<std::thread>(processingFunc, this, counter));
   }
 }
 
@@ -31,56 +57,143 @@ void CalcLumScheduler::stopThreads() {
 
 /*
   Method is used to add a new job into the scheduler.
-  It will pend on condition variable when queue of waiting jobs
+  It will pend on free_slots_ semaphore when queue of waiting jobs
   is too large. This is to avoid a situation when worker threads
   cannot keep up with the main thread which creates jobs.
   The queue could grow so large the OOM would kill the process.
   Here we limit the queue to max_outstanding_jobs_ value.
+  Many reader threads may add jobs at the same time. No lock is taken.
 */
 void CalcLumScheduler::addJob(std::unique_ptr<CalcLumJob> job) {
-  std::unique_lock<std::mutex> lck(jobs_list_lock_);
-  // pend on the condition variable if the queue is too large.
-  cv_.wait(lck, [this]{return jobs_list_.size() < max_outstanding_jobs_;});
-  jobs_list_.push_back(std::move(job));
+  // pend on the semaphore if the queue is full.
+  if (nullptr != profiler_) {
+    profiler_->record(CalcLumStage::QueueDepth, getJobsNum());
+    CalcLumProfiler::Timer timer(profiler_.get(), CalcLumStage::AddJobWait);
+    semWait(&free_slots_);
+    job->setQueuedAt(CalcLumProfiler::now());
+  } else {
+    semWait(&free_slots_);
+  }
+
+  if (CalcLumSchedulingMode::WorkStealing == mode_) {
+    pushWorkerJob(std::move(job));
+  } else {
+    // Free place is guaranteed now, but a worker may still be moving
+    // the job out of the cell, so push may fail for a very short moment.
+    while (!jobs_.push(job)) {
+      std::this_thread::yield();
+    }
+  }
  
-  // signal that there is new job added to the queue
+  // signal that there is new job added to the queue. Only one worker is woken up.
   sem_post(&jobs_in_queue_);
 }
 
 int CalcLumScheduler::getJobsNum() {
-  std::unique_lock<std::mutex> lck(jobs_list_lock_);
-  return jobs_list_.size();
+  if (CalcLumSchedulingMode::WorkStealing == mode_) {
+    return queued_jobs_;
+  }
+  return jobs_.size();
+}
+
+/*
+  Puts job into the next worker's queue (round-robin). When threads are pinned,
+  only workers on the same node as the writer are used.
+  Only that worker's queue is locked, so writers rarely wait for each other.
+*/
+void CalcLumScheduler::pushWorkerJob(std::unique_ptr<CalcLumJob> job) {
+  unsigned int queue = next_queue_++;
+  int node = (nullptr != topology_) ? topology_->getCurrentNode() : -1;
+  if ((0 <= node) && (node < static_cast<int>(node_workers_.size())) && !node_workers_[node].empty()) {
+    // frame stays on the node where it has been decoded
+    queue = node_workers_[node][queue % node_workers_[node].size()];
+  }
+  WorkerQueue& q = *worker_queues_[queue % worker_queues_.size()];
+  std::lock_guard<std::mutex> lck(q.m);
+  q.jobs.push_back(std::move(job));
+  queued_jobs_++;
+}
+
+/*
+  Takes the oldest job from worker's own queue. If the queue is empty,
+  tries to steal the newest job from other workers' queues.
+*/
+bool CalcLumScheduler::popWorkerJob(int worker, std::unique_ptr<CalcLumJob>& job) {
+  int queues = worker_queues_.size();
+  // With pinned threads other workers on the same node are tried first,
+  // remote nodes only in the second pass.
+  int passes = (nullptr != topology_) ? 2 : 1;
+  for (auto pass = 0; pass < passes; pass++) {
+    for (auto counter = 0; counter < queues; counter++) {
+      int victim = (worker + counter) % queues;
+      if ((nullptr != topology_) &&
+          ((0 == pass) != (topology_->getWorkerNode(victim) == topology_->getWorkerNode(worker)))) {
+        continue;
+      }
+      WorkerQueue& q = *worker_queues_[victim];
+      std::lock_guard<std::mutex> lck(q.m);
+      if (q.jobs.empty()) {
+        continue;
+      }
+      if (0 == counter) {
+        job = std::move(q.jobs.front());
+        q.jobs.pop_front();
+      } else {
+        job = std::move(q.jobs.back());
+        q.jobs.pop_back();
+      }
+      queued_jobs_--;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool CalcLumScheduler::takeJob(int worker, std::unique_ptr<CalcLumJob>& job) {
+  if (CalcLumSchedulingMode::WorkStealing == mode_) {
+    return popWorkerJob(worker, job);
+  }
+  return jobs_.pop(job);
 }
 
 /*
   This is worker thread. It just pends on a semaphore waiting 
   for new job to be added to the queue. Then it takes the job from the 
   queue and processes it.
-  If the length os the queue drops below max_outstanding_jobs_ value,
-  it will indicate that new jobs can be added to the queue. See addJob method.
+  After the job has been taken from the queue, one place is freed
+  and a pending writer can add new job. See addJob method.
 */
-void CalcLumScheduler::processingFunc(CalcLumScheduler *s) {
-  bool allow_new_jobs ;
+void CalcLumScheduler::processingFunc(CalcLumScheduler *s, int worker) {
+  if (nullptr != s->topology_) {
+    CalcLumTopology::pinCurrentThread({s->topology_->getWorkerCpu(worker)});
+  }
   while(s->run_) {
     // wait for the semaphore to indicate that there is new job in the queue
-    sem_wait(&s->jobs_in_queue_);
+    semWait(&s->jobs_in_queue_);
 
     std::unique_ptr<CalcLumJob> job;
-    std::unique_lock<std::mutex> lck(s->jobs_list_lock_);
-    allow_new_jobs = (s->jobs_list_.size() < s->max_outstanding_jobs_);
-    if(0 < s->jobs_list_.size()) {
-      job = std::move(s->jobs_list_.front());
-      s->jobs_list_.pop_front();
-      // unlock immediately so other threads can continue
-      lck.unlock();
-      if(allow_new_jobs) {
-        s->cv_.notify_all();
+    bool got_job = true;
+    while (!s->takeJob(worker, job)) {
+      // Semaphore was posted by stopThreads, there is no job.
+      if (!s->run_) {
+        got_job = false;
+        break;
       }
+      // Job is being added by a writer. It will be there in a moment.
+      std::this_thread::yield();
+    }
+    if (!got_job) {
+      continue;
+    }
+    sem_post(&s->free_slots_);
 
-      // now just process the job
+    // now just process the job
+    if (nullptr != s->profiler_) {
+      s->profiler_->record(CalcLumStage::QueueWait, CalcLumProfiler::now() - job->getQueuedAt());
+      CalcLumProfiler::Timer timer(s->profiler_.get(), CalcLumStage::ProcessJob);
+      job->processJob();
+    } else {
       job->processJob(); 
     }
-    
   }
 }
-
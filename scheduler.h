@@ -1,11 +1,25 @@
+#pragma once
 #include <vector>
 #include <thread>
 #include <semaphore.h>
-#include <list>
-#include <mutex>
-#include <condition_variable>
+#include <memory>
 #include <atomic>
+#include <mutex>
+#include <deque>
 #include "job.h"
+#include "jobQueue.h"
+#include "affinity.h"
+#include "profiler.h"
+
+/*
+  How jobs are distributed to worker threads:
+  - GlobalQueue - all workers take jobs from a single lock-free queue.
+  - WorkStealing - each worker has its own queue. Writers put jobs into workers' queues
+    round-robin. A worker takes jobs from its own queue first. When it is empty,
+    the worker steals jobs from other workers' queues. Writers and workers
+    rarely touch the same queue, so there is little contention between them.
+*/
+enum class CalcLumSchedulingMode { GlobalQueue, WorkStealing };
 
 /*
   Main scheduler class definition.
@@ -13,9 +27,15 @@
 class CalcLumScheduler {
 public:
   CalcLumScheduler() = delete;
-  CalcLumScheduler(int threads_num);
+  CalcLumScheduler(int threads_num, CalcLumSchedulingMode mode = CalcLumSchedulingMode::GlobalQueue);
   ~CalcLumScheduler();
 
+  // Worker threads are pinned to CPUs of the topology. Must be called before start.
+  // In WorkStealing mode jobs are put into queues of workers running on the writer's node.
+  void setTopology(std::shared_ptr<const CalcLumTopology> topology);
+  // Time blocked in addJob, time jobs wait in the queue and time of processJob are recorded.
+  // Must be called before start.
+  void setProfiler(std::shared_ptr<CalcLumProfiler> profiler) { profiler_ = profiler; }
   void start();
   int getThreadsNum() const { return threads_.size(); }
 
@@ -24,30 +44,53 @@ public:
   void stopThreads();
  
   int getMaxOutstandingJobs() const { return max_outstanding_jobs_; }
+  CalcLumSchedulingMode getMode() const { return mode_; }
 
 private:
   int threads_num_;
+  CalcLumSchedulingMode mode_;
   std::vector<std::unique_ptr<std::thread> > threads_;
 
+  int max_outstanding_jobs_{50}; // hardcode it to value larger than # of threads
+
   // posix semaphore counting the number of jobs in the queue
   sem_t jobs_in_queue_;
 
-  // list of jobs in the queue
-  std::list<std::unique_ptr<CalcLumJob> > jobs_list_;
-
-  // mutex guarding access to the jobs_list_
-  std::mutex jobs_list_lock_;
-  // condition variable is used as throttle mechanism.
+  // Posix semaphore counting free places in the queue. It is used as throttle mechanism.
   // If the writer is too fast and worker threads are comparatively
   // slow, there would be large number of scheduled jobs waiting in the queue
   // possibly exhausting memory. Therefore only max_outstanding_jobs_ are allowed in
   // the queue.
-  std::condition_variable cv_;
+  sem_t free_slots_;
 
-  int max_outstanding_jobs_{50}; // hardcode it to value larger than # of threads
+  // lock-free queue of jobs with max_outstanding_jobs_ places
+  CalcLumJobQueue<std::unique_ptr<CalcLumJob> > jobs_;
+
+  // Queue owned by a single worker in WorkStealing mode.
+  // The owner takes jobs from the front, other workers steal from the back.
+  struct WorkerQueue {
+    std::mutex m;
+    std::deque<std::unique_ptr<CalcLumJob> > jobs;
+  };
+  std::vector<std::unique_ptr<WorkerQueue> > worker_queues_;
+  // next worker queue to put a job into
+  std::atomic<unsigned int> next_queue_{0};
+  // number of jobs in all worker queues
+  std::atomic<int> queued_jobs_{0};
+
+  // when set, workers are pinned to CPUs
+  std::shared_ptr<const CalcLumTopology> topology_;
+  // indexes of workers running on each node
+  std::vector<std::vector<int> > node_workers_;
+  // when set, stages of jobs are measured
+  std::shared_ptr<CalcLumProfiler> profiler_;
+
+  void pushWorkerJob(std::unique_ptr<CalcLumJob> job);
+  bool popWorkerJob(int worker, std::unique_ptr<CalcLumJob>& job);
+  bool takeJob(int worker, std::unique_ptr<CalcLumJob>& job);
 
   // boolean value to indicate that threads should exit
   std::atomic<bool> run_{true};
 
-  static void processingFunc(CalcLumScheduler *);
+  static void processingFunc(CalcLumScheduler *, int worker);
 };
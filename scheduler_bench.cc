@@ -0,0 +1,72 @@
+/*
+  Benchmarks of the scheduler. Jobs do nothing, so only the cost of handing
+  jobs over from writers to worker threads is measured.
+  Run with: make bench
+*/
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "scheduler.h"
+
+class NoopJob : public CalcLumJob {
+public:
+  NoopJob(std::atomic<int>& counter) : counter_(counter) {}
+  virtual void processJob() override { counter_.fetch_add(1, std::memory_order_relaxed); }
+private:
+  std::atomic<int>& counter_;
+};
+
+static const int kJobsPerWriter = 20000;
+
+/*
+  Arguments: number of worker threads, number of writer threads.
+  Measures how many jobs per second go through the scheduler.
+*/
+static void handOff(benchmark::State& state, CalcLumSchedulingMode mode) {
+  int threads_num = state.range(0);
+  int writers_num = state.range(1);
+  for (auto _ : state) {
+    CalcLumScheduler s(threads_num, mode);
+    s.start();
+    std::atomic<int> counter{0};
+    std::vector<std::thread> writers;
+    for (auto w = 0; w < writers_num; w++) {
+      writers.emplace_back([&s, &counter]{
+        for (auto i = 0; i < kJobsPerWriter; i++) {
+          s.addJob(std::make_unique<NoopJob>(counter));
+        }
+      });
+    }
+    for (auto& writer : writers) {
+      writer.join();
+    }
+    while (counter != writers_num * kJobsPerWriter) {
+      std::this_thread::yield();
+    }
+    s.stopThreads();
+  }
+  state.SetItemsProcessed(state.iterations() * writers_num * kJobsPerWriter);
+}
+
+static void BM_GlobalQueue(benchmark::State& state) {
+  handOff(state, CalcLumSchedulingMode::GlobalQueue);
+}
+
+static void BM_WorkStealing(benchmark::State& state) {
+  handOff(state, CalcLumSchedulingMode::WorkStealing);
+}
+
+static void threadsArgs(benchmark::internal::Benchmark* b) {
+  for (auto writers : {1, 4}) {
+    for (auto threads = 1; threads <= 64; threads *= 2) {
+      b->Args({threads, writers});
+    }
+  }
+  b->ArgNames({"threads", "writers"})->UseRealTime()->Unit(benchmark::kMillisecond);
+}
+
+BENCHMARK(BM_GlobalQueue)->Apply(threadsArgs);
+BENCHMARK(BM_WorkStealing)->Apply(threadsArgs);
+
+BENCHMARK_MAIN();
@@ -5,6 +5,11 @@
 #include <gmock/gmock.h>
 #include "scheduler.h"
 #include "job.h"
+#include "jobQueue.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <chrono>
 
 // Create mock class based on CalcLumJob class
 // It is used to make sure that scheduler invokes processJob method
@@ -98,6 +103,239 @@ TEST(Scheduler, ProcessManyJobsManyThreads) {
   s.stopThreads();
 }
 
+// Job counting how many times it was processed
+class CountingJob : public CalcLumJob {
+public:
+  CountingJob(std::atomic<int>& counter) : counter_(counter) {}
+  virtual void processJob() override { counter_++; }
+private:
+  std::atomic<int>& counter_;
+};
+
+// Job blocking worker thread until released
+class BlockingJob : public CalcLumJob {
+public:
+  BlockingJob(std::atomic<bool>& release) : release_(release) {}
+  virtual void processJob() override {
+    while (!release_) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+private:
+  std::atomic<bool>& release_;
+};
+
+// Wait until counter reaches the value, but not longer than few seconds
+static bool waitForCounter(std::atomic<int>& counter, int value) {
+  for (auto i = 0; i < 5000; i++) {
+    if (counter == value) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return false;
+}
+
+TEST(Scheduler, WriterThrottled) {
+  CalcLumScheduler s(1);
+  s.start();
+
+  // block the only worker thread
+  std::atomic<bool> release{false};
+  s.addJob(std::make_unique<BlockingJob>(release));
+  sleep(1); // wait a bit until thread picks the job
+
+  // fill the queue
+  std::atomic<int> counter{0};
+  for (auto i = 0; i < s.getMaxOutstandingJobs(); i++) {
+    s.addJob(std::make_unique<CountingJob>(counter));
+  }
+  ASSERT_THAT(s.getJobsNum(), testing::Eq(s.getMaxOutstandingJobs()));
+
+  // the next job must wait until there is a place in the queue
+  std::atomic<bool> added{false};
+  std::thread writer([&s, &counter, &added]{ s.addJob(std::make_unique<CountingJob>(counter)); added = true; });
+  sleep(1);
+  ASSERT_FALSE(added);
+
+  release = true;
+  writer.join();
+  ASSERT_TRUE(waitForCounter(counter, s.getMaxOutstandingJobs() + 1));
+  s.stopThreads();
+}
+
+// Profiler sees the writer blocked on the full queue and jobs waiting for the blocked worker.
+TEST(Scheduler, Profiled) {
+  std::shared_ptr<CalcLumProfiler> profiler = std::make_shared<CalcLumProfiler>();
+  CalcLumScheduler s(1);
+  s.setProfiler(profiler);
+  s.start();
+
+  std::atomic<bool> release{false};
+  s.addJob(std::make_unique<BlockingJob>(release));
+  std::atomic<int> counter{0};
+  std::thread writer([&s, &counter]{
+    for (auto i = 0; i <= s.getMaxOutstandingJobs(); i++) {
+      s.addJob(std::make_unique<CountingJob>(counter));
+    }
+  });
+  sleep(1);
+  release = true;
+  writer.join();
+  ASSERT_TRUE(waitForCounter(counter, s.getMaxOutstandingJobs() + 1));
+  s.stopThreads();
+
+  int jobs = s.getMaxOutstandingJobs() + 2;
+  ASSERT_EQ(jobs, profiler->getHistogram(CalcLumStage::AddJobWait).getCount());
+  ASSERT_EQ(jobs, profiler->getHistogram(CalcLumStage::QueueWait).getCount());
+  ASSERT_EQ(jobs, profiler->getHistogram(CalcLumStage::QueueDepth).getCount());
+  ASSERT_LE(s.getMaxOutstandingJobs(), profiler->getHistogram(CalcLumStage::QueueDepth).getMax());
+  // the last job waited for the blocked worker
+  ASSERT_LE(500000000u, profiler->getHistogram(CalcLumStage::AddJobWait).getMax());
+  ASSERT_LE(500000000u, profiler->getHistogram(CalcLumStage::QueueWait).getMax());
+  ASSERT_LE(500000000u, profiler->getHistogram(CalcLumStage::ProcessJob).getMax());
+}
+
+TEST(Scheduler, ManyWritersManyThreads) {
+  CalcLumScheduler s(4);
+  s.start();
+
+  std::atomic<int> counter{0};
+  std::vector<std::thread> writers;
+  for (auto w = 0; w < 4; w++) {
+    writers.emplace_back([&s, &counter]{
+      for (auto i = 0; i < 10000; i++) {
+        s.addJob(std::make_unique<CountingJob>(counter));
+      }
+    });
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+  ASSERT_TRUE(waitForCounter(counter, 40000));
+  ASSERT_THAT(s.getJobsNum(), testing::Eq(0));
+  s.stopThreads();
+}
+
+TEST(SchedulerWorkStealing, AddJob) {
+  CalcLumScheduler s(0, CalcLumSchedulingMode::WorkStealing);
+
+  s.addJob(std::make_unique<MockJob>());
+  s.addJob(std::make_unique<MockJob>());
+  ASSERT_THAT(s.getJobsNum(), testing::Eq(2));
+}
+
+TEST(SchedulerWorkStealing, ProcessManyJobsManyThreads) {
+  CalcLumScheduler s(10, CalcLumSchedulingMode::WorkStealing);
+  s.start();
+  
+  for (auto counter = 0; counter < 100; counter++) {
+    std::unique_ptr<MockJob> job = std::make_unique<MockJob>();
+    EXPECT_CALL(*job, processJob());
+  
+    s.addJob(std::move(job));
+  }
+  sleep(2); // wait a bit until thread picks the job
+  ASSERT_THAT(s.getJobsNum(), testing::Eq(0));
+  s.stopThreads();
+}
+
+// One worker is blocked. Its jobs must be stolen by the other worker.
+TEST(SchedulerWorkStealing, IdleWorkerSteals) {
+  CalcLumScheduler s(2, CalcLumSchedulingMode::WorkStealing);
+  s.start();
+
+  std::atomic<bool> release{false};
+  s.addJob(std::make_unique<BlockingJob>(release));
+  sleep(1); // wait a bit until thread picks the job
+
+  std::atomic<int> counter{0};
+  for (auto i = 0; i < 20; i++) {
+    s.addJob(std::make_unique<CountingJob>(counter));
+  }
+  ASSERT_TRUE(waitForCounter(counter, 20));
+  release = true;
+  s.stopThreads();
+}
+
+TEST(SchedulerWorkStealing, ManyWritersManyThreads) {
+  CalcLumScheduler s(4, CalcLumSchedulingMode::WorkStealing);
+  s.start();
+
+  std::atomic<int> counter{0};
+  std::vector<std::thread> writers;
+  for (auto w = 0; w < 4; w++) {
+    writers.emplace_back([&s, &counter]{
+      for (auto i = 0; i < 10000; i++) {
+        s.addJob(std::make_unique<CountingJob>(counter));
+      }
+    });
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+  ASSERT_TRUE(waitForCounter(counter, 40000));
+  ASSERT_THAT(s.getJobsNum(), testing::Eq(0));
+  s.stopThreads();
+}
+
+TEST(SchedulerWorkStealing, PinnedWorkers) {
+  CalcLumScheduler s(4, CalcLumSchedulingMode::WorkStealing);
+  s.setTopology(std::make_shared<CalcLumTopology>());
+  s.start();
+
+  std::atomic<int> counter{0};
+  for (auto i = 0; i < 1000; i++) {
+    s.addJob(std::make_unique<CountingJob>(counter));
+  }
+  ASSERT_TRUE(waitForCounter(counter, 1000));
+  s.stopThreads();
+}
+
+TEST(JobQueue, FifoOrder) {
+  CalcLumJobQueue<int> q(4);
+
+  for (auto i = 0; i < 4; i++) {
+    ASSERT_TRUE(q.push(i));
+  }
+  int item;
+  for (auto i = 0; i < 4; i++) {
+    ASSERT_TRUE(q.pop(item));
+    ASSERT_EQ(i, item);
+  }
+  ASSERT_FALSE(q.pop(item));
+}
+
+TEST(JobQueue, FullAndWrapAround) {
+  CalcLumJobQueue<int> q(3);
+  int item = 0;
+
+  for (auto round = 0; round < 10; round++) {
+    for (auto i = 0; i < 3; i++) {
+      item = round * 3 + i;
+      ASSERT_TRUE(q.push(item));
+    }
+    item = 100;
+    ASSERT_FALSE(q.push(item));
+    ASSERT_EQ(3u, q.size());
+    for (auto i = 0; i < 3; i++) {
+      ASSERT_TRUE(q.pop(item));
+      ASSERT_EQ(round * 3 + i, item);
+    }
+    ASSERT_EQ(0u, q.size());
+  }
+}
+
+TEST(JobQueue, MovesUniquePtr) {
+  CalcLumJobQueue<std::unique_ptr<int> > q(2);
+  std::unique_ptr<int> item = std::make_unique<int>(7);
+
+  ASSERT_TRUE(q.push(item));
+  ASSERT_EQ(nullptr, item);
+  ASSERT_TRUE(q.pop(item));
+  ASSERT_EQ(7, *item);
+}
+
 int main(int argc, char **argv) {
  ::testing::InitGoogleTest(&argc, argv);
  return RUN_ALL_TESTS();
@@ -0,0 +1,264 @@
+#include "series.h"
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+// How often the writer appends frames done to the output.
+static const std::chrono::milliseconds kFlushPeriod(100);
+static const char kBlockMagic[] = "CLTS";
+
+CalcLumSeriesSlot CalcLumSeries::getSlot(int frame) {
+  int chunk_num = frame / CalcLumSeriesChunk::kChunkFrames;
+  std::lock_guard<std::mutex> lk(m_);
+  std::shared_ptr<CalcLumSeriesChunk>& chunk = chunks_[chunk_num];
+  if (nullptr == chunk) {
+    chunk = std::make_shared<CalcLumSeriesChunk>();
+  }
+  return CalcLumSeriesSlot(chunk, frame);
+}
+
+bool CalcLumSeries::takeRecords(std::vector<Record>& records) {
+  // Read before the entries. When it is set, all frames which will ever be done are done.
+  bool finished = finished_.load(std::memory_order_acquire);
+  while (true) {
+    std::shared_ptr<CalcLumSeriesChunk> chunk;
+    {
+      std::lock_guard<std::mutex> lk(m_);
+      auto it = chunks_.lower_bound(next_frame_ / CalcLumSeriesChunk::kChunkFrames);
+      if (chunks_.end() == it) {
+        return finished;
+      }
+      if (it->first * CalcLumSeriesChunk::kChunkFrames > next_frame_) {
+        // frames between chunks have never been read
+        if (!finished) {
+          return false;
+        }
+        next_frame_ = it->first * CalcLumSeriesChunk::kChunkFrames;
+      }
+      chunk = it->second;
+    }
+
+    int first = next_frame_ % CalcLumSeriesChunk::kChunkFrames;
+    for (auto index = first; index < CalcLumSeriesChunk::kChunkFrames; index++) {
+      const CalcLumSeriesEntry& entry = chunk->entries[index];
+      uint8_t state = entry.state.load(std::memory_order_acquire);
+      if ((CalcLumSeriesEntry::kEmpty == state) && !finished) {
+        return false;
+      }
+      if (CalcLumSeriesEntry::kDone == state) {
+        records.push_back({next_frame_, entry.pts_us, entry.luminance});
+      }
+      next_frame_++;
+    }
+
+    // all frames of the chunk have been taken
+    std::lock_guard<std::mutex> lk(m_);
+    chunks_.erase(next_frame_ / CalcLumSeriesChunk::kChunkFrames - 1);
+  }
+}
+
+CalcLumSeriesWriter::CalcLumSeriesWriter(const std::string& file_name) :
+  out_(file_name, std::ios::binary | std::ios::trunc) {
+  csv_ = (file_name.size() >= 4) && (file_name.compare(file_name.size() - 4, 4, ".csv") == 0);
+  if (csv_ && out_.is_open()) {
+    out_ << "file,frame,pts_ms,luminance\n";
+  }
+}
+
+CalcLumSeriesWriter::~CalcLumSeriesWriter() {
+  finish();
+}
+
+void CalcLumSeriesWriter::start() {
+  thread_ = std::make_unique<std::thread>(writerFunc, this);
+}
+
+std::shared_ptr<CalcLumSeries> CalcLumSeriesWriter::addFile(const std::string& file_name) {
+  std::shared_ptr<CalcLumSeries> series = std::make_shared<CalcLumSeries>(file_name);
+  std::lock_guard<std::mutex> lk(m_);
+  files_.push_back(series);
+  return series;
+}
+
+void CalcLumSeriesWriter::finish() {
+  {
+    std::lock_guard<std::mutex> lk(m_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (nullptr != thread_) {
+    thread_->join();
+    thread_.reset();
+  }
+  // the last frames, the thread may not have seen them
+  flush();
+  out_.flush();
+}
+
+void CalcLumSeriesWriter::writerFunc(CalcLumSeriesWriter *w) {
+  std::unique_lock<std::mutex> lk(w->m_);
+  while (!w->stop_) {
+    w->cv_.wait_for(lk, kFlushPeriod);
+    lk.unlock();
+    w->flush();
+    lk.lock();
+  }
+}
+
+/*
+  Takes frames done from all series and writes them. Finished series are removed.
+  Only the list of series is locked, not the writing.
+*/
+void CalcLumSeriesWriter::flush() {
+  std::list<std::shared_ptr<CalcLumSeries> > files;
+  {
+    std::lock_guard<std::mutex> lk(m_);
+    files = files_;
+  }
+  std::vector<CalcLumSeries::Record> records;
+  for (const auto& series : files) {
+    records.clear();
+    bool complete = series->takeRecords(records);
+    if (!records.empty()) {
+      writeRecords(series->getFileName(), records);
+    }
+    if (complete) {
+      std::lock_guard<std::mutex> lk(m_);
+      files_.remove(series);
+    }
+  }
+}
+
+void CalcLumSeriesWriter::writeRecords(const std::string& name, const std::vector<CalcLumSeries::Record>& records) {
+  if (!out_.is_open()) {
+    return;
+  }
+  std::string data;
+  if (!csv_) {
+    encodeBlock(name, records, data);
+    out_.write(data.data(), data.size());
+    return;
+  }
+  // quotes in the name are doubled
+  std::string quoted = "\"";
+  for (char c : name) {
+    quoted += c;
+    if ('"' == c) {
+      quoted += c;
+    }
+  }
+  quoted += "\"";
+  std::ostringstream lines;
+  lines << std::fixed << std::setprecision(3);
+  for (const auto& record : records) {
+    lines << quoted << "," << record.frame << ",";
+    if (0 <= record.pts_us) {
+      lines << record.pts_us / 1000.0;
+    }
+    lines << "," << static_cast<int>(record.luminance) << "\n";
+  }
+  data = lines.str();
+  out_.write(data.data(), data.size());
+}
+
+static void putVarint(std::string& out, uint64_t value) {
+  while (value >= 0x80) {
+    out += static_cast<char>((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  out += static_cast<char>(value);
+}
+
+static bool getVarint(const uint8_t*& data, const uint8_t* end, uint64_t& value) {
+  value = 0;
+  for (int shift = 0; (shift < 64) && (data < end); shift += 7) {
+    uint8_t byte = *data++;
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if (0 == (byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// zigzag encoding maps small negative numbers to small positive ones
+static uint64_t zigzag(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+/*
+  Frame numbers grow, so their deltas are small. Timestamps grow by the frame duration.
+  Luminance of consecutive frames is close, deltas mod 256 need one byte each and compress well.
+*/
+void CalcLumSeriesWriter::encodeBlock(const std::string& name, const std::vector<CalcLumSeries::Record>& records,
+                                      std::string& out) {
+  out.append(kBlockMagic, sizeof(kBlockMagic) - 1);
+  putVarint(out, name.size());
+  out += name;
+  putVarint(out, records.size());
+  int prev_frame = 0;
+  for (const auto& record : records) {
+    putVarint(out, record.frame - prev_frame);
+    prev_frame = record.frame;
+  }
+  int64_t prev_pts = -1;
+  for (const auto& record : records) {
+    putVarint(out, zigzag(record.pts_us - prev_pts));
+    prev_pts = record.pts_us;
+  }
+  uint8_t prev_luminance = 0;
+  for (const auto& record : records) {
+    out += static_cast<char>(static_cast<uint8_t>(record.luminance - prev_luminance));
+    prev_luminance = record.luminance;
+  }
+}
+
+bool CalcLumSeriesWriter::decodeBlock(const uint8_t*& data, const uint8_t* end, std::string& name,
+                                      std::vector<CalcLumSeries::Record>& records) {
+  const size_t magic_len = sizeof(kBlockMagic) - 1;
+  if ((static_cast<size_t>(end - data) < magic_len) || (0 != std::memcmp(data, kBlockMagic, magic_len))) {
+    return false;
+  }
+  data += magic_len;
+  uint64_t name_len, count;
+  if (!getVarint(data, end, name_len) || (static_cast<uint64_t>(end - data) < name_len)) {
+    return false;
+  }
+  name.assign(reinterpret_cast<const char*>(data), name_len);
+  data += name_len;
+  // each frame takes at least 3 bytes
+  if (!getVarint(data, end, count) || (count > static_cast<uint64_t>(end - data) / 3)) {
+    return false;
+  }
+  records.assign(count, CalcLumSeries::Record());
+  uint64_t value;
+  int prev_frame = 0;
+  for (auto& record : records) {
+    if (!getVarint(data, end, value)) {
+      return false;
+    }
+    record.frame = prev_frame + value;
+    prev_frame = record.frame;
+  }
+  int64_t prev_pts = -1;
+  for (auto& record : records) {
+    if (!getVarint(data, end, value)) {
+      return false;
+    }
+    record.pts_us = prev_pts + unzigzag(value);
+    prev_pts = record.pts_us;
+  }
+  if (static_cast<uint64_t>(end - data) < count) {
+    return false;
+  }
+  uint8_t prev_luminance = 0;
+  for (auto& record : records) {
+    record.luminance = prev_luminance + *data++;
+    prev_luminance = record.luminance;
+  }
+  return true;
+}
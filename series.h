@@ -0,0 +1,141 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+  Luminance of one frame in the time series. The reader fills the timestamp when it reads the frame,
+  the worker sets luminance and marks the entry done. pts_us is -1 when the timestamp is not known.
+*/
+struct CalcLumSeriesEntry {
+  enum State : uint8_t { kEmpty = 0, kDone = 1, kSkipped = 2 };
+  std::atomic<uint8_t> state{kEmpty};
+  uint8_t luminance{0};
+  int64_t pts_us{-1};
+};
+
+// Entries of kChunkFrames consecutive frames.
+struct CalcLumSeriesChunk {
+  static const int kChunkFrames = 4096;
+  std::array<CalcLumSeriesEntry, kChunkFrames> entries;
+};
+
+/*
+  Place of one frame in the series, given to the job processing the frame.
+  The job keeps the chunk alive, so it can be set even after the writer has dropped the chunk
+  (e.g. when the file has been abandoned). Setting it is a plain store, it never blocks.
+*/
+class CalcLumSeriesSlot {
+public:
+  CalcLumSeriesSlot() {}
+  CalcLumSeriesSlot(std::shared_ptr<CalcLumSeriesChunk> chunk, int frame) :
+    chunk_(chunk), entry_(&chunk->entries[frame % CalcLumSeriesChunk::kChunkFrames]) {}
+
+  bool isValid() const { return nullptr != entry_; }
+  void setPts(int64_t pts_us) { entry_->pts_us = pts_us; }
+  void setLuminance(int luminance) {
+    entry_->luminance = luminance;
+    entry_->state.store(CalcLumSeriesEntry::kDone, std::memory_order_release);
+  }
+  void setSkipped() { entry_->state.store(CalcLumSeriesEntry::kSkipped, std::memory_order_release); }
+
+private:
+  std::shared_ptr<CalcLumSeriesChunk> chunk_;
+  CalcLumSeriesEntry* entry_{nullptr};
+};
+
+/*
+  CalcLumSeries stores luminance of frames of one file until they are written.
+  Entries are addressed by frame number, so frames processed out of order by different workers
+  (or read by different segment readers) go straight to their place and no reorder buffer is needed.
+  Chunks are created by reader threads; the writer drops them once all their frames have been written.
+*/
+class CalcLumSeries {
+public:
+  CalcLumSeries() = delete;
+  CalcLumSeries(const std::string& file_name) : file_name_(file_name) {}
+  const std::string& getFileName() const { return file_name_; }
+
+  // Called by reader threads when the frame is read.
+  CalcLumSeriesSlot getSlot(int frame);
+
+  // One frame of the output.
+  struct Record {
+    int frame;
+    int64_t pts_us;
+    uint8_t luminance;
+  };
+  // Called when processing of the file is over, see CalcLumFileCtx::signalEnd.
+  void setFinished() { finished_.store(true, std::memory_order_release); }
+
+  // Called by the writer. Takes records of frames done in order, starting from the first
+  // frame not taken yet, until a frame which has not been processed yet.
+  // When the file is finished, frames never processed are passed over and all records are taken.
+  // Returns true then, the series is complete.
+  bool takeRecords(std::vector<Record>& records);
+
+private:
+  std::string file_name_;
+  std::atomic<bool> finished_{false};
+  std::mutex m_;
+  // chunks by chunk number
+  std::map<int, std::shared_ptr<CalcLumSeriesChunk> > chunks_;
+  // first frame not taken by the writer, used only by the writer
+  int next_frame_{0};
+};
+
+/*
+  CalcLumSeriesWriter writes time series of all files on a background thread.
+  Every kFlushPeriod it takes frames done in each file and appends them to the output,
+  so workers only store luminance into the series and never wait for the disk.
+
+  Output format depends on the file name. Files ending with .csv get lines:
+    "file name",frame,pts_ms,luminance
+  Other files get compact binary blocks. Each block holds frames of one file, columns follow each other:
+    "CLTS", varint name length, name, varint number of frames N,
+    N varint frame number deltas, N zigzag varint pts deltas (microseconds), N uint8 luminance deltas (mod 256).
+  Deltas of the first frame of a block are from 0 (and -1 for pts). See decodeBlock.
+*/
+class CalcLumSeriesWriter {
+public:
+  CalcLumSeriesWriter() = delete;
+  CalcLumSeriesWriter(const std::string& file_name);
+  ~CalcLumSeriesWriter();
+
+  bool isOpen() const { return out_.is_open(); }
+  void start();
+  // Creates series of the file. Frames are written until the series is finished.
+  std::shared_ptr<CalcLumSeries> addFile(const std::string& file_name);
+  // Writes all remaining frames and stops the thread.
+  void finish();
+
+  static void encodeBlock(const std::string& name, const std::vector<CalcLumSeries::Record>& records,
+                          std::string& out);
+  // Decodes a block at data and moves data after it. Returns false when the block is not valid.
+  static bool decodeBlock(const uint8_t*& data, const uint8_t* end, std::string& name,
+                          std::vector<CalcLumSeries::Record>& records);
+
+private:
+  std::ofstream out_;
+  bool csv_;
+  std::unique_ptr<std::thread> thread_;
+
+  // files being written, guarded by m_
+  std::mutex m_;
+  std::condition_variable cv_;
+  std::list<std::shared_ptr<CalcLumSeries> > files_;
+  bool stop_{false};
+
+  void flush();
+  void writeRecords(const std::string& name, const std::vector<CalcLumSeries::Record>& records);
+  static void writerFunc(CalcLumSeriesWriter *);
+};
@@ -0,0 +1,189 @@
+/*
+  Set of unit tests for per-frame luminance time series.
+*/
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "series.h"
+
+// Frames done out of order are taken in order, only up to the first frame not done yet.
+TEST(series, outOfOrderFrames) {
+  CalcLumSeries series("test");
+  std::vector<CalcLumSeriesSlot> slots;
+  for (auto frame = 0; frame < 4; frame++) {
+    slots.push_back(series.getSlot(frame));
+    slots.back().setPts(frame * 40000);
+  }
+  slots[1].setLuminance(11);
+  slots[0].setLuminance(10);
+  slots[3].setLuminance(13);
+
+  std::vector<CalcLumSeries::Record> records;
+  ASSERT_FALSE(series.takeRecords(records));
+  ASSERT_EQ(2u, records.size());
+  ASSERT_EQ(0, records[0].frame);
+  ASSERT_EQ(10, records[0].luminance);
+  ASSERT_EQ(40000, records[1].pts_us);
+
+  slots[2].setLuminance(12);
+  records.clear();
+  ASSERT_FALSE(series.takeRecords(records));
+  ASSERT_EQ(2u, records.size());
+  ASSERT_EQ(2, records[0].frame);
+  ASSERT_EQ(13, records[1].luminance);
+
+  series.setFinished();
+  records.clear();
+  ASSERT_TRUE(series.takeRecords(records));
+  ASSERT_TRUE(records.empty());
+}
+
+// Skipped frames do not stop the writer. Frames never done are passed over when the file is finished.
+TEST(series, skippedAndMissingFrames) {
+  CalcLumSeries series("test");
+  series.getSlot(0).setLuminance(50);
+  series.getSlot(1).setSkipped();
+  series.getSlot(2).setLuminance(52);
+  CalcLumSeriesSlot lost = series.getSlot(3);
+  series.getSlot(4).setLuminance(54);
+  // a frame far away, in another chunk
+  series.getSlot(3 * CalcLumSeriesChunk::kChunkFrames + 5).setLuminance(99);
+
+  std::vector<CalcLumSeries::Record> records;
+  ASSERT_FALSE(series.takeRecords(records));
+  ASSERT_EQ(2u, records.size());
+  ASSERT_EQ(2, records[1].frame);
+
+  series.setFinished();
+  records.clear();
+  ASSERT_TRUE(series.takeRecords(records));
+  ASSERT_EQ(2u, records.size());
+  ASSERT_EQ(4, records[0].frame);
+  ASSERT_EQ(3 * CalcLumSeriesChunk::kChunkFrames + 5, records[1].frame);
+  ASSERT_EQ(99, records[1].luminance);
+
+  // the job may still hold the slot after the series has been written
+  lost.setLuminance(53);
+}
+
+TEST(series, encodeDecode) {
+  std::vector<CalcLumSeries::Record> records = {{0, -1, 0}, {1, 40000, 255}, {3, 120000, 3}, {4, 100000, 128}};
+  std::string data;
+  CalcLumSeriesWriter::encodeBlock("video.mp4", records, data);
+  CalcLumSeriesWriter::encodeBlock("second", {{7, 0, 16}}, data);
+  // header, 4 frames of at most 3 bytes each and luminance
+  ASSERT_GT(4u + 1 + 9 + 1 + 4 * 4 + 4 * 3, data.size() - (4 + 1 + 6 + 1 + 4));
+
+  const uint8_t* pos = reinterpret_cast<const uint8_t*>(data.data());
+  const uint8_t* end = pos + data.size();
+  std::string name;
+  std::vector<CalcLumSeries::Record> decoded;
+  ASSERT_TRUE(CalcLumSeriesWriter::decodeBlock(pos, end, name, decoded));
+  ASSERT_EQ("video.mp4", name);
+  ASSERT_EQ(records.size(), decoded.size());
+  for (size_t i = 0; i < records.size(); i++) {
+    ASSERT_EQ(records[i].frame, decoded[i].frame);
+    ASSERT_EQ(records[i].pts_us, decoded[i].pts_us);
+    ASSERT_EQ(records[i].luminance, decoded[i].luminance);
+  }
+  ASSERT_TRUE(CalcLumSeriesWriter::decodeBlock(pos, end, name, decoded));
+  ASSERT_EQ("second", name);
+  ASSERT_EQ(7, decoded[0].frame);
+  ASSERT_EQ(pos, end);
+
+  // truncated block
+  pos = reinterpret_cast<const uint8_t*>(data.data());
+  ASSERT_FALSE(CalcLumSeriesWriter::decodeBlock(pos, pos + 20, name, decoded));
+}
+
+class SeriesWriterTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    char dir_template[] = "/tmp/calclum_series_XXXXXX";
+    dir_ = mkdtemp(dir_template);
+  }
+
+  void TearDown() override {
+    std::string cmd = "rm -rf " + dir_;
+    ASSERT_EQ(0, system(cmd.c_str()));
+  }
+
+  std::string readFile(const std::string& file_name) {
+    std::ifstream in(file_name, std::ios::binary);
+    std::stringstream content;
+    content << in.rdbuf();
+    return content.str();
+  }
+
+  std::string dir_;
+};
+
+// Many workers finish frames of two files in random order, the output is in frame order.
+TEST_F(SeriesWriterTest, binaryOutput) {
+  const int frames = 10000;
+  std::string file_name = dir_ + "/series.bin";
+  {
+    CalcLumSeriesWriter writer(file_name);
+    ASSERT_TRUE(writer.isOpen());
+    writer.start();
+    std::shared_ptr<CalcLumSeries> a = writer.addFile("a");
+    std::shared_ptr<CalcLumSeries> b = writer.addFile("b");
+    std::vector<CalcLumSeriesSlot> slots;
+    for (auto frame = 0; frame < frames; frame++) {
+      slots.push_back(a->getSlot(frame));
+      slots.push_back(b->getSlot(frame));
+    }
+    std::vector<std::thread> workers;
+    for (auto w = 0; w < 4; w++) {
+      workers.emplace_back([&slots, w]{
+        for (size_t i = w; i < slots.size(); i += 4) {
+          slots[i].setPts(i / 2 * 1000);
+          slots[i].setLuminance(i / 2 % 256);
+        }
+      });
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    a->setFinished();
+    b->setFinished();
+    writer.finish();
+  }
+
+  std::string data = readFile(file_name);
+  const uint8_t* pos = reinterpret_cast<const uint8_t*>(data.data());
+  const uint8_t* end = pos + data.size();
+  std::map<std::string, int> next_frame;
+  std::string name;
+  std::vector<CalcLumSeries::Record> records;
+  while (pos < end) {
+    ASSERT_TRUE(CalcLumSeriesWriter::decodeBlock(pos, end, name, records));
+    for (const auto& record : records) {
+      ASSERT_EQ(next_frame[name]++, record.frame);
+      ASSERT_EQ(record.frame * 1000, record.pts_us);
+      ASSERT_EQ(record.frame % 256, record.luminance);
+    }
+  }
+  ASSERT_EQ(frames, next_frame["a"]);
+  ASSERT_EQ(frames, next_frame["b"]);
+}
+
+TEST_F(SeriesWriterTest, csvOutput) {
+  std::string file_name = dir_ + "/series.csv";
+  {
+    CalcLumSeriesWriter writer(file_name);
+    writer.start();
+    std::shared_ptr<CalcLumSeries> series = writer.addFile("my \"best\" video.mp4");
+    CalcLumSeriesSlot slot = series->getSlot(0);
+    slot.setPts(40000);
+    slot.setLuminance(17);
+    series->getSlot(1).setLuminance(18);
+    series->setFinished();
+  }
+  ASSERT_EQ("file,frame,pts_ms,luminance\n"
+            "\"my \"\"best\"\" video.mp4\",0,40.000,17\n"
+            "\"my \"\"best\"\" video.mp4\",1,,18\n", readFile(file_name));
+}
@@ -0,0 +1,126 @@
+#include "sniffer.h"
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Number of consecutive transport stream packets which must start with the sync byte.
+static const int kTSPackets = 3;
+static const uint8_t kTSSync = 0x47;
+
+static bool startsWith(const uint8_t* data, size_t size, size_t offset, const char* magic, size_t len) {
+  return (offset + len <= size) && (0 == std::memcmp(data + offset, magic, len));
+}
+
+/*
+  Checks sync bytes of the first packets. M2TS packets have 4 bytes of time code before the sync byte.
+  A single 0x47 is too common to be trusted, so several packets must be present.
+*/
+static bool isTransportStream(const uint8_t* data, size_t size, size_t packet_size, size_t sync_offset) {
+  if (sync_offset + (kTSPackets - 1) * packet_size >= size) {
+    return false;
+  }
+  for (size_t offset = sync_offset; offset < size; offset += packet_size) {
+    if (kTSSync != data[offset]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+  ISO base media files (MP4, MOV, 3GP) start with a box: 4 bytes of size and 4 bytes of type.
+  Usually it is ftyp, older QuickTime files may start with other boxes.
+*/
+static bool isISOMedia(const uint8_t* data, size_t size) {
+  static const char* const kBoxes[] = {"ftyp", "moov", "mdat", "free", "skip", "wide", "pnot"};
+  for (const char* box : kBoxes) {
+    if (startsWith(data, size, 4, box, 4)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+CalcLumContainer CalcLumSniffer::sniff(const uint8_t* data, size_t size) {
+  static const uint8_t kEBML[] = {0x1A, 0x45, 0xDF, 0xA3};
+  static const uint8_t kPackHeader[] = {0x00, 0x00, 0x01, 0xBA};
+  static const uint8_t kASF[] = {0x30, 0x26, 0xB2, 0x75, 0x8E, 0x66, 0xCF, 0x11};
+
+  if (isISOMedia(data, size)) {
+    return CalcLumContainer::MP4;
+  }
+  if (isTransportStream(data, size, 188, 0) || isTransportStream(data, size, 192, 4)) {
+    return CalcLumContainer::MPEGTS;
+  }
+  if ((size >= sizeof(kEBML)) && (0 == std::memcmp(data, kEBML, sizeof(kEBML)))) {
+    return CalcLumContainer::Matroska;
+  }
+  if (startsWith(data, size, 0, "RIFF", 4) && startsWith(data, size, 8, "AVI", 3)) {
+    // form type is "AVI " or "AVIX" for extended files
+    return CalcLumContainer::AVI;
+  }
+  if (startsWith(data, size, 0, "YUV4MPEG2", 9)) {
+    return CalcLumContainer::Y4M;
+  }
+  if ((size >= sizeof(kPackHeader)) && (0 == std::memcmp(data, kPackHeader, sizeof(kPackHeader)))) {
+    return CalcLumContainer::MPEGPS;
+  }
+  if (startsWith(data, size, 0, "FLV\x01", 4)) {
+    return CalcLumContainer::FLV;
+  }
+  if ((size >= sizeof(kASF)) && (0 == std::memcmp(data, kASF, sizeof(kASF)))) {
+    return CalcLumContainer::ASF;
+  }
+  if (startsWith(data, size, 0, "OggS", 4)) {
+    return CalcLumContainer::Ogg;
+  }
+  return CalcLumContainer::Unknown;
+}
+
+CalcLumContainer CalcLumSniffer::sniffFile(const std::string& file_name) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (-1 == fd) {
+    return CalcLumContainer::Unknown;
+  }
+  uint8_t data[kSniffSize];
+  size_t size = 0;
+  while (size < kSniffSize) {
+    ssize_t len = pread(fd, data + size, kSniffSize - size, size);
+    if ((-1 == len) && (EINTR == errno)) {
+      continue;
+    }
+    if (len <= 0) {
+      break;
+    }
+    size += len;
+  }
+  close(fd);
+  return sniff(data, size);
+}
+
+const char* CalcLumSniffer::getName(CalcLumContainer container) {
+  switch (container) {
+  case CalcLumContainer::MP4:
+    return "MP4";
+  case CalcLumContainer::MPEGTS:
+    return "MPEG-TS";
+  case CalcLumContainer::Matroska:
+    return "Matroska";
+  case CalcLumContainer::AVI:
+    return "AVI";
+  case CalcLumContainer::Y4M:
+    return "YUV4MPEG2";
+  case CalcLumContainer::MPEGPS:
+    return "MPEG-PS";
+  case CalcLumContainer::FLV:
+    return "FLV";
+  case CalcLumContainer::ASF:
+    return "ASF";
+  case CalcLumContainer::Ogg:
+    return "Ogg";
+  case CalcLumContainer::Unknown:
+    break;
+  }
+  return "unknown";
+}
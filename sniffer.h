@@ -0,0 +1,29 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Containers recognized by their magic numbers.
+enum class CalcLumContainer { Unknown, MP4, MPEGTS, Matroska, AVI, Y4M, MPEGPS, FLV, ASF, Ogg };
+
+/*
+  CalcLumSniffer tells whether a file looks like a video before it is given to the decoder.
+  Only the first kSniffSize bytes are read and compared with magic numbers of common containers:
+   - MP4/MOV: ftyp (or another top level box) at offset 4,
+   - MPEG-TS: sync byte 0x47 repeated every 188 bytes (every 192 bytes in M2TS),
+   - Matroska/WebM: EBML header 1A 45 DF A3,
+   - AVI: RIFF header with AVI form type,
+   - YUV4MPEG2, MPEG-PS pack header, FLV, ASF and Ogg.
+  Some decoders report success when opening e.g. a text file and then never return a frame,
+  so such files are rejected without being opened.
+*/
+class CalcLumSniffer {
+public:
+  static const size_t kSniffSize = 4096;
+
+  // Detects container of data taken from the beginning of a file.
+  static CalcLumContainer sniff(const uint8_t* data, size_t size);
+  // Reads the beginning of the file. Returns Unknown when it cannot be read.
+  static CalcLumContainer sniffFile(const std::string& file_name);
+  static const char* getName(CalcLumContainer container);
+};
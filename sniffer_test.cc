@@ -0,0 +1,89 @@
+/*
+  Set of unit tests for content sniffing.
+*/
+#include <gtest/gtest.h>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <unistd.h>
+#include "sniffer.h"
+
+static CalcLumContainer sniff(const std::vector<uint8_t>& data) {
+  return CalcLumSniffer::sniff(data.data(), data.size());
+}
+
+static std::vector<uint8_t> bytes(const std::string& str) {
+  return std::vector<uint8_t>(str.begin(), str.end());
+}
+
+TEST(sniffer, containers) {
+  ASSERT_EQ(CalcLumContainer::MP4, sniff(bytes(std::string("\0\0\0\x20" "ftypisom", 12))));
+  ASSERT_EQ(CalcLumContainer::MP4, sniff(bytes(std::string("\0\0\0\x08" "wide", 8))));
+  ASSERT_EQ(CalcLumContainer::Matroska, sniff({0x1A, 0x45, 0xDF, 0xA3, 0x9F, 0x42, 0x86, 0x81}));
+  ASSERT_EQ(CalcLumContainer::AVI, sniff(bytes(std::string("RIFF\x10\0\0\0" "AVI LIST", 16))));
+  ASSERT_EQ(CalcLumContainer::Y4M, sniff(bytes("YUV4MPEG2 W64 H48 C420\n")));
+  ASSERT_EQ(CalcLumContainer::MPEGPS, sniff({0x00, 0x00, 0x01, 0xBA, 0x44, 0x00}));
+  ASSERT_EQ(CalcLumContainer::Ogg, sniff(bytes("OggS")));
+  // RIFF alone is e.g. a WAVE file
+  ASSERT_EQ(CalcLumContainer::Unknown, sniff(bytes(std::string("RIFF\x10\0\0\0" "WAVEfmt ", 16))));
+}
+
+TEST(sniffer, transportStream) {
+  std::vector<uint8_t> ts(188 * 10, 0xFF);
+  for (size_t offset = 0; offset < ts.size(); offset += 188) {
+    ts[offset] = 0x47;
+  }
+  ASSERT_EQ(CalcLumContainer::MPEGTS, sniff(ts));
+
+  // a single sync byte is not enough
+  ts.resize(188);
+  ASSERT_EQ(CalcLumContainer::Unknown, sniff(ts));
+
+  // sync bytes must repeat in every packet
+  ts.assign(188 * 10, 0xFF);
+  ts[0] = 0x47;
+  ts[188] = 0x47;
+  ASSERT_EQ(CalcLumContainer::Unknown, sniff(ts));
+
+  // M2TS has 4 bytes of time code before each packet
+  std::vector<uint8_t> m2ts(192 * 10, 0x00);
+  for (size_t offset = 4; offset < m2ts.size(); offset += 192) {
+    m2ts[offset] = 0x47;
+  }
+  ASSERT_EQ(CalcLumContainer::MPEGTS, sniff(m2ts));
+}
+
+TEST(sniffer, notVideo) {
+  ASSERT_EQ(CalcLumContainer::Unknown, sniff(bytes("This is a plain text file.\nIt is not a video.\n")));
+  ASSERT_EQ(CalcLumContainer::Unknown, sniff(bytes("\x7f" "ELF")));
+  ASSERT_EQ(CalcLumContainer::Unknown, sniff({}));
+  // text starting with G (0x47) must not be taken for a transport stream
+  ASSERT_EQ(CalcLumContainer::Unknown, sniff(bytes(std::string(100, 'G'))));
+}
+
+TEST(sniffer, sniffFile) {
+  char file_template[] = "/tmp/calclum_sniffer_XXXXXX";
+  int fd = mkstemp(file_template);
+  ASSERT_NE(-1, fd);
+  close(fd);
+  std::string file_name = file_template;
+
+  {
+    std::ofstream out(file_name, std::ios::binary);
+    out << "hello world\n";
+  }
+  ASSERT_EQ(CalcLumContainer::Unknown, CalcLumSniffer::sniffFile(file_name));
+
+  {
+    std::ofstream out(file_name, std::ios::binary);
+    out.write("\0\0\0\x18" "ftypmp42", 12);
+    // only the beginning is read
+    out << std::string(3 * CalcLumSniffer::kSniffSize, 'x');
+  }
+  ASSERT_EQ(CalcLumContainer::MP4, CalcLumSniffer::sniffFile(file_name));
+  ASSERT_STREQ("MP4", CalcLumSniffer::getName(CalcLumContainer::MP4));
+
+  unlink(file_name.c_str());
+  ASSERT_EQ(CalcLumContainer::Unknown, CalcLumSniffer::sniffFile(file_name));
+}
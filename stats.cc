@@ -0,0 +1,138 @@
+#include "stats.h"
+#include "lumaKernel.h"
+#include <algorithm>
+#include <cassert>
+
+// Merges min and max, -1 means that there is no value yet.
+template <typename T, typename U>
+static void mergeMinMax(T& min, T& max, U other_min, U other_max) {
+  if ((-1 != other_min) && ((-1 == min) || (other_min < min))) {
+    min = other_min;
+  }
+  max = std::max<T>(max, other_max);
+}
+
+void CalcLumStats::addFrame(int frame_luminance) {
+  assert((0 <= frame_luminance) && (frame_luminance <= 255));
+  luminance += frame_luminance;
+  frames++;
+  if ((-1 == min_luminance) || (frame_luminance < min_luminance)) {
+    min_luminance = frame_luminance;
+  }
+  max_luminance = std::max(max_luminance, frame_luminance);
+  median_set[frame_luminance]++;
+}
+
+void CalcLumStats::addFrameFixed(uint32_t frame_luminance_fixed) {
+  addFrame(frame_luminance_fixed >> kLumaFixedShift);
+  if (fine_set.empty()) {
+    fine_set.assign(kFineBinsNum, 0);
+  }
+  luminance_fixed += frame_luminance_fixed;
+  if ((-1 == min_fixed) || (frame_luminance_fixed < min_fixed)) {
+    min_fixed = frame_luminance_fixed;
+  }
+  max_fixed = std::max<long long>(max_fixed, frame_luminance_fixed);
+  fine_set[frame_luminance_fixed >> kFineBinShift]++;
+}
+
+/*
+  Histograms are added even when other has no frames counted, so statistics of frames which have been
+  reported but not counted yet are not lost. Min and max of stats without frames are -1 and do not change anything.
+*/
+void CalcLumStats::merge(const CalcLumStats& other) {
+  luminance += other.luminance;
+  frames += other.frames;
+  mergeMinMax(min_luminance, max_luminance, other.min_luminance, other.max_luminance);
+  addHistogram(median_set.data(), other.median_set.data(), median_set.size());
+
+  if (!other.isExact()) {
+    return;
+  }
+  if (fine_set.empty()) {
+    fine_set.assign(kFineBinsNum, 0);
+  }
+  luminance_fixed += other.luminance_fixed;
+  mergeMinMax(min_fixed, max_fixed, other.min_fixed, other.max_fixed);
+  addHistogram(fine_set.data(), other.fine_set.data(), kFineBinsNum);
+}
+
+void CalcLumTotals::merge(const CalcLumStats& stats) {
+  luminance += stats.luminance;
+  frames += stats.frames;
+  mergeMinMax(min_luminance, max_luminance, stats.min_luminance, stats.max_luminance);
+  addHistogramWide(median_set.data(), stats.median_set.data(), median_set.size());
+
+  if (!stats.isExact()) {
+    return;
+  }
+  if (fine_set.empty()) {
+    fine_set.assign(kFineBinsNum, 0);
+  }
+  luminance_fixed += stats.luminance_fixed;
+  mergeMinMax(min_fixed, max_fixed, stats.min_fixed, stats.max_fixed);
+  addHistogramWide(fine_set.data(), stats.fine_set.data(), kFineBinsNum);
+}
+
+// Used to merge totals of threads, so it is done a few times per run and needs no SIMD.
+void CalcLumTotals::merge(const CalcLumTotals& other) {
+  luminance += other.luminance;
+  frames += other.frames;
+  mergeMinMax(min_luminance, max_luminance, other.min_luminance, other.max_luminance);
+  for (size_t i = 0; i < median_set.size(); i++) {
+    median_set[i] += other.median_set[i];
+  }
+
+  if (other.fine_set.empty()) {
+    return;
+  }
+  if (fine_set.empty()) {
+    fine_set.assign(kFineBinsNum, 0);
+  }
+  luminance_fixed += other.luminance_fixed;
+  mergeMinMax(min_fixed, max_fixed, other.min_fixed, other.max_fixed);
+  for (size_t i = 0; i < fine_set.size(); i++) {
+    fine_set[i] += other.fine_set[i];
+  }
+}
+
+template <typename T>
+static void writeValue(std::ostream& out, const T& value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+static bool readValue(std::istream& in, T& value) {
+  return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+/*
+  Layout: sum, number of frames, min, max and the full median set.
+  Exact mode statistics follow: fixed point sum, min and max and the number of fine histogram bins,
+  which is 0 when the frames were not added in exact mode, followed by the bins.
+*/
+void CalcLumStats::write(std::ostream& out) const {
+  writeValue(out, luminance);
+  writeValue(out, frames);
+  writeValue(out, min_luminance);
+  writeValue(out, max_luminance);
+  writeValue(out, median_set);
+  writeValue(out, luminance_fixed);
+  writeValue(out, min_fixed);
+  writeValue(out, max_fixed);
+  writeValue(out, static_cast<uint32_t>(fine_set.size()));
+  out.write(reinterpret_cast<const char*>(fine_set.data()), fine_set.size() * sizeof(int));
+}
+
+bool CalcLumStats::read(std::istream& in) {
+  uint32_t fine_bins = 0;
+  if (!readValue(in, luminance) || !readValue(in, frames) ||
+      !readValue(in, min_luminance) || !readValue(in, max_luminance) ||
+      !readValue(in, median_set) || !readValue(in, luminance_fixed) ||
+      !readValue(in, min_fixed) || !readValue(in, max_fixed) || !readValue(in, fine_bins) ||
+      ((0 != fine_bins) && (static_cast<uint32_t>(kFineBinsNum) != fine_bins))) {
+    return false;
+  }
+  fine_set.resize(fine_bins);
+  return (0 == fine_bins) || static_cast<bool>(in.read(reinterpret_cast<char*>(fine_set.data()), fine_bins * sizeof(int)));
+}
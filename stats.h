@@ -0,0 +1,76 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+/*
+  Exact mode. Frame luminance is kept in fixed point with kLumaFixedShift fractional bits,
+  so averages are not truncated to whole numbers. The histogram used for the median has
+  kFineBinsNum bins, 16 per whole luminance value. Fixed point value >> kFineBinShift is the bin.
+*/
+const int kLumaFixedShift = 16;
+const int kFineBinsNum = 4096;
+const int kFineBinShift = 12;
+
+/*
+  CalcLumStats holds luminance statistics of a group of frames.
+  It is used to accumulate statistics locally, without any locking,
+  and then merge them into file context in one step.
+*/
+struct CalcLumStats {
+  CalcLumStats() { median_set.fill(0); }
+
+  void addFrame(int frame_luminance);
+  // Exact mode. Adds the frame with whole luminance too, so all members are filled.
+  void addFrameFixed(uint32_t frame_luminance_fixed);
+  void merge(const CalcLumStats& other);
+  // True when frames have been added in exact mode.
+  bool isExact() const { return !fine_set.empty(); }
+
+  // Binary form used by the result cache and by partial stats files, in native byte order.
+  void write(std::ostream& out) const;
+  // Returns false when the data is truncated or not valid.
+  bool read(std::istream& in);
+
+  // sum of luminances of all frames
+  long long luminance{0};
+  int frames{0};
+  // -1 means that no frame has been added yet
+  int min_luminance{-1};
+  int max_luminance{-1};
+  // number of occurances of each luminance value. Used to calculate median.
+  std::array<int, 256> median_set;
+
+  // Exact mode only. Sum, min and max of fixed point luminances and the histogram of
+  // kFineBinsNum bins. fine_set is empty until the first frame is added with addFrameFixed.
+  unsigned long long luminance_fixed{0};
+  long long min_fixed{-1};
+  long long max_fixed{-1};
+  std::vector<int> fine_set;
+};
+
+/*
+  CalcLumTotals holds statistics of many files (see StatsAggregator). A run may have more than 2^31 frames,
+  so the number of frames and the histograms are 64-bit.
+*/
+struct CalcLumTotals {
+  CalcLumTotals() { median_set.fill(0); }
+
+  void merge(const CalcLumStats& stats);
+  void merge(const CalcLumTotals& other);
+
+  long long luminance{0};
+  long long frames{0};
+  // -1 means that no frame has been added yet
+  int min_luminance{-1};
+  int max_luminance{-1};
+  std::array<long long, 256> median_set;
+
+  // Exact mode only, empty fine_set means that no exact statistics have been merged.
+  unsigned long long luminance_fixed{0};
+  long long min_fixed{-1};
+  long long max_fixed{-1};
+  std::vector<long long> fine_set;
+};
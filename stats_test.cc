@@ -0,0 +1,124 @@
+/*
+  Set of unit tests for statistics accumulated outside of file context.
+*/
+#include <gtest/gtest.h>
+#include "stats.h"
+
+TEST(stats, emptyStats) {
+  CalcLumStats stats;
+
+  ASSERT_EQ(0, stats.frames);
+  ASSERT_EQ(0, stats.luminance);
+  ASSERT_EQ(-1, stats.min_luminance);
+  ASSERT_EQ(-1, stats.max_luminance);
+}
+
+TEST(stats, addFrames) {
+  CalcLumStats stats;
+
+  stats.addFrame(20);
+  stats.addFrame(5);
+  stats.addFrame(20);
+  stats.addFrame(200);
+  ASSERT_EQ(4, stats.frames);
+  ASSERT_EQ(245, stats.luminance);
+  ASSERT_EQ(5, stats.min_luminance);
+  ASSERT_EQ(200, stats.max_luminance);
+  ASSERT_EQ(2, stats.median_set[20]);
+  ASSERT_EQ(1, stats.median_set[5]);
+}
+
+TEST(stats, mergeStats) {
+  CalcLumStats stats1, stats2, empty;
+
+  stats1.addFrame(10);
+  stats1.addFrame(30);
+  stats2.addFrame(0);
+  stats2.addFrame(10);
+  stats2.addFrame(40);
+
+  stats1.merge(stats2);
+  stats1.merge(empty);
+  ASSERT_EQ(5, stats1.frames);
+  ASSERT_EQ(90, stats1.luminance);
+  ASSERT_EQ(0, stats1.min_luminance);
+  ASSERT_EQ(40, stats1.max_luminance);
+  ASSERT_EQ(2, stats1.median_set[10]);
+}
+
+TEST(stats, mergeIntoEmpty) {
+  CalcLumStats stats1, stats2;
+
+  stats2.addFrame(7);
+  stats1.merge(stats2);
+  ASSERT_EQ(7, stats1.min_luminance);
+  ASSERT_EQ(7, stats1.max_luminance);
+}
+
+TEST(stats, addFramesFixed) {
+  CalcLumStats stats;
+  ASSERT_FALSE(stats.isExact());
+
+  // 20.5, 20.25 and 5.0625
+  stats.addFrameFixed((20 << kLumaFixedShift) + (1 << (kLumaFixedShift - 1)));
+  stats.addFrameFixed((20 << kLumaFixedShift) + (1 << (kLumaFixedShift - 2)));
+  stats.addFrameFixed((5 << kLumaFixedShift) + (1 << (kLumaFixedShift - 4)));
+  ASSERT_TRUE(stats.isExact());
+  // whole values are kept too
+  ASSERT_EQ(3, stats.frames);
+  ASSERT_EQ(45, stats.luminance);
+  ASSERT_EQ(2, stats.median_set[20]);
+  ASSERT_EQ(45.8125 * (1 << kLumaFixedShift), stats.luminance_fixed);
+  ASSERT_EQ(5.0625 * (1 << kLumaFixedShift), stats.min_fixed);
+  ASSERT_EQ(20.5 * (1 << kLumaFixedShift), stats.max_fixed);
+  ASSERT_EQ(kFineBinsNum, static_cast<int>(stats.fine_set.size()));
+  // 16 bins per whole value
+  ASSERT_EQ(1, stats.fine_set[20 * 16 + 8]);
+  ASSERT_EQ(1, stats.fine_set[20 * 16 + 4]);
+  ASSERT_EQ(1, stats.fine_set[5 * 16 + 1]);
+}
+
+TEST(stats, mergeFixedStats) {
+  CalcLumStats stats1, stats2;
+
+  stats1.addFrame(10);
+  stats2.addFrameFixed(3 << kLumaFixedShift);
+  stats2.addFrameFixed(255 << kLumaFixedShift);
+  stats1.merge(stats2);
+  ASSERT_TRUE(stats1.isExact());
+  ASSERT_EQ(3, stats1.frames);
+  ASSERT_EQ(258u << kLumaFixedShift, stats1.luminance_fixed);
+  ASSERT_EQ(3 << kLumaFixedShift, stats1.min_fixed);
+  ASSERT_EQ(255 << kLumaFixedShift, stats1.max_fixed);
+  ASSERT_EQ(1, stats1.fine_set[kFineBinsNum - 16]);
+}
+
+// Totals of many files count past the 32-bit range.
+TEST(stats, totalsOfManyFiles) {
+  CalcLumStats file;
+  file.frames = 2000000000;
+  file.luminance = 2000000000LL * 100;
+  file.min_luminance = file.max_luminance = 100;
+  file.median_set[100] = 2000000000;
+  file.fine_set.assign(kFineBinsNum, 0);
+  file.fine_set[100 << 4] = 2000000000;
+  file.luminance_fixed = 2000000000ULL * (100 << kLumaFixedShift);
+  file.min_fixed = file.max_fixed = 100 << kLumaFixedShift;
+
+  CalcLumTotals totals, other;
+  totals.merge(file);
+  other.merge(file);
+  totals.merge(other);
+  ASSERT_EQ(4000000000LL, totals.frames);
+  ASSERT_EQ(400000000000LL, totals.luminance);
+  ASSERT_EQ(4000000000LL, totals.median_set[100]);
+  ASSERT_EQ(4000000000LL, totals.fine_set[100 << 4]);
+  ASSERT_EQ(4000000000ULL * (100 << kLumaFixedShift), totals.luminance_fixed);
+  ASSERT_EQ(100, totals.min_luminance);
+  ASSERT_EQ(100 << kLumaFixedShift, totals.max_fixed);
+}
+
+int main(int argc, char **argv) {
+ ::testing::InitGoogleTest(&argc, argv);
+ return RUN_ALL_TESTS();
+}